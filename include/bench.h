@@ -0,0 +1,31 @@
+// File       : bench.h
+// Author     : Jeff Schornick
+//
+// Micro-benchmarks for the parser, interpolators, FIFOs and step output
+//
+// Costs are measured with hal_cycles(): CPU cycles (DWT CYCCNT) on the
+// target, wall-clock ns on the host. Interrupts are left running, so run
+// on an idle machine for repeatable numbers.
+//
+//   target : main menu 'b'
+//   host   : cnc_host -B
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#define BENCH_PARSE_REPS 20   /* passes over the sample lines */
+#define BENCH_FIFO_BYTES 1000
+#define BENCH_OUTPUT_REPS 50  /* passes per move, the fastest one counts */
+
+// Function: bench_run
+//
+// Runs every benchmark and prints the cost per parsed line, per generated
+// step, per FIFO byte and per step output tick. Refuses to run while
+// motion or G-code is queued; afterwards the G-code queue is empty and the
+// modal state is reset.
+void bench_run(void);
+
+#endif /* __BENCH_H */
@@ -0,0 +1,85 @@
+// File       : clock.h
+// Author     : Jeff Schornick
+//
+// System clock modes and the peripheral dividers derived from them
+//
+// Each mode sets MCLK (CPU) from one source together with the core voltage,
+// regulator and flash wait states it needs. SMCLK is held at CLOCK_SMCLK_HZ
+// in every mode, so the UART, SPI and coil timer dividers below are computed
+// once at compile time and stay valid across mode switches.
+//
+// Clock tree (CLOCK_HFXT_48MHZ):
+//   HFXT  48 MHz (PJ.2/PJ.3) -> MCLK, HSMCLK /1 ; SMCLK /2 = 24 MHz
+//   LFXT  32768 Hz           -> ACLK (step timer)
+//
+// CLOCK_HFXT_3MHZ is the idle clock: MCLK = HFXT/16 with the SMCLK source
+// and divider untouched, so clock_scale() can switch between the two while
+// the UART, SPI and timers are running.
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#ifndef __CLOCK_H
+#define __CLOCK_H
+
+#include <stdint.h>
+
+#define CLOCK_ERR 0
+#define CLOCK_OK 1
+
+#define CLOCK_HFXT_HZ  48000000L
+#define CLOCK_DCO_HZ   24000000L
+#define CLOCK_IDLE_HZ  (CLOCK_HFXT_HZ / 16)
+#define CLOCK_SMCLK_HZ 24000000L
+
+// UART, 16x oversampling: N = SMCLK/baud rounded, BRW = N/16, BRF = N%16
+// (see MSP432P4xx TRM section 22.3.10)
+#define CLOCK_UART_BAUD 57600L
+#define CLOCK_UART_N    ((CLOCK_SMCLK_HZ + CLOCK_UART_BAUD/2) / CLOCK_UART_BAUD)
+#define CLOCK_UART_BRW  (CLOCK_UART_N / 16)
+#define CLOCK_UART_BRF  (CLOCK_UART_N % 16)
+
+// SPI bit clock = SMCLK / BRW, rounded down to at most CLOCK_SPI_HZ
+#define CLOCK_SPI_HZ  3000000L
+#define CLOCK_SPI_BRW ((CLOCK_SMCLK_HZ + CLOCK_SPI_HZ - 1) / CLOCK_SPI_HZ)
+
+typedef enum {
+  CLOCK_DCO_24MHZ,   // reset configuration from SystemInit(), HFXT fallback
+  CLOCK_HFXT_48MHZ,
+  CLOCK_HFXT_3MHZ,   // idle, MCLK only divided down from CLOCK_HFXT_48MHZ
+  CLOCK_MODES
+} clock_mode_t;
+
+typedef struct {
+  const char *name;
+  uint32_t mclk_hz;
+  uint32_t cs_ctl1;    // CS_CTL1 source and divider selects
+  uint8_t vcore;       // core voltage level, 0 or 1
+  uint8_t dcdc;        // 1 to run from the DC-DC regulator, 0 for LDO
+  uint8_t flash_wait;  // flash read wait states, both banks
+  uint8_t hfxt;        // mode requires the HFXT oscillator
+} clock_config_t;
+
+extern const clock_config_t clock_configs[CLOCK_MODES];
+extern volatile uint8_t clock_mode;
+
+// Function: clock_init
+//
+// Switches from the SystemInit() reset clock to the given mode. Returns
+// CLOCK_ERR and stays on the DCO if the mode can not be reached.
+uint8_t clock_init(uint8_t mode);
+
+// Function: clock_set
+//
+// Changes to a new mode, ordering the voltage, wait-state and clock steps
+// so the core is never run faster than its current supply allows.
+uint8_t clock_set(uint8_t mode);
+
+// Function: clock_scale
+//
+// Selects CLOCK_HFXT_48MHZ when `busy` and CLOCK_HFXT_3MHZ otherwise. Does
+// nothing unless clock_init() reached the HFXT. Returns 1 if the mode
+// changed, the caller then rescales anything timed from MCLK (SysTick).
+uint8_t clock_scale(uint8_t busy);
+
+#endif /* __CLOCK_H */
@@ -0,0 +1,39 @@
+// File       : coil.h
+// Author     : Jeff Schornick
+//
+// Direct coil current drive for the TMC26x (SPI mode)
+//
+// With DRVCONF.SDOFF set the driver ignores STEP/DIR and takes coil
+// currents from DRVCTL. A timer advances a phase per driver and streams
+// the matching sine/cosine currents through the async SPI queue, giving
+// 1/256 step resolution regardless of MRES.
+//
+// Phase units: 256 per full step, 1024 per electrical cycle.
+//
+// Timer assignment:
+//   TA2 : SMCLK, up mode at COIL_UPDATE_HZ, CCR0 interrupt
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#ifndef __COIL_H
+#define __COIL_H
+
+#include <stdint.h>
+#include "clock.h"
+
+#define COIL_UPDATE_HZ 8000
+#define COIL_SMCLK     CLOCK_SMCLK_HZ
+#define COIL_AMPLITUDE 248  /* peak table value, as the driver's own table */
+
+extern uint8_t coil_mode;       // bitmask of drivers in SPI mode
+extern volatile int32_t coil_phase[];
+
+void coil_init(void);
+void coil_enable(uint8_t tmc, uint8_t enable);
+void coil_set_velocity(uint8_t tmc, int32_t phase_per_s);
+uint32_t coil_datagram(int32_t phase);
+
+void coil_isr(void);
+
+#endif /* __COIL_H */
@@ -0,0 +1,19 @@
+// File       : control.h
+// Author     : Jeff Schornick
+//
+// Main loop work, shared by the firmware and the host simulator
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#ifndef __CONTROL_H
+#define __CONTROL_H
+
+// Function: control_poll
+//
+// One pass of the main loop: processes received characters, feeds queued
+// G-code to the planner and runs the background pollers. Called after
+// every wake-up, never from an ISR.
+void control_poll(void);
+
+#endif /* __CONTROL_H */
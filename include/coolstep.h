@@ -0,0 +1,51 @@
+// File       : coolstep.h
+// Author     : Jeff Schornick
+//
+// Closed-loop current control on top of the TMC26x CoolStep feature
+//
+// The driver's own CoolStep loop scales the coil current between CSCALE/2
+// (or /4) and CSCALE from the StallGuard load. This module samples the
+// load (SG) and actual current (SE) in the background and moves the CSCALE
+// ceiling itself within per-axis bounds: up when the driver is pinned at
+// its ceiling under load, down when the load is light.
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#ifndef __COOLSTEP_H
+#define __COOLSTEP_H
+
+#include <stdint.h>
+
+#define COOLSTEP_PERIOD_MS 30  /* time between samples of the same axis */
+#define COOLSTEP_HISTORY   16  /* samples kept per axis for the status report */
+
+typedef struct {
+  uint8_t cs_min;    // CSCALE bounds for the controller
+  uint8_t cs_max;
+  uint16_t sg_low;   // SG below this (heavy load) may raise CSCALE
+  uint16_t sg_high;  // SG above this (light load) lowers CSCALE
+} coolstep_bounds_t;
+
+typedef struct {
+  uint8_t cs;        // CSCALE ceiling in effect
+  uint8_t se;        // actual current scale reported by the driver
+  uint16_t sg;       // load reported by the driver
+} coolstep_sample_t;
+
+typedef struct {
+  uint8_t enabled;
+  uint8_t cs_saved;  // CSCALE before enabling, restored on disable
+  uint8_t head;      // next history slot
+  uint8_t count;     // valid history entries
+  coolstep_sample_t history[COOLSTEP_HISTORY];
+} coolstep_axis_t;
+
+extern coolstep_bounds_t coolstep_bounds[];
+extern coolstep_axis_t coolstep_axis[];
+
+void coolstep_enable(uint8_t axis, uint8_t enable);
+void coolstep_poll(void);
+void coolstep_report(uint8_t axis);
+
+#endif /* __COOLSTEP_H */
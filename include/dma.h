@@ -0,0 +1,52 @@
+// File       : dma.h
+// Author     : Jeff Schornick
+//
+// MSP432 DMA (ARM uDMA/PL230) channel control table
+//
+// Channel/trigger assignments:
+//   CH2 : EUSCI_B1 TX0 (SPI to the TMC drivers)
+//   CH3 : EUSCI_B1 RX0 (SPI to the TMC drivers), completion on DMA_INT1
+//   CH6 : TA3 CCR0 (STEP_BACKEND_DMA step frames), completion on DMA_INT3
+//   CH7 : TA3 CCR2 (STEP_BACKEND_DMA step periods)
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#ifndef __DMA_H
+#define __DMA_H
+
+#include <stdint.h>
+
+#define DMA_CHANNELS 8
+
+#define DMA_CH_SPI_TX 2
+#define DMA_CH_SPI_RX 3
+#define DMA_CH_STEP_FRAMES 6
+#define DMA_CH_STEP_PERIODS 7
+
+// Channel source (trigger) selection, see MSP432P401R datasheet "DMA Sources"
+#define DMA_SRC_EUSCI_B1_TX0 2
+#define DMA_SRC_EUSCI_B1_RX0 2
+#define DMA_SRC_TA3_CCR0 6
+#define DMA_SRC_TA3_CCR2 6
+
+// Channel control structure, one per channel in each of the primary and
+// alternate halves of the table
+typedef struct {
+  volatile void *src_end;  // address of the last source item
+  volatile void *dst_end;  // address of the last destination item
+  volatile uint32_t ctl;   // UDMA_CHCTL_* word
+  uint32_t spare;
+} dma_desc_t;
+
+extern dma_desc_t dma_ctl_table[];
+
+// Item count field of the control word (count - 1, 10 bits)
+#define DMA_XFER_COUNT(n) ( ((uint32_t)((n) - 1) << 4) & UDMA_CHCTL_XFERSIZE_M )
+
+void dma_init(void);
+void dma_set_source(uint8_t channel, uint8_t source);
+void dma_enable(uint8_t channel);
+void dma_disable(uint8_t channel);
+
+#endif /* __DMA_H */
@@ -0,0 +1,42 @@
+// File       : drive.h
+// Author     : Jeff Schornick
+//
+// Speed-dependent chopper and current scheduling for the TMC26x drivers
+//
+// A small table of velocity bands sets the chopper parameters and run
+// current for each block, queued by the step ISR as it promotes the block
+// and sent before its first step. After the machine has been idle
+// for drive_hold_ms, and the driver reports standstill, current drops to
+// drive_hold_pct of the run current until the next block.
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#ifndef __DRIVE_H
+#define __DRIVE_H
+
+#include <stdint.h>
+#include "motion.h"
+
+typedef struct {
+  uint16_t min_rate;  // band applies at and above this rate (base steps/s)
+  uint8_t chm;        // TMC_CHOP_SPREAD / TMC_CHOP_CONST
+  uint8_t tbl;        // TMC_CHOP_TBL_*
+  uint8_t toff;
+  uint8_t hstrt;
+  uint8_t hend;
+  uint8_t current_pct;  // of the run current, may exceed 100 up to CSCALE 31
+} drive_band_t;
+
+#define DRIVE_BANDS 3
+
+extern drive_band_t drive_bands[];
+extern uint8_t drive_run_cs[];   // run current (CSCALE) per driver
+extern uint8_t drive_hold_pct;
+extern uint16_t drive_hold_ms;
+
+void drive_init(void);
+void drive_poll(void);
+uint8_t drive_block_start(motion_t *block);
+
+#endif /* __DRIVE_H */
@@ -49,6 +49,7 @@ extern uint16_t gcode_cmd_count;
 extern fifo_t gcode_input_fifo;
 
 void init_parser(void);
+void clear_gcode_queue(void);
 
 void init_gcode_state(void);
 
@@ -9,7 +9,7 @@
 #ifndef __GPIO_H
 #define __GPIO_H
 
-#include "msp432p401r.h"
+#include "hal.h"
 
 #define PIN0 BIT0
 #define PIN1 BIT1
@@ -29,51 +29,51 @@
 #define GPIO_RISING    0
 #define GPIO_FALLING   1
 
-static inline uint8_t gpio_intr_flag(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits)
+static inline uint8_t gpio_intr_flag(hal_port_t *port, uint8_t pin_bits)
 {
   return (port->IFG & pin_bits);
 }
 
-static inline void gpio_intr_clear(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits)
+static inline void gpio_intr_clear(hal_port_t *port, uint8_t pin_bits)
 {
   port->IFG &= ~pin_bits;
 }
 
 
-static inline void gpio_high(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits)
+HAL_INLINE void gpio_high(hal_port_t *port, uint8_t pin_bits)
 {
   port->OUT |= pin_bits;
 }
 
 
-static inline void gpio_low(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits)
+HAL_INLINE void gpio_low(hal_port_t *port, uint8_t pin_bits)
 {
   port->OUT &= ~pin_bits;
 }
 
-static inline void gpio_toggle(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits)
+HAL_INLINE void gpio_toggle(hal_port_t *port, uint8_t pin_bits)
 {
   port->OUT ^= pin_bits;
 }
 
-static inline uint8_t gpio_get_output(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits)
+HAL_INLINE uint8_t gpio_get_output(hal_port_t *port, uint8_t pin_bits)
 {
   return (port->OUT & pin_bits);
 }
 
 
-void gpio_set(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits, uint8_t val);
+void gpio_set(hal_port_t *port, uint8_t pin_bits, uint8_t val);
 
-void gpio_toggle(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits);
+void gpio_toggle(hal_port_t *port, uint8_t pin_bits);
 
-void gpio_set_input(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits);
+void gpio_set_input(hal_port_t *port, uint8_t pin_bits);
 
-void gpio_set_output(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits);
+void gpio_set_output(hal_port_t *port, uint8_t pin_bits);
 
-void gpio_set_pullup(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits, uint8_t pull_dir);
+void gpio_set_pullup(hal_port_t *port, uint8_t pin_bits, uint8_t pull_dir);
 
-void gpio_set_interrupt(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits, uint8_t edge);
+void gpio_set_interrupt(hal_port_t *port, uint8_t pin_bits, uint8_t edge);
 
-void gpio_disable_interrupt(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits);
+void gpio_disable_interrupt(hal_port_t *port, uint8_t pin_bits);
 
 #endif /* __GPIO_H */
@@ -0,0 +1,41 @@
+// File       : hal.h
+// Author     : Jeff Schornick
+//
+// Hardware abstraction layer
+//
+// Portable modules (planner, parser, FIFOs, TMC register logic) include
+// this instead of the device header. The backend is picked at build time:
+//
+//   default : MSP432P401R, register access (hal_msp432.h)
+//   HOST    : Linux, memory-backed ports and stubbed peripherals
+//             (hal_host.h, src/host/), see `make host`
+//
+// Both backends provide:
+//   hal_port_t                      GPIO port with OUT/DIR/IN/REN/IES/IE/IFG
+//   P1..P10, BIT0..BIT7             ports and pin masks
+//   hal_irq_disable/hal_irq_enable  global interrupt mask
+//   hal_irq_save/hal_irq_restore    nestable interrupt mask
+//   hal_cycles_init/hal_cycles      free-running 32-bit counter for timing,
+//                                   in HAL_CYCLE_UNIT (CPU cycles or ns),
+//                                   HAL_CYCLE_HZ per second at full speed
+//   HAL_RAMFUNC                     places a hot function in SRAM
+//   HAL_INLINE                      static inline, also at -O0
+//
+// Timer, UART and SPI are abstracted at the driver API (timer.h, uart.h,
+// spi.h), with an alternate implementation per backend.
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#ifndef __HAL_H
+#define __HAL_H
+
+#include <stdint.h>
+
+#ifdef HOST
+#include "hal_host.h"
+#else
+#include "hal_msp432.h"
+#endif
+
+#endif /* __HAL_H */
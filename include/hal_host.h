@@ -0,0 +1,137 @@
+// File       : hal_host.h
+// Author     : Jeff Schornick
+//
+// Hardware abstraction layer, Linux host backend
+//
+// GPIO ports are plain memory so pin state can be inspected. There are no
+// interrupts on the host; the mask is tracked only so misuse shows up.
+//
+// Compilation: host GCC, see `make host`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#ifndef __HAL_HOST_H
+#define __HAL_HOST_H
+
+#include <stdint.h>
+
+typedef struct {
+  volatile uint8_t IN;
+  volatile uint8_t OUT;
+  volatile uint8_t DIR;
+  volatile uint8_t REN;
+  volatile uint8_t IES;
+  volatile uint8_t IE;
+  volatile uint8_t IFG;
+} hal_port_t;
+
+#define HAL_CYCLE_UNIT "ns"
+#define HAL_CYCLE_HZ 1000000000ull
+#define HAL_RAMFUNC
+#define HAL_INLINE static inline __attribute__((always_inline))
+
+#define HAL_PORTS 10
+extern hal_port_t hal_ports[];
+
+#define P1  (&hal_ports[0])
+#define P2  (&hal_ports[1])
+#define P3  (&hal_ports[2])
+#define P4  (&hal_ports[3])
+#define P5  (&hal_ports[4])
+#define P6  (&hal_ports[5])
+#define P7  (&hal_ports[6])
+#define P8  (&hal_ports[7])
+#define P9  (&hal_ports[8])
+#define P10 (&hal_ports[9])
+
+#define BIT0 (uint16_t)(0x0001)
+#define BIT1 (uint16_t)(0x0002)
+#define BIT2 (uint16_t)(0x0004)
+#define BIT3 (uint16_t)(0x0008)
+#define BIT4 (uint16_t)(0x0010)
+#define BIT5 (uint16_t)(0x0020)
+#define BIT6 (uint16_t)(0x0040)
+#define BIT7 (uint16_t)(0x0080)
+
+extern volatile uint32_t hal_irq_masked;
+
+static inline void hal_irq_disable(void)
+{
+  hal_irq_masked = 1;
+}
+
+static inline void hal_irq_enable(void)
+{
+  hal_irq_masked = 0;
+}
+
+static inline uint32_t hal_irq_save(void)
+{
+  uint32_t masked = hal_irq_masked;
+  hal_irq_masked = 1;
+  return masked;
+}
+
+static inline void hal_irq_restore(uint32_t masked)
+{
+  hal_irq_masked = masked;
+}
+
+static inline void hal_cycles_init(void)
+{
+}
+
+// Monotonic wall clock, ns, wraps every ~4.3 s
+uint32_t hal_cycles(void);
+
+
+// Host backend hooks (src/host/)
+
+// Simulated SPI slave: fills rx[] for a job before its callback runs.
+// NULL reads back zeros.
+struct spi_job_s;
+extern void (*spi_host_device)(struct spi_job_s *job);
+
+// Copy UART output to stdout (otherwise it is discarded)
+extern uint8_t uart_host_echo;
+
+// Paced UART, see uart_host.c. Output waits for uart_host_tx_done() and
+// input arrives through uart_host_receive().
+#define UART_HOST_RXIFG 0x01
+#define UART_HOST_TXIFG 0x02
+#define UART_HOST_RXIE  0x01
+#define UART_HOST_TXIE  0x02
+extern uint8_t uart_host_paced;
+extern volatile uint8_t uart_host_ifg;
+extern volatile uint8_t uart_host_ie;
+void uart_host_receive(char c);
+void uart_host_tx_done(void);
+
+// Emulated step (TA1, ACLK) and coil (TA2, SMCLK) timers, up mode. The
+// handlers run only when a driver such as the simulator calls them.
+extern volatile uint16_t timer_host_step_ccr;
+extern volatile uint8_t timer_host_step_ie;
+extern volatile uint16_t timer_host_coil_ccr;
+extern volatile uint8_t timer_host_coil_ie;
+
+// STEP_BACKEND_TIMER: STEP outputs armed for the next step timer match,
+// toggled by timer_host_step_match() when the simulator reaches it
+extern volatile uint8_t timer_host_step_armed;
+void timer_host_step_match(void);
+
+// STEP_BACKEND_AXIS: per-axis compare channels. The simulator sets
+// timer_host_aclk to the tick being handled before calling a handler, and
+// calls timer_host_axis_match() at each enabled axis' match tick.
+extern uint64_t timer_host_aclk;
+extern volatile uint64_t timer_host_axis_at[3];
+extern volatile uint8_t timer_host_axis_ie[3];
+void timer_host_axis_match(uint8_t axis);
+
+// STEP_BACKEND_DMA: the step timer (TA3 on the target, here the same
+// emulated timer) while the DMA streams frames. The simulator calls
+// timer_host_dma_match() at each wrap while timer_host_dma_on, and
+// DMA_INT3_IRQHandler() when it sets timer_host_dma_irq.
+extern volatile uint8_t timer_host_dma_on;
+extern volatile uint8_t timer_host_dma_irq;
+void timer_host_dma_match(void);
+
+#endif /* __HAL_HOST_H */
@@ -0,0 +1,62 @@
+// File       : hal_msp432.h
+// Author     : Jeff Schornick
+//
+// Hardware abstraction layer, MSP432P401R backend
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#ifndef __HAL_MSP432_H
+#define __HAL_MSP432_H
+
+#include <stdint.h>
+#include "msp432p401r.h"
+
+typedef DIO_PORT_Odd_Interruptable_Type hal_port_t;
+
+#define HAL_CYCLE_UNIT "cycles"
+#define HAL_CYCLE_HZ 48000000ull  // at the full-speed MCLK, CLOCK_HFXT_HZ
+
+// Run from SRAM (zero wait state) instead of flash. The section is copied
+// at reset, see Reset_Handler and the .ramfunc output section.
+#define HAL_RAMFUNC __attribute__((section(".ramfunc"), noinline))
+
+// Inlined even at -O0, so RAM functions don't call back into flash
+#define HAL_INLINE static inline __attribute__((always_inline))
+
+HAL_INLINE void hal_irq_disable(void)
+{
+  __disable_irq();
+}
+
+HAL_INLINE void hal_irq_enable(void)
+{
+  __enable_irq();
+}
+
+HAL_INLINE uint32_t hal_irq_save(void)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  return primask;
+}
+
+HAL_INLINE void hal_irq_restore(uint32_t primask)
+{
+  __set_PRIMASK(primask);
+}
+
+// DWT cycle counter, wraps every 2^32 core clocks
+HAL_INLINE void hal_cycles_init(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+HAL_INLINE uint32_t hal_cycles(void)
+{
+  return DWT->CYCCNT;
+}
+
+#endif /* __HAL_MSP432_H */
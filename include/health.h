@@ -0,0 +1,42 @@
+// File       : health.h
+// Author     : Jeff Schornick
+//
+// Periodic TMC26x driver health polling and fault latching
+//
+// Every driver response carries the status flags, so the poller only
+// requests a reading when no other traffic (CoolStep, homing) has produced
+// one recently. New faults are latched and counted per driver. Hard faults
+// (over-temperature shutdown, short to ground) put the machine in feed
+// hold (MOTION_INHIBIT_FAULT) until the latch is cleared from the config
+// menu.
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#ifndef __HEALTH_H
+#define __HEALTH_H
+
+#include <stdint.h>
+#include "tmc.h"
+
+#define HEALTH_FAULTS (TMC_STAT_OT | TMC_STAT_OTPW | TMC_STAT_S2GA | TMC_STAT_S2GB | TMC_STAT_OLA | TMC_STAT_OLB)
+#define HEALTH_HARD_FAULTS (TMC_STAT_OT | TMC_STAT_S2GA | TMC_STAT_S2GB)
+
+// Fault counter slots, in TMC_STAT_* bit order from OT
+#define HEALTH_OT   0
+#define HEALTH_OTPW 1
+#define HEALTH_S2GA 2
+#define HEALTH_S2GB 3
+#define HEALTH_OLA  4
+#define HEALTH_OLB  5
+#define HEALTH_COUNTERS 6
+
+extern uint16_t health_period_ms;   // per-driver poll period, 0 = off
+extern uint8_t health_latched[];    // TMC_STAT_* faults seen since last clear
+extern uint16_t health_counts[][HEALTH_COUNTERS];
+
+void health_poll(void);
+void health_clear(void);
+void health_report(void);
+
+#endif /* __HEALTH_H */
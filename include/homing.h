@@ -0,0 +1,49 @@
+// File       : homing.h
+// Author     : Jeff Schornick
+//
+// Sensorless homing using TMC26x StallGuard2
+//
+// Each axis in turn seeks toward its home end with homing current and
+// StallGuard threshold applied, stops when the driver reports a stall,
+// backs off and zeroes its position.
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#ifndef __HOMING_H
+#define __HOMING_H
+
+#include <stdint.h>
+
+typedef enum {
+  HOMING_IDLE = 0,
+  HOMING_SEEK_START,
+  HOMING_SEEK,
+  HOMING_BACKOFF,
+  HOMING_DONE,
+  HOMING_FAILED
+} homing_state_t;
+
+#define HOMING_SAMPLE_MS  5    /* StallGuard sample period during seek */
+#define HOMING_BLANK_MS   250  /* ignore StallGuard while the axis gets moving */
+#define HOMING_SEEK_CHUNK 200  /* steps per queued seek motion */
+#define HOMING_MOTION_ID  900
+
+// Per-axis settings, indexed by axis (X_AXIS, ...)
+extern int8_t homing_dir[];       // -1 : home at the negative end, +1 : positive
+extern int8_t homing_sgt[];       // StallGuard threshold applied while seeking
+extern uint8_t homing_cscale[];   // current scale applied while seeking
+
+extern uint16_t homing_sg_stall;  // SG10 at or below this is a stall
+extern uint16_t homing_rate;      // seek rate, steps/s
+extern uint32_t homing_travel;    // give up after this many steps
+extern uint16_t homing_backoff;   // steps to back away after the stall
+
+extern homing_state_t homing_state;
+
+void homing_start(void);
+void homing_cancel(void);
+void homing_poll(void);
+uint8_t homing_active(void);
+
+#endif /* __HOMING_H */
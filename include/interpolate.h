@@ -11,8 +11,10 @@
 
 #include "motion.h"
 
-void rapid_interpolate(int32_t *start_pos, int32_t *end_pos, motion_t *motion);
+extern uint8_t interp_rle;
+
+void rapid_interpolate(int32_t *start_pos, int32_t *end_pos, uint32_t rate, motion_t *motion);
 void linear_interpolate(int32_t *start_pos, int32_t *end_pos, uint16_t rate, motion_t *motion);
-void arc_interpolate(int32_t *start_pos, int32_t *end_pos, int32_t x_off, int32_t y_off, uint8_t rot, uint16_t rate, motion_t *motion);
+void arc_interpolate(int32_t *start_pos, int32_t *end_pos, int32_t x_off, int32_t y_off, int8_t rot, uint16_t rate, motion_t *motion);
 
 #endif /* __INTPOLATE_H */
@@ -0,0 +1,63 @@
+// File       : load.h
+// Author     : Jeff Schornick
+//
+// CPU load accounting for the main loop
+//
+// The main loop marks each change of activity with load_mark(); the
+// load_timer_ticks() elapsed since the previous mark are charged to the
+// activity that was running. Interrupts are charged to whatever they
+// interrupted, including sleep; the profiled ISRs (profile.h) are also
+// totalled separately. Totals are kept per LOAD_WINDOW_MS window, for the
+// last LOAD_WINDOWS windows.
+//
+// The load timer runs from SMCLK, which keeps running in LPM0 and at the
+// same rate in every clock mode (clock.h). The DWT cycle counter can stop
+// with the core clock in __sleep(), which would hide idle time.
+//
+// The ISR profile counts CPU cycles. While the clock is scaled down each
+// cycle is taken as load_clock_div full-speed cycles, at the rate in
+// effect when the window closes.
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#ifndef __LOAD_H
+#define __LOAD_H
+
+#include <stdint.h>
+
+#define LOAD_IDLE   0  /* __sleep(), waiting for an interrupt */
+#define LOAD_INPUT  1  /* received characters: menu, G-code parsing */
+#define LOAD_GCODE  2  /* run_gcode: planning and interpolation */
+#define LOAD_POLL   3  /* homing, coolstep, health and drive pollers */
+#define LOAD_OTHER  4  /* rest of the loop (buttons, LED) */
+#define LOAD_PHASES 5
+
+#define LOAD_WINDOW_MS 1000
+#define LOAD_WINDOWS   8
+
+typedef struct {
+  uint32_t ticks[LOAD_PHASES];  // LOAD_TIMER_HZ ticks
+  uint32_t isr;    // profiled ISR time within the window, ticks
+  uint32_t total;
+} load_window_t;
+
+// Function: load_mark
+//
+// Ends the current activity and starts `phase`. Main loop only.
+void load_mark(uint8_t phase);
+
+// Function: load_poll
+//
+// Closes the current window once LOAD_WINDOW_MS has passed
+void load_poll(void);
+
+// Function: load_clock
+//
+// Sets `div`, the full-speed MCLK over the new MCLK, for converting the
+// profiled ISR cycles
+void load_clock(uint8_t div);
+
+void load_report(void);
+
+#endif /* __LOAD_H */
@@ -0,0 +1,40 @@
+// File       : log.h
+// Author     : Jeff Schornick
+//
+// Leveled debug output
+//
+// Messages are wrapped in LOG_ON(level) checks. The build-time ceiling
+// LOG_LEVEL is a constant, so any statement above it folds to if(0) and is
+// dropped by the compiler. Statements at or below the ceiling are further
+// gated by the runtime log_level, which starts at LOG_INFO and is set
+// from the menu ('v').
+//
+//   make LOG_LEVEL=LOG_WARN    # quiet production build
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#ifndef __LOG_H
+#define __LOG_H
+
+#include <stdint.h>
+
+#define LOG_NONE  0
+#define LOG_ERROR 1  /* something failed */
+#define LOG_WARN  2  /* unexpected, but handled */
+#define LOG_INFO  3  /* motion/g-code progress */
+#define LOG_DEBUG 4  /* planner parameters, parsed g-code */
+#define LOG_TRACE 5  /* per-step and per-datagram detail */
+
+// Build-time ceiling, statements above this level are compiled out
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_TRACE
+#endif
+
+extern uint8_t log_level;
+
+#define LOG_ON(level) ( ((level) <= LOG_LEVEL) && ((level) <= log_level) )
+
+const char *log_level_name(uint8_t level);
+
+#endif /* __LOG_H */
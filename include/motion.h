@@ -19,11 +19,12 @@
 #define Y_AXIS 0  // strong 262
 #define Z_AXIS 1  // weak 262
 
-#define MAX_RATE 400
+#define MAX_RATE 400          /* step edges/s per axis the step ISR can sustain */
+#define MOTION_MAX_SHIFT 4    /* coarsest block resolution, 2^n base steps per edge */
 extern uint32_t rapid_rate;
 
 typedef struct {
-  uint16_t timer_ticks;
+  uint16_t timer_ticks;  // step timer period ending at this step, less one
   union {
     struct {
       uint8_t x : 1;
@@ -35,18 +36,36 @@ typedef struct {
     };
     uint8_t step_data;
   };
+  uint8_t repeat;  // further steps just like this one, in the struct's padding
 } step_timing_t;
 
+// Most repeats one entry holds. An entry with DIR flip bits never repeats.
+#define STEP_REPEAT_MAX 0xff
+
 
 // interpolated motion set
 typedef struct motion_s {
   uint16_t id;
   uint8_t dirs[3];  // step direcitons per axis, set once per motion
-  uint16_t count;   // total step changes
+  uint32_t count;   // step table entries, each one or more steps
+  uint8_t shift;    // each step moves 2^shift base microsteps
+  uint8_t axes;     // bitmask of axes that move, (1 << X_AXIS) ...
+  uint16_t rate;    // planned rate, base steps/s
   step_timing_t *steps;  // malloc'd array of timestamped steps
+
+  // STEP_BACKEND_AXIS only (steps is then 0): one stream per axis, where
+  // timer_ticks is the ticks since the axis' previous entry (or the block
+  // start) and step_data holds only that axis' STEP/flip bits. An entry
+  // without the STEP bit is a wait, for intervals longer than 16 bits.
+  uint32_t ticks;                 // block length, step timer ticks
+  uint32_t axis_count[3];
+  step_timing_t *axis_steps[3];   // malloc'd, 0 for an axis that doesn't move
+
+  struct motion_s *done;  // next finished block, see motion_retire()
 } motion_t;
 
 extern volatile int32_t pos[];
+extern int32_t plan_pos[];
 extern int32_t target[];
 
 extern motion_t *motion;
@@ -54,6 +73,11 @@ extern motion_t *next_motion;
 extern uint32_t motion_tick;
 extern uint32_t motion_enabled;
 
+// Reasons motion_start() refuses to run
+#define MOTION_INHIBIT_FAULT 0x01  /* latched driver fault, see health.c */
+#define MOTION_INHIBIT_COIL  0x02  /* a driver is in SPI coil mode, see coil.c */
+extern uint8_t motion_inhibit;
+
 void rapid(uint8_t tmc, int32_t steps);
 
 motion_t *new_linear_motion(int32_t x, int32_t y, int32_t z, uint16_t speed, uint16_t id);
@@ -61,8 +85,23 @@ motion_t *new_rapid_motion(int32_t x, int32_t y, int32_t z, uint16_t id);
 motion_t *new_arc_motion(int32_t x, int32_t y, int32_t x_off, int32_t y_off, int8_t rotation, uint16_t speed, uint16_t id);
 
 void free_motion(motion_t *);
+
+// Function: motion_retire
+//
+// Step ISR only: hands a finished block to the main loop to be freed.
+// free() runs from flash and is not reentrant, while the main loop may be
+// in malloc() planning the next block.
+void motion_retire(motion_t *block);
+
+// Function: motion_reap
+//
+// Main loop: frees the blocks retired since the last call
+void motion_reap(void);
+
 void motion_start(void);
 void motion_stop(void);
+void motion_abort(void);
+uint32_t motion_rate_limit(void);
 
 void goto_pos(int32_t x, int32_t y, int32_t z);
 
@@ -0,0 +1,80 @@
+// File       : profile.h
+// Author     : Jeff Schornick
+//
+// Interrupt execution time and entry latency profiling
+//
+// Each instrumented handler reads hal_cycles() on entry and calls
+// prof_isr() on exit. Times are kept as min/max/sum and as log2 histograms
+// (bin n counts values in [2^(n-1), 2^n), bin 0 counts zero).
+//
+// Entry latency needs a hardware reference for when the interrupt was
+// raised, so it is only recorded where one exists:
+//   step timer : TA1R counts ACLK since the CCR0 match, so latency has one
+//                ACLK tick of resolution, SystemCoreClock / 32768 cycles
+//                at whatever MCLK clock_scale has set
+// Other handlers pass PROF_NO_LATENCY.
+//
+// Units are HAL_CYCLE_UNIT. Build with PROF_ENABLE=0 to compile it out.
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+#include <stdint.h>
+#include "hal.h"
+
+#ifndef PROF_ENABLE
+#define PROF_ENABLE 1
+#endif
+
+#define PROF_STEP  0  /* TA1_0_IRQHandler */
+#define PROF_UART  1  /* EUSCIA0_IRQHandler */
+#define PROF_PORT1 2  /* PORT1_IRQHandler */
+#define PROF_DMA   3  /* DMA_INT3_IRQHandler */
+#define PROF_ISRS  4
+
+#define PROF_BINS 20
+#define PROF_NO_LATENCY 0xffffffff
+
+typedef struct {
+  uint32_t count;
+  uint32_t exec_min;
+  uint32_t exec_max;
+  uint64_t exec_sum;
+  uint32_t lat_count;
+  uint32_t lat_min;
+  uint32_t lat_max;
+  uint64_t lat_sum;
+  uint16_t exec_hist[PROF_BINS];  // saturating
+  uint16_t lat_hist[PROF_BINS];
+} prof_isr_t;
+
+extern prof_isr_t prof_isrs[];
+
+#if PROF_ENABLE
+
+void prof_record(uint8_t isr, uint32_t exec, uint32_t latency);
+
+// Function: prof_isr
+//
+// Records one run of a handler that started at hal_cycles() == start.
+// Call last thing in the handler.
+HAL_INLINE void prof_isr(uint8_t isr, uint32_t start, uint32_t latency)
+{
+  prof_record(isr, hal_cycles() - start, latency);
+}
+
+#else
+
+HAL_INLINE void prof_isr(uint8_t isr, uint32_t start, uint32_t latency)
+{
+}
+
+#endif
+
+void prof_reset(void);
+void prof_report(void);
+
+#endif /* __PROFILE_H */
@@ -1,7 +1,7 @@
 // File       : spi.h
 // Author     : Jeff Schornick
 //
-// MSP432 SPI driver using interrupts and a pair of RX/TX buffers.
+// MSP432 SPI driver using DMA and a queue of transactions.
 // EUSCIB0 is connected SPI bus for the TMC stepper drivers
 //
 // SPI1:
@@ -21,8 +21,45 @@
 #define _SPI_H
 
 #include <stdint.h>
+#include "gpio.h"
+
+#define SPI_ERR 0
+#define SPI_OK 1
+
+#define SPI_JOB_QUEUE_SIZE 32
+#define SPI_JOB_MAX_LEN 4
+
+struct spi_job_s;
+typedef void (*spi_callback_t)(struct spi_job_s *job);
+
+// A single chip-select framed transaction. Jobs are copied into the queue,
+// the callback receives the queued copy with rx[] filled in.
+typedef struct spi_job_s {
+  hal_port_t *cs_port;  // slave select, active low
+  uint8_t cs_pin;
+  uint8_t len;                 // bytes to shift, [1, SPI_JOB_MAX_LEN]
+  uint8_t tx[SPI_JOB_MAX_LEN];
+  uint8_t rx[SPI_JOB_MAX_LEN];
+  uint8_t tag;                 // client data, e.g. the device index
+  void *arg;                   // client data
+  spi_callback_t callback;     // called from the DMA ISR, may be NULL
+} spi_job_t;
 
 void spi_init(void);
 uint8_t spi_send_byte(uint8_t);
 
+// Function: spi_queue_job
+//
+// Queues a transaction and starts the bus if idle. Safe to call from an ISR.
+// Returns SPI_ERR if the queue is full.
+uint8_t spi_queue_job(spi_job_t *job);
+
+// Number of jobs queued or in flight
+uint8_t spi_pending(void);
+
+// Busy-wait until all queued jobs have completed
+void spi_flush(void);
+
+void DMA_INT1_IRQHandler(void);
+
 #endif /* _SPI_H */
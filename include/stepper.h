@@ -0,0 +1,214 @@
+// File       : stepper.h
+// Author     : Jeff Schornick
+//
+// Step generation, run from the step timer interrupt
+//
+// The step timer (see timer.c) only acknowledges its interrupt and calls
+// stepper_isr(). Timer access goes through step_timer_*(), so the same
+// code runs against the host simulator's virtual clock.
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#ifndef __STEPPER_H
+#define __STEPPER_H
+
+#include <stdint.h>
+#include "hal.h"
+#include "gpio.h"
+#include "tmc.h"
+#include "motion.h"
+
+// Step output path, `make STEPPER_LUT=1`
+//   0 : per axis, the default. Each axis' STEP and flip flags are tested
+//       and only the moving axes' pins are toggled.
+//   1 : table driven. A tick's step_data code (the six STEP and DIR flip
+//       flags of step_timing_t) indexes precomputed per-port XOR masks and
+//       position deltas are added without branching. Every tick writes
+//       each of the STEPPER_PORTS ports once and adds to every axis,
+//       however many axes move.
+// In both the DIR pins are only touched on the rare ticks that reverse an
+// axis. The menu benchmark ('b') times one against the other; the table
+// stays opt-in until target cycle counts show it is the faster.
+#ifndef STEPPER_LUT
+#define STEPPER_LUT 0
+#endif
+
+// Step output backend, `make STEP_BACKEND=STEP_BACKEND_TIMER`
+//   GPIO  : stepper_isr() toggles the STEP pins with stepper_output(), so
+//           any delay in entering the ISR delays the edges
+//   TIMER : each STEP pin is a TA1 compare output in toggle mode, mapped
+//           through PMAP. The ISR arms the next tick's outputs with
+//           step_timer_arm() and the timer places the edges exactly; the
+//           ISR only has to run before the following tick.
+//   AXIS  : as TIMER, but each axis' compare channel runs its own interval
+//           stream (motion_t.axis_steps) with its own interrupt, so an axis
+//           is never rounded onto another's ticks. CCR0 only paces the
+//           blocks: every stream starts at the block start and a linear
+//           block's last steps all land on its final tick.
+//   DMA   : the STEP outputs are TA1 compare outputs held in OUTMOD 0, and
+//           the DMA writes a table of output levels (frames) to them, one
+//           frame per step timer (TA3) period, loading each period from a
+//           second table. The CPU is interrupted only when one half of the
+//           double-buffered table is done, to apply DIR reversals and pos[]
+//           and refill it, and at block boundaries.
+// With every backend a stop halts the STEP edges within a tick and a later
+// start resumes the block where it was held, see stepper_hold().
+#define STEP_BACKEND_GPIO  0
+#define STEP_BACKEND_TIMER 1
+#define STEP_BACKEND_AXIS  2
+#define STEP_BACKEND_DMA   3
+#ifndef STEP_BACKEND
+#define STEP_BACKEND STEP_BACKEND_GPIO
+#endif
+
+#define STEPPER_PORTS 3     /* distinct ports the STEP/DIR pins may span */
+#define STEPPER_CODES 64    /* step_data values, six flag bits */
+#define STEPPER_CODE_MASK (STEPPER_CODES - 1)
+#define STEPPER_FLIP_BITS 0x2a  /* x_flip, y_flip, z_flip */
+
+// Bit of an axis' STEP flag in step_data, its flip flag is the next bit up
+#define STEPPER_BIT(axis) ( ((axis) == X_AXIS) ? 0 : ((axis) == Y_AXIS) ? 2 : 4 )
+
+typedef struct {
+  uint8_t step[STEPPER_PORTS];  // STEP pins to toggle, per stepper_ports[]
+  uint8_t dir[STEPPER_PORTS];   // DIR pins to toggle after the step
+} stepper_masks_t;
+
+// STEP_BACKEND_DMA table, two halves of up to STEPPER_DMA_FRAMES frames.
+// A half ends early after a frame that reverses an axis, so the DIR flip
+// is made by stepper_dma_isr() before the next frame, and with a block's
+// last step, where the next block is started.
+#define STEPPER_DMA_FRAMES 32
+
+typedef struct {
+  uint16_t out[STEPPER_DMA_FRAMES][3];  // TA1 CCTL1-3 word per frame, by axis
+  uint16_t period[STEPPER_DMA_FRAMES];  // step timer period ending at each frame
+  uint8_t frames;
+  uint8_t flip;         // flip bits of the last frame, applied after it
+  uint8_t end;          // last frame is the block's last step
+  uint16_t edges[3];    // STEP edges per axis
+  uint16_t from[3];     // output words before the first frame
+  uint32_t tick;        // block entry and its repeats at the first frame
+  uint8_t repeat;
+} stepper_half_t;
+
+extern stepper_half_t stepper_half[2];
+
+extern hal_port_t *stepper_ports[STEPPER_PORTS];
+extern stepper_masks_t stepper_lut[STEPPER_CODES];
+extern int32_t stepper_delta[3];
+
+// Function: stepper_init
+//
+// Builds stepper_lut[] from the STEP/DIR pins in tmc_pins[]. Call after
+// tmc_init() and before the first motion.
+void stepper_init(void);
+
+// Function: stepper_output_axes
+//
+// Outputs one tick through the per-axis path, see stepper_output()
+HAL_INLINE void stepper_output_axes(uint8_t code)
+{
+  uint8_t i;
+
+  for(i=0; i<3; i++) {
+    if (code & (1 << STEPPER_BIT(i))) {
+#if STEP_BACKEND == STEP_BACKEND_GPIO
+      gpio_toggle(tmc_pins[i].step_port, tmc_pins[i].step_pin);
+#endif
+      pos[i] += stepper_delta[i];
+    }
+  }
+  if (code & STEPPER_FLIP_BITS) {
+    for(i=0; i<3; i++) {
+      if (code & (2 << STEPPER_BIT(i))) {
+        gpio_toggle(tmc_pins[i].dir_port, tmc_pins[i].dir_pin);
+        stepper_delta[i] = -stepper_delta[i];
+      }
+    }
+  }
+}
+
+// Function: stepper_output_lut
+//
+// Outputs one tick through stepper_lut[], see stepper_output()
+HAL_INLINE void stepper_output_lut(uint8_t code)
+{
+  const stepper_masks_t *m = &stepper_lut[code & STEPPER_CODE_MASK];
+  int32_t on, flip;
+  uint8_t i;
+
+#if STEP_BACKEND == STEP_BACKEND_GPIO
+  for(i=0; i<STEPPER_PORTS; i++) {
+    stepper_ports[i]->OUT ^= m->step[i];
+  }
+#endif
+  if (code & STEPPER_FLIP_BITS) {
+    for(i=0; i<STEPPER_PORTS; i++) {
+      stepper_ports[i]->OUT ^= m->dir[i];
+    }
+  }
+  for(i=0; i<3; i++) {
+    on = -(int32_t) ((code >> STEPPER_BIT(i)) & 1);
+    flip = -(int32_t) ((code >> (STEPPER_BIT(i) + 1)) & 1);
+    pos[i] += stepper_delta[i] & on;
+    stepper_delta[i] = (stepper_delta[i] ^ flip) - flip;
+  }
+}
+
+// Function: stepper_output
+//
+// Outputs one tick: STEP edges, then DIR flips (so DIR never changes with
+// the edge that samples it), then moves pos[] and negates the delta of
+// each flipped axis. With the TIMER, AXIS and DMA backends the STEP edges
+// have already been made by the timer and only the rest is done.
+HAL_INLINE void stepper_output(uint8_t code)
+{
+#if STEPPER_LUT
+  stepper_output_lut(code);
+#else
+  stepper_output_axes(code);
+#endif
+}
+
+// Function: stepper_isr
+//
+// Outputs the next step of the active motion and sets the timer period to
+// the following one. Promotes next_motion when the active one completes.
+// Called with the step timer interrupt disabled; re-enables it if stepping
+// continues.
+void stepper_isr(void);
+
+// Function: stepper_axis_isr
+//
+// STEP_BACKEND_AXIS only: finishes an axis' stream entry whose compare
+// match has just happened and schedules its next one. With this backend
+// stepper_isr() runs only at block boundaries.
+void stepper_axis_isr(uint8_t axis);
+
+// Function: stepper_dma_isr
+//
+// STEP_BACKEND_DMA only: the DMA has written the last frame of stepper_half
+// `half`. Starts the other half, accounts for this one and refills it, or
+// completes the block and starts the next. With this backend stepper_isr()
+// only starts motion from idle.
+void stepper_dma_isr(uint8_t half);
+
+// Function: stepper_hold
+//
+// Called by motion_stop() with motion_enabled cleared. The GPIO and TIMER
+// backends stop at their next tick on their own; the AXIS and DMA streams
+// would run to the end of the block, so they are halted here with their
+// outputs parked and pos[] up to date. The active block keeps its place
+// and the next motion_start() carries on from the first step not made.
+void stepper_hold(void);
+
+// Function: stepper_dma_abort
+//
+// STEP_BACKEND_DMA only: the stream was stopped with `written` frames of
+// stepper_half `half` out. Brings pos[] and DIR up to date with them and
+// rewinds the block to the first frame not written.
+void stepper_dma_abort(uint8_t half, uint8_t written);
+
+#endif /* __STEPPER_H */
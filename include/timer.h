@@ -9,9 +9,99 @@
 #ifndef __TIMER_H
 #define __TIMER_H
 
+#include <stdint.h>
+#include "clock.h"
+
+// Step timer clock, ACLK from the LFXT
+#define STEP_TIMER_HZ 32768
+
+// Load timer clock, SMCLK/64 (TA0). Unlike the DWT cycle counter it keeps
+// counting in LPM0 and runs at the same rate in every clock mode.
+#define LOAD_TIMER_HZ (CLOCK_SMCLK_HZ / 64)
+
+// Function: load_timer_ticks
+//
+// Free-running LOAD_TIMER_HZ count, wraps every ~3 hours
+uint32_t load_timer_ticks(void);
+
+// Milliseconds since systick_init(), wraps after ~49 days
+extern volatile uint32_t systick_ms;
+
 void timer_init(void);
+void systick_init(void);
+void systick_rescale(void);
 
 void step_timer_on(void);
+void step_timer_off(void);
 void step_timer_period(uint16_t);
 
+// Function: step_timer_arm
+//
+// STEP_BACKEND_TIMER only: the STEP outputs of the axes flagged in `code`
+// (a step_data value) toggle at the next tick, the others stay put.
+// Call after step_timer_period() has set that tick.
+void step_timer_arm(uint8_t code);
+
+// Ticks the step timer was already past when scheduled, and so was
+// pushed back to just after the ISR (STEP_BACKEND_TIMER, STEP_BACKEND_AXIS)
+extern volatile uint32_t step_timer_slips;
+
+// Function: step_axis_start
+//
+// STEP_BACKEND_AXIS only: schedules an axis' first compare match `ticks`
+// after the step timer tick being handled (the block start). The axis'
+// STEP output toggles at the match if `step`, and stepper_axis_isr() runs.
+void step_axis_start(uint8_t axis, uint16_t ticks, uint8_t step);
+
+// Function: step_axis_next
+//
+// As step_axis_start(), `ticks` after the axis' previous match. Called
+// from stepper_axis_isr().
+void step_axis_next(uint8_t axis, uint16_t ticks, uint8_t step);
+
+// Function: step_axis_stop
+//
+// Parks an axis' STEP output and disables its compare interrupt
+void step_axis_stop(uint8_t axis);
+
+// STEP_BACKEND_DMA frame word holding a STEP output high: TA1 CCTLn in
+// OUTMOD 0 with the OUT bit set. Low is 0.
+#define STEP_DMA_HIGH 0x0004
+
+// Function: step_dma_start
+//
+// STEP_BACKEND_DMA only: restarts the step timer from the tick being
+// handled with the given period and streams stepper_half[0], then [1] if
+// filled. Frame 0 lands at the end of that period, the DMA loads every
+// later period from the table.
+void step_dma_start(uint16_t period);
+
+// Function: step_dma_frames
+//
+// Continues the frame stream with stepper_half[half]. Its first frame lands
+// at the end of the period already running, so this must be called within
+// it (at least one tick).
+void step_dma_frames(uint8_t half);
+
+// Function: step_dma_periods
+//
+// Queues stepper_half[half].period[first...] to be loaded, one per period,
+// after the other half's.
+void step_dma_periods(uint8_t half, uint8_t first);
+
+// Current level of an axis' STEP output, 0 or 1
+uint8_t step_dma_level(uint8_t axis);
+
+void coil_timer_init(uint16_t period);
+void coil_timer_on(void);
+void coil_timer_off(void);
+
+void SysTick_Handler(void);
+void TA0_N_IRQHandler(void);
+void TA1_0_IRQHandler(void);
+void TA1_N_IRQHandler(void);
+void TA2_0_IRQHandler(void);
+void TA3_0_IRQHandler(void);
+void DMA_INT3_IRQHandler(void);
+
 #endif /* __TIMER_H */
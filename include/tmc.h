@@ -10,8 +10,9 @@
 #define _TMC_H
 
 #include <stdint.h>
-#include "msp432p401r.h"
+#include "hal.h"
 #include "gpio.h"
+#include "spi.h"
 
 // The selected stepper controller
 extern uint8_t tmc;
@@ -65,13 +66,13 @@ extern uint8_t tmc_axis_conf[];
 #define TMC2_DIR_PIN  PIN6
 
 typedef struct {
-  DIO_PORT_Odd_Interruptable_Type *cs_port;
+  hal_port_t *cs_port;
   uint8_t cs_pin;
-  DIO_PORT_Odd_Interruptable_Type *en_port;
+  hal_port_t *en_port;
   uint8_t en_pin;
-  DIO_PORT_Odd_Interruptable_Type *step_port;
+  hal_port_t *step_port;
   uint8_t step_pin;
-  DIO_PORT_Odd_Interruptable_Type *dir_port;
+  hal_port_t *dir_port;
   uint8_t dir_pin;
 } tmc_pinout_t;
 
@@ -155,6 +156,18 @@ typedef union {
   uint32_t raw;
 } drvctl_t;
 
+// DRVCTL in SPI mode (DRVCONF.SDOFF = 1): coil currents written directly
+typedef union {
+  struct {
+    uint32_t CB         : 8;  // coil B current magnitude, scaled by CSCALE
+    uint32_t PHB        : 1;  // coil B polarity, 1 = reversed
+    uint32_t CA         : 8;
+    uint32_t PHA        : 1;
+    uint32_t ADDR       : 2;  // 00b
+  };
+  uint32_t raw;
+} drvctl_spi_t;
+
 
 
 /////////////////////////////////////////
@@ -260,6 +273,25 @@ typedef struct {
 
 extern tmc_config_t tmc_config[];
 
+// Resolution that pos[] and the planner count in (set from the menu). Fast
+// blocks may run the driver coarser, see tmc_set_step_shift().
+extern uint8_t tmc_base_mres[];
+
+// Shadow copy of the last datagram written to each register, indexed by
+// TMC_REG_*. Only registers flagged in tmc_shadow_valid are known.
+#define TMC_REG_DRVCTL   0
+#define TMC_REG_CHOPCONF 1
+#define TMC_REG_SMARTEN  2
+#define TMC_REG_SGCSCONF 3
+#define TMC_REG_DRVCONF  4
+#define TMC_REG_COUNT    5
+
+// Register index from a datagram's address bits (DRVCTL is the only one with bit 19 clear)
+#define TMC_REG_INDEX(data) ( ((data) & 0x80000) ? ((((data) >> 17) & 0x3) + 1) : TMC_REG_DRVCTL )
+
+extern uint32_t tmc_shadow[][TMC_REG_COUNT];
+extern uint8_t tmc_shadow_valid[];
+
 
 /////////////////////////////////////////////
 // TMC 20-bit response, structure definition
@@ -311,8 +343,32 @@ typedef union {
   ustep_resp_t ustep;
   sg_resp_t sg;
   sgcs_resp_t sgcs;
+  uint32_t raw;
 } tmc_response_t;
 
+// Status flags common to every response (low 8 bits)
+#define TMC_STAT_SG   0x01
+#define TMC_STAT_OT   0x02
+#define TMC_STAT_OTPW 0x04
+#define TMC_STAT_S2GA 0x08
+#define TMC_STAT_S2GB 0x10
+#define TMC_STAT_OLA  0x20
+#define TMC_STAT_OLB  0x40
+#define TMC_STAT_STST 0x80
+
+// Latest decoded driver readings, filled in by tmc_request_status()
+typedef struct {
+  uint8_t flags;    // TMC_STAT_*
+  uint8_t rdsel;    // which reading the last response carried
+  uint16_t sg;      // StallGuard2 load (10 bits, 0 = stalled; 5 MSBs via RDSEL_SGCS)
+  uint8_t se;       // CoolStep actual current scale (RDSEL_SGCS)
+  uint16_t mstep;   // microstep table position (RDSEL_USTEP)
+  uint32_t seq;     // incremented per decoded response
+  volatile uint8_t pending;
+} tmc_status_t;
+
+extern volatile tmc_status_t tmc_status[];
+
 
 ////////////////////////////////////////////////////////////////
 // Register definitions, bitmask style
@@ -415,13 +471,25 @@ typedef union {
 
 void tmc_init(void);
 uint32_t tmc_send(uint8_t tmc, uint32_t tx_data);
+uint8_t tmc_send_async(uint8_t tmc, uint32_t tx_data, spi_callback_t callback, void *arg);
+uint32_t tmc_job_response(spi_job_t *job);
 void tmc_reconfigure(uint8_t tmc, tmc_config_t *config);
+uint8_t tmc_update(uint8_t tmc);
+uint8_t tmc_update_reg(uint8_t tmc, uint8_t reg);
+uint8_t tmc_update_all(void);
+void tmc_invalidate(uint8_t tmc);
+uint8_t tmc_request_status(uint8_t tmc, uint8_t rdsel);
 
 uint8_t tmc_get_current_scale(uint8_t tmc);
 void tmc_set_current_scale(uint8_t tmc, uint32_t value);
 
 uint8_t tmc_get_microstep(uint8_t tmc);
-void tmc_set_microstep(uint8_t tmc, uint32_t value);
+uint8_t tmc_set_microstep(uint8_t tmc, uint32_t value);
+uint8_t tmc_max_shift(uint8_t tmc);
+uint8_t tmc_set_step_shift(uint8_t tmc, uint8_t shift);
+uint8_t tmc_block_write(uint8_t tmc, uint32_t tx_data);
+uint8_t tmc_block_pending(uint8_t tmc);
+int32_t tmc_step_size(uint8_t tmc);
 
 void tmc_set_dir(uint8_t tmc, uint8_t dir);
 int8_t tmc_get_dir(uint8_t tmc);
@@ -0,0 +1,61 @@
+// File       : trace.h
+// Author     : Jeff Schornick
+//
+// Step traces for the host simulator (host build only)
+//
+// A trace is the sequence of machine positions after each step edge, with
+// the virtual time of the edge. Traces are stored as the simulator's CSV
+// output; STEP rows carry the axis position after the edge:
+//
+//   time_ns,signal,value,pos
+//   20874023,X_STEP,0,1
+//   20874023,X_DIR,0,
+//
+// Compilation: host GCC, see `make host`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stdint.h>
+
+typedef struct {
+  uint64_t time_ns;
+  int32_t pos[3];
+} trace_point_t;
+
+typedef struct {
+  trace_point_t *points;
+  uint32_t count;
+  uint32_t size;
+} trace_t;
+
+typedef struct {
+  uint8_t identical;    // same points at the same times
+  double dev_max;       // path deviation, steps
+  double dev_mean;
+  int32_t final_err[3]; // run - reference
+  int64_t time_err_ns;  // run - reference, last step edge
+} trace_diff_t;
+
+// Reference points either side of the run's proportional position
+#define TRACE_DIFF_BAND 256
+
+void trace_init(trace_t *trace);
+void trace_free(trace_t *trace);
+void trace_add(trace_t *trace, uint64_t time_ns, volatile int32_t *pos);
+
+// Function: trace_load_csv
+//
+// Reads a CSV trace written by cnc_sim -o. Returns 0 on error.
+uint8_t trace_load_csv(const char *name, trace_t *trace);
+
+// Function: trace_diff
+//
+// Compares a run against a reference. Path deviation is the discrete
+// Frechet distance between the two paths, searched within TRACE_DIFF_BAND
+// points of proportional progress along each, so the cost stays linear in
+// trace length.
+void trace_diff(trace_t *ref, trace_t *run, trace_diff_t *diff);
+
+#endif /* __TRACE_H */
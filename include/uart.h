@@ -22,7 +22,7 @@ extern fifo_t tx_fifo;
 // Function: uart_init
 //
 // Initializes the EUSCI A0 as a basic UART in 8n1 mode at 57.6K baud.
-// Current configuration expectes a processor clock of 3MHz.
+// Baud rate dividers are derived from the SMCLK frequency in clock.h.
 //
 // Also initializes UART FIFOs for queued transmissions.
 //
@@ -34,6 +34,11 @@ void uart_init(void);
 // Send a character out the UART.
 void uart_putc(char c);
 
+// Function: uart_prime_tx
+//
+// Starts transmission of tx_fifo if the transmitter is idle
+void uart_prime_tx(void);
+
 // Function: uart_send
 //
 // Queues a character for UART transmission
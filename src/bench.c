@@ -0,0 +1,337 @@
+// File       : bench.c
+// Author     : Jeff Schornick
+//
+// Micro-benchmarks for the parser, interpolators, FIFOs and step output
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include <stdlib.h>  // free
+#include "hal.h"
+#include "fifo.h"
+#include "uart.h"
+#include "log.h"
+#include "motion.h"
+#include "interpolate.h"
+#include "gcode.h"
+#include "tmc.h"
+#include "stepper.h"
+#include "bench.h"
+
+static char *bench_lines[] = {
+  "G01 X1000 Y500 F200",
+  "G00 Z-50",
+  "N120 G01 X-12345 Y678 Z9 F300",
+  "G02 X200 Y0 I100 J0 F150",
+  "G03 X-3 Y4 I-3 J0",
+  "G91",
+  "G90",
+};
+#define BENCH_LINES (sizeof(bench_lines) / sizeof(bench_lines[0]))
+
+typedef struct {
+  int32_t end[3];  // X, Y, Z
+  int32_t i;       // arc center offsets
+  int32_t j;
+  int8_t rot;      // 0 = linear, else arc direction as new_arc_motion
+} bench_move_t;
+
+static const bench_move_t bench_moves[] = {
+  { {1000, 400, 0}, 0, 0, 0 },
+  { {300, -700, 50}, 0, 0, 0 },
+  { {5, 3, 0}, 0, 0, 0 },
+  { {200, 0, 0}, 100, 0, -1 },
+  { {0, 0, 0}, 100, 0, 1 },
+  { {20, 20, 0}, 10, 10, 1 },
+};
+#define BENCH_MOVES (sizeof(bench_moves) / sizeof(bench_moves[0]))
+
+static fifo_t bench_fifo;
+
+static void bench_report(char *name, uint32_t elapsed, uint32_t items, char *per)
+{
+  uart_queue_str(name);
+  uart_queue_str(": ");
+  if (items) {
+    uart_queue_dec(elapsed / items);
+    uart_queue('.');
+    uart_queue_dec( (uint32_t) ((uint64_t) (elapsed % items) * 10 / items) );
+  }
+  uart_queue_str(" " HAL_CYCLE_UNIT "/");
+  uart_queue_str(per);
+  uart_queue_str(" (");
+  uart_queue_dec(items);
+  uart_queue_str(")\r\n");
+}
+
+static void bench_parse(void)
+{
+  uint32_t elapsed = 0;
+  uint32_t start;
+  uint8_t rep, n;
+  char *c;
+
+  for(rep=0; rep<BENCH_PARSE_REPS; rep++) {
+    for(n=0; n<BENCH_LINES; n++) {
+      for(c = bench_lines[n]; *c; c++) {
+        fifo_push(&gcode_input_fifo, *c);
+      }
+      fifo_push(&gcode_input_fifo, '\r');
+      start = hal_cycles();
+      parse_gcode();
+      elapsed += hal_cycles() - start;
+    }
+    clear_gcode_queue();
+  }
+  bench_report("parse_gcode       ", elapsed, BENCH_PARSE_REPS * BENCH_LINES, "line");
+}
+
+// A block's step tables: the merged table, or with STEP_BACKEND_AXIS one
+// stream per axis. Returns how many were found.
+static uint8_t bench_tables(motion_t *block, step_timing_t **tables, uint32_t *counts)
+{
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+  uint8_t i;
+
+  for(i=0; i<3; i++) {
+    tables[i] = block->axis_steps[i];
+    counts[i] = block->axis_count[i];
+  }
+  return 3;
+#else
+  tables[0] = block->steps;
+  counts[0] = block->count;
+  return 1;
+#endif
+}
+
+// Steps in a block's tables, each entry is one step plus its repeats
+static uint32_t bench_block_steps(motion_t *block)
+{
+  step_timing_t *tables[3];
+  uint32_t counts[3];
+  uint32_t steps = 0;
+  uint32_t i;
+  uint8_t n, t;
+
+  n = bench_tables(block, tables, counts);
+  for(t=0; t<n; t++) {
+    if (!tables[t]) {
+      steps += counts[t];
+      continue;
+    }
+    for(i=0; i<counts[t]; i++) {
+      steps += tables[t][i].repeat + 1;
+    }
+  }
+  return steps;
+}
+
+static void bench_free(motion_t *block)
+{
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+  uint8_t i;
+
+  for(i=0; i<3; i++) {
+    free(block->axis_steps[i]);
+  }
+#endif
+  free(block->steps);
+}
+
+// Interpolates each move from the origin at full resolution, as a block
+// with shift 0 would be
+static void bench_interpolate(uint8_t arcs)
+{
+  int32_t start[3];
+  int32_t end[3];
+  uint32_t elapsed = 0;
+  uint32_t steps = 0;
+  uint32_t t;
+  motion_t block;
+  uint8_t n;
+
+  for(n=0; n<BENCH_MOVES; n++) {
+    if ( (bench_moves[n].rot != 0) != arcs ) {
+      continue;
+    }
+    start[X_AXIS] = start[Y_AXIS] = start[Z_AXIS] = 0;
+    end[X_AXIS] = bench_moves[n].end[0];
+    end[Y_AXIS] = bench_moves[n].end[1];
+    end[Z_AXIS] = bench_moves[n].end[2];
+    block.id = 0;
+    block.shift = 0;
+
+    t = hal_cycles();
+    if (arcs) {
+      arc_interpolate(start, end, bench_moves[n].i, bench_moves[n].j,
+                      bench_moves[n].rot, 200, &block);
+    } else {
+      linear_interpolate(start, end, 200, &block);
+    }
+    elapsed += hal_cycles() - t;
+    steps += bench_block_steps(&block);
+    bench_free(&block);
+  }
+  bench_report(arcs ? "arc_interpolate   " : "linear_interpolate", elapsed, steps, "step");
+}
+
+static void bench_fifos(void)
+{
+  uint32_t push, pop;
+  uint32_t t;
+  uint16_t n;
+  char c;
+
+  if (!bench_fifo.buffer) {
+    fifo_init(&bench_fifo, BENCH_FIFO_BYTES);
+  }
+
+  t = hal_cycles();
+  for(n=0; n<BENCH_FIFO_BYTES; n++) {
+    fifo_push(&bench_fifo, (char) n);
+  }
+  push = hal_cycles() - t;
+
+  t = hal_cycles();
+  for(n=0; n<BENCH_FIFO_BYTES; n++) {
+    fifo_pop(&bench_fifo, &c);
+  }
+  pop = hal_cycles() - t;
+
+  bench_report("fifo_push         ", push, BENCH_FIFO_BYTES, "byte");
+  bench_report("fifo_pop          ", pop, BENCH_FIFO_BYTES, "byte");
+}
+
+// Scratch ports for the step output benchmarks, so no pins move
+static hal_port_t bench_ports[STEPPER_PORTS];
+
+// Times the per-tick step output of stepper_output_axes() against
+// stepper_output_lut(), over the ticks of every bench move, taking the
+// best of BENCH_OUTPUT_REPS passes per move. Both write to bench_ports[]
+// in place of the real STEP/DIR ports.
+static void bench_step_output(void)
+{
+  hal_port_t *ports[STEPPER_PORTS];
+  tmc_pinout_t pins[3];
+  int32_t saved_pos[3];
+  int32_t start[3];
+  int32_t end[3];
+  uint32_t axes = 0, lut = 0;
+  uint32_t best_axes, best_lut;
+  uint32_t ticks = 0;
+  uint32_t t;
+  motion_t block;
+  step_timing_t *tables[3];
+  step_timing_t *s;
+  uint32_t counts[3];
+  uint32_t i;
+  uint16_t k;
+  uint8_t n, p, rep, tab, ntab;
+
+  for(n=0; n<3; n++) {
+    saved_pos[n] = pos[n];
+    pins[n] = tmc_pins[n];
+    for(p=0; p<STEPPER_PORTS; p++) {
+      if (pins[n].step_port == stepper_ports[p]) {
+        tmc_pins[n].step_port = &bench_ports[p];
+      }
+      if (pins[n].dir_port == stepper_ports[p]) {
+        tmc_pins[n].dir_port = &bench_ports[p];
+      }
+    }
+  }
+  for(p=0; p<STEPPER_PORTS; p++) {
+    ports[p] = stepper_ports[p];
+    stepper_ports[p] = &bench_ports[p];
+  }
+
+  for(n=0; n<BENCH_MOVES; n++) {
+    start[X_AXIS] = start[Y_AXIS] = start[Z_AXIS] = 0;
+    end[X_AXIS] = bench_moves[n].end[0];
+    end[Y_AXIS] = bench_moves[n].end[1];
+    end[Z_AXIS] = bench_moves[n].end[2];
+    block.shift = 0;
+    if (bench_moves[n].rot) {
+      arc_interpolate(start, end, bench_moves[n].i, bench_moves[n].j,
+                      bench_moves[n].rot, 200, &block);
+    } else {
+      linear_interpolate(start, end, 200, &block);
+    }
+
+    ntab = bench_tables(&block, tables, counts);
+
+    // the fastest pass of each, the others were interrupted or cold
+    best_axes = best_lut = UINT32_MAX;
+    for(rep=0; rep<BENCH_OUTPUT_REPS; rep++) {
+      for(p=0; p<3; p++) {
+        stepper_delta[p] = (block.dirs[p] == TMC_FWD) ? 1 : -1;
+      }
+      t = hal_cycles();
+      for(tab=0; tab<ntab; tab++) {
+        for(i=0, s=tables[tab]; i<counts[tab]; i++, s++) {
+          for(k=0; k<=s->repeat; k++) {
+            stepper_output_axes(s->step_data);
+          }
+        }
+      }
+      t = hal_cycles() - t;
+      if (t < best_axes) {
+        best_axes = t;
+      }
+
+      for(p=0; p<3; p++) {
+        stepper_delta[p] = (block.dirs[p] == TMC_FWD) ? 1 : -1;
+      }
+      t = hal_cycles();
+      for(tab=0; tab<ntab; tab++) {
+        for(i=0, s=tables[tab]; i<counts[tab]; i++, s++) {
+          for(k=0; k<=s->repeat; k++) {
+            stepper_output_lut(s->step_data);
+          }
+        }
+      }
+      t = hal_cycles() - t;
+      if (t < best_lut) {
+        best_lut = t;
+      }
+    }
+    axes += best_axes;
+    lut += best_lut;
+
+    ticks += bench_block_steps(&block);
+    bench_free(&block);
+  }
+
+  for(p=0; p<STEPPER_PORTS; p++) {
+    stepper_ports[p] = ports[p];
+  }
+  for(n=0; n<3; n++) {
+    tmc_pins[n] = pins[n];
+    pos[n] = saved_pos[n];
+  }
+  bench_report("step output, axes ", axes, ticks, "tick");
+  bench_report("step output, LUT  ", lut, ticks, "tick");
+}
+
+void bench_run(void)
+{
+  uint8_t level = log_level;
+
+  if (motion || next_motion || gcode_cmd_count) {
+    uart_queue_str("Busy, stop motion and clear the G-code queue first!\r\n");
+    return;
+  }
+
+  // keep per-line and per-step logging out of the measurements
+  log_level = LOG_NONE;
+  bench_parse();
+  bench_interpolate(0);
+  bench_interpolate(1);
+  bench_fifos();
+  bench_step_output();
+  log_level = level;
+
+  init_gcode_state();
+}
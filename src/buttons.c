@@ -10,6 +10,8 @@
 #include "gpio.h"
 #include "buttons.h"
 #include "uart.h"
+#include "log.h"
+#include "profile.h"
 
 // Button flags that may be set during GPIO interrupt
 volatile uint8_t B1_flag;
@@ -49,12 +51,16 @@ void enable_limit_switch(void) {
 void disable_limit_switch(void)
 {
   gpio_disable_interrupt(BUTTON3);
-  uart_queue_str("Limiter disabled!\r\n");
+  if (LOG_ON(LOG_INFO)) {
+    uart_queue_str("Limiter disabled!\r\n");
+  }
 }
 
 // Interrupt handler for Port 1 (buttons)
 void PORT1_IRQHandler(void)
 {
+  uint32_t start = hal_cycles();
+
   // check if it was S1 or S2
   if (P1->IFG & BIT1) {
   /* if (gpio_intr_flag(BUTTON1)) { */
@@ -66,6 +72,8 @@ void PORT1_IRQHandler(void)
     P1->IFG &= ~BIT4;
     B2_flag = 1;
   }
+
+  prof_isr(PROF_PORT1, start, PROF_NO_LATENCY);
 }
 
 void PORT3_IRQHandler(void)
@@ -0,0 +1,176 @@
+// File       : clock.c
+// Author     : Jeff Schornick
+//
+// System clock modes: core voltage, regulator, flash wait states and the
+// MCLK/SMCLK tree, applied from a single configuration table.
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include "msp432p401r.h"
+#include "clock.h"
+
+// HFXT fault polling limit, each pass is a few MCLK cycles at 24 MHz
+#define CLOCK_HFXT_TIMEOUT 100000
+
+#define CLOCK_CS_CTL1_MASK (CS_CTL1_SELM_MASK | CS_CTL1_SELS_MASK | CS_CTL1_DIVM_MASK | \
+                            CS_CTL1_DIVHS_MASK | CS_CTL1_DIVS_MASK)
+
+// Wait states follow the vendor SystemInit(): one wait state for both
+// 24 MHz at VCORE0 and 48 MHz at VCORE1, none below 12 MHz. The idle mode
+// keeps VCORE1 since SMCLK stays at 24 MHz.
+const clock_config_t clock_configs[CLOCK_MODES] = {
+  [CLOCK_DCO_24MHZ] = {
+    .name = "DCO 24 MHz",
+    .mclk_hz = CLOCK_DCO_HZ,
+    .cs_ctl1 = CS_CTL1_SELM__DCOCLK | CS_CTL1_DIVM__1 |
+               CS_CTL1_SELS__DCOCLK | CS_CTL1_DIVHS__1 | CS_CTL1_DIVS__1,
+    .vcore = 0, .dcdc = 0, .flash_wait = 1, .hfxt = 0,
+  },
+  [CLOCK_HFXT_48MHZ] = {
+    .name = "HFXT 48 MHz",
+    .mclk_hz = CLOCK_HFXT_HZ,
+    .cs_ctl1 = CS_CTL1_SELM__HFXTCLK | CS_CTL1_DIVM__1 |
+               CS_CTL1_SELS__HFXTCLK | CS_CTL1_DIVHS__1 | CS_CTL1_DIVS__2,
+    .vcore = 1, .dcdc = 1, .flash_wait = 1, .hfxt = 1,
+  },
+  [CLOCK_HFXT_3MHZ] = {
+    .name = "HFXT 3 MHz (idle)",
+    .mclk_hz = CLOCK_IDLE_HZ,
+    .cs_ctl1 = CS_CTL1_SELM__HFXTCLK | CS_CTL1_DIVM__16 |
+               CS_CTL1_SELS__HFXTCLK | CS_CTL1_DIVHS__1 | CS_CTL1_DIVS__2,
+    .vcore = 1, .dcdc = 1, .flash_wait = 0, .hfxt = 1,
+  },
+};
+
+// SystemInit() leaves the DCO at 24 MHz on the LDO at VCORE0
+volatile uint8_t clock_mode = CLOCK_DCO_24MHZ;
+static uint8_t pcm_vcore = 0;
+static uint8_t pcm_dcdc = 0;
+static uint8_t clock_scaling = 0;  // set once the HFXT is running
+
+static void pcm_set_amr(uint32_t amr)
+{
+  while(PCM->CTL1 & PCM_CTL1_PMR_BUSY);
+  PCM->CTL0 = PCM_CTL0_KEY_VAL | amr;
+  while(PCM->CTL1 & PCM_CTL1_PMR_BUSY);
+}
+
+// Function: clock_power
+//
+// Moves the core to the requested voltage and regulator. VCORE may only
+// change while on the LDO, so DC-DC is left first and re-entered last. If
+// the DC-DC fails to start the PCM stays on the LDO, which supports every
+// mode at the same VCORE, so this is not treated as an error.
+static void clock_power(uint8_t vcore, uint8_t dcdc)
+{
+  if((vcore == pcm_vcore) && (dcdc == pcm_dcdc)) {
+    return;
+  }
+  if(pcm_dcdc) {
+    pcm_set_amr(pcm_vcore ? PCM_CTL0_AMR_1 : PCM_CTL0_AMR_0);
+    pcm_dcdc = 0;
+  }
+  if(vcore != pcm_vcore) {
+    pcm_set_amr(vcore ? PCM_CTL0_AMR_1 : PCM_CTL0_AMR_0);
+    pcm_vcore = vcore;
+  }
+  if(dcdc) {
+    PCM->CLRIFG = PCM_CLRIFG_CLR_DCDC_ERROR_IFG;
+    pcm_set_amr(vcore ? PCM_CTL0_AMR_5 : PCM_CTL0_AMR_4);
+    pcm_dcdc = !(PCM->IFG & PCM_IFG_DCDC_ERROR_IFG);
+  }
+}
+
+static void clock_flash_wait(uint8_t wait)
+{
+  FLCTL->BANK0_RDCTL = (FLCTL->BANK0_RDCTL & ~FLCTL_BANK0_RDCTL_WAIT_MASK) |
+    ((uint32_t) wait << FLCTL_BANK0_RDCTL_WAIT_OFS);
+  FLCTL->BANK1_RDCTL = (FLCTL->BANK1_RDCTL & ~FLCTL_BANK1_RDCTL_WAIT_MASK) |
+    ((uint32_t) wait << FLCTL_BANK1_RDCTL_WAIT_OFS);
+}
+
+// Function: clock_hfxt_start
+//
+// Hands PJ.2/PJ.3 to the 48 MHz crystal and waits for the oscillator fault
+// flag to stay clear. The oscillator is switched back off on timeout.
+static uint8_t clock_hfxt_start(void)
+{
+  uint32_t timeout = CLOCK_HFXT_TIMEOUT;
+
+  PJ->SEL0 |= BIT2 | BIT3;
+  PJ->SEL1 &= ~(BIT2 | BIT3);
+
+  CS->KEY = CS_KEY_VAL;
+  CS->CTL2 = (CS->CTL2 & ~CS_CTL2_HFXTFREQ_MASK) |
+    CS_CTL2_HFXTFREQ_6 | CS_CTL2_HFXTDRIVE | CS_CTL2_HFXT_EN;
+  while((CS->IFG & CS_IFG_HFXTIFG) && --timeout) {
+    CS->CLRIFG |= CS_CLRIFG_CLR_HFXTIFG;
+  }
+  if(!timeout) {
+    CS->CTL2 &= ~CS_CTL2_HFXT_EN;
+  }
+  CS->KEY = 0;
+
+  return timeout ? CLOCK_OK : CLOCK_ERR;
+}
+
+uint8_t clock_set(uint8_t mode)
+{
+  const clock_config_t *cfg;
+
+  if(mode >= CLOCK_MODES) {
+    return CLOCK_ERR;
+  }
+  cfg = &clock_configs[mode];
+
+  if(cfg->hfxt && !(CS->CTL2 & CS_CTL2_HFXT_EN) && !clock_hfxt_start()) {
+    return CLOCK_ERR;
+  }
+
+  // Raise supply and wait states before the clock, lower them after
+  if(cfg->mclk_hz >= SystemCoreClock) {
+    clock_power(cfg->vcore, cfg->dcdc);
+    clock_flash_wait(cfg->flash_wait);
+  }
+
+  CS->KEY = CS_KEY_VAL;
+  CS->CTL1 = (CS->CTL1 & ~CLOCK_CS_CTL1_MASK) | cfg->cs_ctl1;
+  CS->KEY = 0;
+
+  if(cfg->mclk_hz < SystemCoreClock) {
+    clock_flash_wait(cfg->flash_wait);
+    clock_power(cfg->vcore, cfg->dcdc);
+  }
+
+  SystemCoreClock = cfg->mclk_hz;
+  clock_mode = mode;
+  return CLOCK_OK;
+}
+
+uint8_t clock_init(uint8_t mode)
+{
+  uint8_t ok;
+
+  // Read buffering for both banks, as SystemInit() does for 48 MHz
+  FLCTL->BANK0_RDCTL |= FLCTL_BANK0_RDCTL_BUFD | FLCTL_BANK0_RDCTL_BUFI;
+  FLCTL->BANK1_RDCTL |= FLCTL_BANK1_RDCTL_BUFD | FLCTL_BANK1_RDCTL_BUFI;
+
+  ok = clock_set(mode);
+  clock_scaling = ok && clock_configs[mode].hfxt;
+  return ok;
+}
+
+uint8_t clock_scale(uint8_t busy)
+{
+  uint8_t mode = busy ? CLOCK_HFXT_48MHZ : CLOCK_HFXT_3MHZ;
+
+  if(!clock_scaling || (mode == clock_mode)) {
+    return 0;
+  }
+  // Only DIVM and the wait states change: no PCM transition, and SMCLK
+  // and ACLK keep running from the same sources throughout
+  clock_set(mode);
+  return 1;
+}
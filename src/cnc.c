@@ -9,8 +9,10 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include "msp432p401r.h"
+#include "clock.h"
 #include "uart.h"
 #include "spi.h"
+#include "dma.h"
 #include "timer.h"
 #include "tmc.h"
 #include "gpio.h"
@@ -18,6 +20,12 @@
 #include "menu.h"
 #include "gcode.h"
 #include "motion.h"
+#include "homing.h"
+#include "drive.h"
+#include "coil.h"
+#include "control.h"
+#include "stepper.h"
+#include "load.h"
 
 // MSP-EXP432 board layout
 //
@@ -36,18 +44,45 @@
 /* motion_t sample_motion1; */
 /* motion_t sample_motion2; */
 
+// Function: cnc_busy
+//
+// True while anything is moving, queued for planning or waiting to be
+// parsed; the CPU then runs at full speed.
+static uint8_t cnc_busy(void)
+{
+  return motion || next_motion || gcode_cmd_count || rx_fifo.count || coil_mode ||
+    ((homing_state != HOMING_IDLE) && (homing_state != HOMING_DONE) && (homing_state != HOMING_FAILED));
+}
+
+// Function: cnc_clock
+//
+// Follows cnc_busy() with the clock, see clock_scale()
+static void cnc_clock(void)
+{
+  if(clock_scale(cnc_busy())) {
+    systick_rescale();
+    load_clock(CLOCK_HFXT_HZ / SystemCoreClock);
+  }
+}
+
 int main(void) {
 
-  // clocks/watchdog configured via SystemInit() on reset (see: system_msp432p401r.c)
+  // clocks/watchdog configured via SystemInit() on reset (see: system_msp432p401r.c),
+  // then moved to the run clock before any peripheral or SysTick setup
+  clock_init(CLOCK_HFXT_48MHZ);
 
   gpio_set_output(LED1);
   gpio_high(LED1);
 
   button_init();
   uart_init();
+  dma_init();
   spi_init();
 
   timer_init();
+  systick_init();
+  hal_cycles_init();
+  coil_init();
 
   init_parser();
 
@@ -63,8 +98,14 @@ int main(void) {
   uart_queue_str("| CNC Controller |\r\n");
   uart_queue_str("------------------\r\n\r\n");
 
+  uart_queue_str("Clock: ");
+  uart_queue_str((char *) clock_configs[clock_mode].name);
+  uart_queue_str("\r\n");
+
   uart_queue_str("Initializing steppers... ");
   tmc_init();
+  stepper_init();
+  drive_init();
   uart_queue_str("done!\r\n");
 
   /* motion = new_linear_motion(50, 50, 0, 100, 100); */
@@ -80,13 +121,13 @@ int main(void) {
   /* motion = new_motion; */
 
 
-  char new_char;
   input_state = INPUT_MENU;
   display_main_menu(2);
 
   while(1) {
     if(B1_flag) {
       uart_queue_str("\r\nB1 : E-stop!\r\n");
+      homing_cancel();
       // disable all mosfets
       for(uint8_t i = 0; i < 3; i++) {
         gpio_high(tmc_pins[i].en_port, tmc_pins[i].en_pin);
@@ -95,6 +136,7 @@ int main(void) {
     }
     if(B2_flag) {
       uart_queue_str("\r\nB2 : E-stop\r\n");
+      homing_cancel();
       for(uint8_t i = 0; i < 3; i++) {
         gpio_high(tmc_pins[i].en_port, tmc_pins[i].en_pin);
       }
@@ -103,27 +145,22 @@ int main(void) {
 
     if(B3_flag) {
       uart_queue_str("\r\nZ-axis limit sensor! Stopping motion!\r\n");
-      motion_stop();
-      motion = 0;
+      motion_abort();  // drops the plunging move with its stream
       disable_limit_switch();
       rapid(Z_AXIS, 700); // retract tool
       B3_flag=0;
     }
 
-    // Pop received characters off the FIFO and process them
-    while(rx_fifo.count) {
-      fifo_pop(&rx_fifo, &new_char);
-      process_input(new_char);
-    }
-
-    if( gcode_enabled && gcode_cmd_count ) {
-      run_gcode();
-    }
-
+    cnc_clock();
+    control_poll();
+    cnc_clock();
 
+    // Sleep in LPM0; SMCLK keeps the UART and coil timer running
+    load_mark(LOAD_IDLE);
     gpio_low(LED1);
     __sleep();
     gpio_high(LED1);
+    load_mark(LOAD_OTHER);
 
   };
 }
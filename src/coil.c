@@ -0,0 +1,154 @@
+// File       : coil.c
+// Author     : Jeff Schornick
+//
+// Direct coil current drive for the TMC26x (SPI mode)
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include <math.h>  // sinf
+#include "timer.h"
+#include "tmc.h"
+#include "motion.h"
+#include "coil.h"
+
+#define COIL_PI 3.14159265f
+
+uint8_t coil_mode = 0;
+volatile int32_t coil_phase[3];
+
+static uint8_t coil_sine[257];          // first quarter wave, inclusive
+static int32_t coil_inc[3];             // phase per update, 16.16 fixed point
+static uint16_t coil_frac[3];
+static int32_t coil_pos0[3];            // pos[] when the phase was zero
+static int32_t coil_sent[3];            // phase of the last queued datagram
+static volatile uint8_t coil_busy[3];   // datagram in flight, cleared from the SPI ISR
+
+static void coil_done_cb(spi_job_t *job)
+{
+  coil_busy[job->tag] = 0;
+}
+
+static uint8_t coil_sin(uint16_t index, uint8_t *negative)
+{
+  uint16_t i = index & 0xff;
+
+  *negative = (index & 0x200) ? 1 : 0;
+  if (index & 0x100) {
+    return coil_sine[256 - i];
+  }
+  return coil_sine[i];
+}
+
+// Function: coil_datagram
+//
+// SPI-mode DRVCTL for a phase: coil A follows sine, coil B cosine.
+uint32_t coil_datagram(int32_t phase)
+{
+  drvctl_spi_t drvctl;
+  uint8_t negative;
+  uint16_t index = phase & 0x3ff;
+
+  drvctl.raw = DRVCTL;
+  drvctl.CA = coil_sin(index, &negative);
+  drvctl.PHA = negative;
+  drvctl.CB = coil_sin((index + 0x100) & 0x3ff, &negative);
+  drvctl.PHB = negative;
+  return drvctl.raw;
+}
+
+void coil_init(void)
+{
+  uint16_t i;
+
+  for(i=0; i<=256; i++) {
+    coil_sine[i] = (uint8_t) (COIL_AMPLITUDE * sinf(i * COIL_PI / 512) + 0.5f);
+  }
+
+  coil_timer_init(COIL_SMCLK / COIL_UPDATE_HZ - 1);
+}
+
+// Function: coil_enable
+//
+// Switches a driver between STEP/DIR and SPI coil drive. The phase starts
+// at zero, so the rotor may settle up to two full steps when entering SPI
+// mode; enable at standstill. pos[] keeps counting in base steps.
+void coil_enable(uint8_t tmc, uint8_t enable)
+{
+  if (enable && !(coil_mode & (1 << tmc))) {
+    coil_inc[tmc] = 0;
+    coil_frac[tmc] = 0;
+    coil_phase[tmc] = 0;
+    coil_sent[tmc] = 0;
+    coil_pos0[tmc] = pos[tmc];
+
+    tmc_config[tmc].drvconf.SDOFF = TMC_SD_OFF;
+    tmc_update(tmc);
+    while (tmc_send_async(tmc, coil_datagram(0), 0, 0) == SPI_ERR);
+
+    coil_mode |= 1 << tmc;
+    motion_inhibit |= MOTION_INHIBIT_COIL;
+    coil_timer_on();
+  } else if (!enable && (coil_mode & (1 << tmc))) {
+    coil_mode &= ~(1 << tmc);
+    if (!coil_mode) {
+      coil_timer_off();
+      motion_inhibit &= ~MOTION_INHIBIT_COIL;
+    }
+    while (coil_busy[tmc]);
+
+    // back to STEP/DIR, DRVCTL must be rewritten in step format
+    tmc_config[tmc].drvconf.SDOFF = TMC_SD_ON;
+    tmc_shadow_valid[tmc] &= ~(1 << TMC_REG_DRVCTL);
+    tmc_update(tmc);
+  }
+}
+
+// Function: coil_set_velocity
+//
+// Sets the phase velocity (phase units/s, signed) of a driver in SPI mode.
+void coil_set_velocity(uint8_t tmc, int32_t phase_per_s)
+{
+  int64_t inc = ((int64_t) phase_per_s << 16) / COIL_UPDATE_HZ;
+
+  if (tmc_axis_conf[tmc] == TMC_POLARITY_INVERT) {
+    inc = -inc;
+  }
+  coil_inc[tmc] = inc;
+}
+
+// Function: coil_isr
+//
+// Called from the coil timer interrupt (TA2CCR0). Advances each SPI-mode
+// driver's phase and queues a new current setting when the table position
+// changed and the previous one has gone out.
+void coil_isr(void)
+{
+  uint8_t i;
+  int32_t sum;
+  int32_t step;
+
+  for(i=0; i<3; i++) {
+    if ( !(coil_mode & (1 << i)) ) {
+      continue;
+    }
+
+    sum = coil_frac[i] + coil_inc[i];
+    coil_phase[i] += sum >> 16;
+    coil_frac[i] = sum & 0xffff;
+
+    // base step is 2^MRES phase units, see DRVCTL_MRES_*
+    step = (tmc_axis_conf[i] == TMC_POLARITY_INVERT) ? -coil_phase[i] : coil_phase[i];
+    pos[i] = coil_pos0[i] + (step >> tmc_base_mres[i]);
+
+    if ( (coil_phase[i] != coil_sent[i]) && !coil_busy[i] ) {
+      coil_busy[i] = 1;
+      if (tmc_send_async(i, coil_datagram(coil_phase[i]), coil_done_cb, 0) == SPI_OK) {
+        coil_sent[i] = coil_phase[i];
+      } else {
+        coil_busy[i] = 0;
+      }
+    }
+  }
+}
@@ -0,0 +1,47 @@
+// File       : control.c
+// Author     : Jeff Schornick
+//
+// Main loop work, shared by the firmware and the host simulator
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include "fifo.h"
+#include "uart.h"
+#include "menu.h"
+#include "gcode.h"
+#include "motion.h"
+#include "homing.h"
+#include "coolstep.h"
+#include "health.h"
+#include "drive.h"
+#include "load.h"
+#include "control.h"
+
+void control_poll(void)
+{
+  char new_char;
+
+  // Pop received characters off the FIFO and process them
+  load_mark(LOAD_INPUT);
+  while(rx_fifo.count) {
+    fifo_pop(&rx_fifo, &new_char);
+    process_input(new_char);
+  }
+
+  load_mark(LOAD_GCODE);
+  motion_reap();
+  if( gcode_enabled && gcode_cmd_count ) {
+    run_gcode();
+  }
+
+  load_mark(LOAD_POLL);
+  homing_poll();
+  coolstep_poll();
+  health_poll();
+  drive_poll();
+
+  load_mark(LOAD_OTHER);
+  load_poll();
+}
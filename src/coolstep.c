@@ -0,0 +1,176 @@
+// File       : coolstep.c
+// Author     : Jeff Schornick
+//
+// Closed-loop current control on top of the TMC26x CoolStep feature
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include "uart.h"
+#include "log.h"
+#include "timer.h"
+#include "tmc.h"
+#include "homing.h"
+#include "coolstep.h"
+
+// Indexed by driver, see cscale_init[] in tmc.c for the fixed settings
+coolstep_bounds_t coolstep_bounds[] = {
+  { .cs_min = 0x2, .cs_max = 0x9, .sg_low = 64, .sg_high = 320 },
+  { .cs_min = 0x1, .cs_max = 0x4, .sg_low = 64, .sg_high = 320 },
+  { .cs_min = 0x4, .cs_max = 0xd, .sg_low = 64, .sg_high = 320 },
+};
+
+coolstep_axis_t coolstep_axis[3];
+
+static uint32_t coolstep_sample_ms;
+static uint8_t coolstep_next;       // round-robin driver index
+static uint32_t coolstep_seq[3];    // last tmc_status[].seq examined
+
+// Function: coolstep_enable
+//
+// Turns the driver CoolStep loop and the CSCALE controller on or off for a
+// driver. Enabling starts from the current CSCALE clamped to the bounds,
+// disabling restores the CSCALE in effect before.
+void coolstep_enable(uint8_t axis, uint8_t enable)
+{
+  tmc_config_t *config = &tmc_config[axis];
+  coolstep_bounds_t *bounds = &coolstep_bounds[axis];
+
+  if (enable && !coolstep_axis[axis].enabled) {
+    coolstep_axis[axis].cs_saved = config->sgcsconf.CSCALE;
+    if (config->sgcsconf.CSCALE < bounds->cs_min) {
+      config->sgcsconf.CSCALE = bounds->cs_min;
+    } else if (config->sgcsconf.CSCALE > bounds->cs_max) {
+      config->sgcsconf.CSCALE = bounds->cs_max;
+    }
+    // current up fast when loaded, down slowly, never below half
+    config->smarten.SEMIN = 2;
+    config->smarten.SEMAX = 2;
+    config->smarten.SEUP = TMC_SE_UP2;
+    config->smarten.SEDN = TMC_SE_DOWN32;
+    config->smarten.SEIMIN = TMC_SE_MIN_1_2;
+    coolstep_axis[axis].head = 0;
+    coolstep_axis[axis].count = 0;
+    coolstep_axis[axis].enabled = 1;
+  } else if (!enable && coolstep_axis[axis].enabled) {
+    coolstep_axis[axis].enabled = 0;
+    config->sgcsconf.CSCALE = coolstep_axis[axis].cs_saved;
+    config->smarten.SEMIN = TMC_SE_DISABLED;
+  }
+  coolstep_seq[axis] = tmc_status[axis].seq;
+  tmc_update(axis);
+}
+
+static void coolstep_adjust(uint8_t axis)
+{
+  volatile tmc_status_t *status = &tmc_status[axis];
+  coolstep_axis_t *cool = &coolstep_axis[axis];
+  coolstep_bounds_t *bounds = &coolstep_bounds[axis];
+  uint8_t cs = tmc_config[axis].sgcsconf.CSCALE;
+  coolstep_sample_t *sample;
+
+  sample = &cool->history[cool->head];
+  sample->cs = cs;
+  sample->se = status->se;
+  sample->sg = status->sg;
+  cool->head = (cool->head + 1) % COOLSTEP_HISTORY;
+  if (cool->count < COOLSTEP_HISTORY) {
+    cool->count++;
+  }
+
+  // load is meaningless at standstill, leave the ceiling where it is
+  if (status->flags & TMC_STAT_STST) {
+    return;
+  }
+
+  if ( (status->sg < bounds->sg_low) && (status->se >= cs) && (cs < bounds->cs_max) ) {
+    cs++;
+  } else if ( (status->sg > bounds->sg_high) && (cs > bounds->cs_min) ) {
+    cs--;
+  } else {
+    return;
+  }
+
+  if (LOG_ON(LOG_DEBUG)) {
+    uart_queue_str("CoolStep[");
+    uart_queue_hex(axis, 4);
+    uart_queue_str("] CSCALE ");
+    uart_queue_hex(cs, 5);
+    uart_queue_str("\r\n");
+  }
+  tmc_config[axis].sgcsconf.CSCALE = cs;
+  tmc_update(axis);
+}
+
+// Function: coolstep_poll
+//
+// Background controller, called from the main loop. Requests an SG/SE
+// reading from one enabled driver per slot and acts on fresh readings.
+// Suspended while homing, which owns the StallGuard settings.
+void coolstep_poll(void)
+{
+  uint8_t axis;
+  uint32_t now = systick_ms;
+
+  if (homing_active()) {
+    return;
+  }
+
+  for(axis=0; axis<3; axis++) {
+    if ( coolstep_axis[axis].enabled && (tmc_status[axis].seq != coolstep_seq[axis]) ) {
+      coolstep_seq[axis] = tmc_status[axis].seq;
+      if (tmc_status[axis].rdsel == TMC_RDSEL_SGCS) {
+        coolstep_adjust(axis);
+      }
+    }
+  }
+
+  if (now - coolstep_sample_ms < COOLSTEP_PERIOD_MS/3) {
+    return;
+  }
+  coolstep_sample_ms = now;
+
+  axis = coolstep_next;
+  coolstep_next = (coolstep_next + 1) % 3;
+  if (coolstep_axis[axis].enabled) {
+    tmc_request_status(axis, TMC_RDSEL_SGCS);
+  }
+}
+
+// Function: coolstep_report
+//
+// Prints the controller settings and recent history for a driver, oldest
+// sample first.
+void coolstep_report(uint8_t axis)
+{
+  coolstep_axis_t *cool = &coolstep_axis[axis];
+  coolstep_sample_t *sample;
+  uint8_t i;
+
+  uart_queue_str("\r\nCoolStep for stepper #");
+  uart_queue_hex(axis, 4);
+  uart_queue_str(cool->enabled ? " (enabled)\r\n" : " (disabled)\r\n");
+  uart_queue_str("  CSCALE now / min / max  : ");
+  uart_queue_hex(tmc_config[axis].sgcsconf.CSCALE, 5);
+  uart_queue_str(" / ");
+  uart_queue_hex(coolstep_bounds[axis].cs_min, 5);
+  uart_queue_str(" / ");
+  uart_queue_hex(coolstep_bounds[axis].cs_max, 5);
+  uart_queue_str("\r\n  SG low / high           : ");
+  uart_queue_dec(coolstep_bounds[axis].sg_low);
+  uart_queue_str(" / ");
+  uart_queue_dec(coolstep_bounds[axis].sg_high);
+  uart_queue_str("\r\n  History (CS SE SG)      :\r\n");
+
+  for(i=0; i<cool->count; i++) {
+    sample = &cool->history[(cool->head + COOLSTEP_HISTORY - cool->count + i) % COOLSTEP_HISTORY];
+    uart_queue_str("    ");
+    uart_queue_hex(sample->cs, 5);
+    uart_queue(' ');
+    uart_queue_hex(sample->se, 5);
+    uart_queue(' ');
+    uart_queue_dec(sample->sg);
+    uart_queue_str("\r\n");
+  }
+}
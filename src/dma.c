@@ -0,0 +1,53 @@
+// File       : dma.c
+// Author     : Jeff Schornick
+//
+// MSP432 DMA (ARM uDMA/PL230) channel control table
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include "msp432p401r.h"
+#include "hal.h"
+#include "dma.h"
+
+// Primary descriptors [0, DMA_CHANNELS), alternates follow. The controller
+// requires the table base to be aligned to the full table size.
+dma_desc_t dma_ctl_table[2*DMA_CHANNELS] __attribute__((aligned(256)));
+
+// Function: dma_init
+//
+// Enables the DMA controller and points it at the channel control table.
+// Channels are left disabled until configured by their users.
+void dma_init(void)
+{
+  uint8_t i;
+
+  for(i=0; i<2*DMA_CHANNELS; i++) {
+    dma_ctl_table[i].ctl = UDMA_CHCTL_XFERMODE_STOP;
+  }
+
+  DMA_Control->CFG = DMA_CFG_MASTEN;
+  DMA_Control->CTLBASE = (uint32_t) dma_ctl_table;
+
+  // peripheral requests only, primary descriptors, default priority
+  DMA_Control->ENACLR = 0xff;
+  DMA_Control->ALTCLR = 0xff;
+  DMA_Control->USEBURSTCLR = 0xff;
+  DMA_Control->REQMASKCLR = 0xff;
+}
+
+void dma_set_source(uint8_t channel, uint8_t source)
+{
+  DMA_Channel->CH_SRCCFG[channel] = source;
+}
+
+HAL_RAMFUNC void dma_enable(uint8_t channel)
+{
+  DMA_Control->ENASET = 1 << channel;
+}
+
+HAL_RAMFUNC void dma_disable(uint8_t channel)
+{
+  DMA_Control->ENACLR = 1 << channel;
+}
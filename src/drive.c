@@ -0,0 +1,165 @@
+// File       : drive.c
+// Author     : Jeff Schornick
+//
+// Speed-dependent chopper and current scheduling for the TMC26x drivers
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include "hal.h"
+#include "uart.h"
+#include "log.h"
+#include "timer.h"
+#include "tmc.h"
+#include "motion.h"
+#include "coolstep.h"
+#include "health.h"
+#include "homing.h"
+#include "drive.h"
+
+// Slowest band first. The first band matches chopconf_init in tmc.c.
+drive_band_t drive_bands[DRIVE_BANDS] = {
+  { .min_rate = 0,    .chm = TMC_CHOP_SPREAD, .tbl = TMC_CHOP_TBL_24, .toff = 8, .hstrt = 0, .hend = 0, .current_pct = 100 },
+  { .min_rate = 400,  .chm = TMC_CHOP_SPREAD, .tbl = TMC_CHOP_TBL_24, .toff = 5, .hstrt = 3, .hend = 2, .current_pct = 100 },
+  { .min_rate = 1200, .chm = TMC_CHOP_CONST,  .tbl = TMC_CHOP_TBL_36, .toff = 4, .hstrt = 4, .hend = 6, .current_pct = 115 },
+};
+
+uint8_t drive_run_cs[3];
+uint8_t drive_hold_pct = 50;
+uint16_t drive_hold_ms = 500;
+
+static uint32_t drive_idle_ms;    // when the motion queue last ran dry
+static volatile uint8_t drive_held;  // bitmask of drivers at hold current
+static uint8_t drive_saved_cs[3]; // CoolStep ceiling to restore after hold
+
+HAL_RAMFUNC static uint8_t drive_scale(uint8_t tmc, uint8_t pct)
+{
+  uint32_t cs = ((drive_run_cs[tmc] + 1) * pct) / 100;
+
+  // CSCALE n gives (n+1)/32 of full scale
+  if (cs < 1) {
+    cs = 1;
+  } else if (cs > 32) {
+    cs = 32;
+  }
+  return cs - 1;
+}
+
+// Function: drive_block_start
+//
+// Called from the step ISR as it promotes a block. Queues the velocity band
+// of each moving axis, only CHOPCONF and SGCSCONF and only if changed, so
+// the block steps with its own settings from the first step. Returns 0 if
+// a write could not be queued; the ISR retries on the next tick.
+HAL_RAMFUNC uint8_t drive_block_start(motion_t *block)
+{
+  drive_band_t *band = &drive_bands[0];
+  chopconf_t chopconf;
+  sgcsconf_t sgcsconf;
+  uint8_t i;
+
+  // homing sets its own current
+  if (homing_active()) {
+    return 1;
+  }
+
+  for(i=1; i<DRIVE_BANDS; i++) {
+    if (block->rate >= drive_bands[i].min_rate) {
+      band = &drive_bands[i];
+    }
+  }
+
+  for(i=0; i<3; i++) {
+    if ( !(block->axes & (1 << i)) ) {
+      continue;
+    }
+    chopconf = tmc_config[i].chopconf;
+    chopconf.CHM = band->chm;
+    chopconf.TBL = band->tbl;
+    chopconf.TOFF = band->toff;
+    chopconf.HSTRT = band->hstrt;
+    chopconf.HEND = band->hend;
+    if (tmc_block_write(i, chopconf.raw) == SPI_ERR) {
+      return 0;
+    }
+    tmc_config[i].chopconf = chopconf;
+
+    sgcsconf = tmc_config[i].sgcsconf;
+    if ( (drive_held & (1 << i)) && coolstep_axis[i].enabled ) {
+      sgcsconf.CSCALE = drive_saved_cs[i];
+    }
+    // CoolStep owns the current while it is enabled
+    if (!coolstep_axis[i].enabled) {
+      sgcsconf.CSCALE = drive_scale(i, band->current_pct);
+    }
+    if (tmc_block_write(i, sgcsconf.raw) == SPI_ERR) {
+      return 0;
+    }
+    tmc_config[i].sgcsconf = sgcsconf;
+    drive_held &= ~(1 << i);
+  }
+  return 1;
+}
+
+// Only SGCSCONF is touched. The step ISR reads it at the next promotion,
+// so it is changed with interrupts held off.
+static void drive_apply_hold(uint8_t tmc)
+{
+  uint32_t irq;
+
+  irq = hal_irq_save();
+  drive_saved_cs[tmc] = tmc_config[tmc].sgcsconf.CSCALE;
+  tmc_config[tmc].sgcsconf.CSCALE = drive_scale(tmc, drive_hold_pct);
+  drive_held |= 1 << tmc;
+  hal_irq_restore(irq);
+
+  if (LOG_ON(LOG_DEBUG)) {
+    uart_queue_str("Hold current on ");
+    uart_queue_hex(tmc, 4);
+    uart_queue_str("\r\n");
+  }
+  tmc_update_reg(tmc, TMC_REG_SGCSCONF);
+}
+
+// Function: drive_init
+//
+// Takes the configured current scales as the run currents, call after
+// tmc_init().
+void drive_init(void)
+{
+  uint8_t i;
+
+  for(i=0; i<3; i++) {
+    drive_run_cs[i] = tmc_config[i].sgcsconf.CSCALE;
+  }
+  drive_held = 0;
+  drive_idle_ms = systick_ms;
+}
+
+// Function: drive_poll
+//
+// Called from the main loop. Applies the hold current once idle, the bands
+// are set by drive_block_start().
+void drive_poll(void)
+{
+  uint32_t now = systick_ms;
+  uint8_t i;
+
+  // homing sets its own current
+  if (homing_active() || motion || next_motion) {
+    drive_idle_ms = now;
+    return;
+  }
+
+  if (now - drive_idle_ms < drive_hold_ms) {
+    return;
+  }
+  for(i=0; i<3; i++) {
+    // trust the driver's standstill flag when status is being polled
+    if ( !(drive_held & (1 << i)) &&
+         ((tmc_status[i].flags & TMC_STAT_STST) || !health_period_ms) ) {
+      drive_apply_hold(i);
+    }
+  }
+}
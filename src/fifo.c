@@ -8,7 +8,7 @@
 
 #include <stddef.h>
 #include <stdlib.h> /* malloc */
-#include "msp432p401r.h"
+#include "hal.h"
 #include "fifo.h"
 
 // Function: fifo_init
@@ -26,20 +26,25 @@ void fifo_init(fifo_t *fifo, size_t size)
 
 // Function: fifo_push
 //
-// Pushes a new item onto the FIFO, unless it is full.
-uint8_t fifo_push(fifo_t *fifo, char val)
+// Pushes a new item onto the FIFO, unless it is full. The full test and
+// the push are one masked section, so pushes from handlers cannot overfill
+// it. Safe with interrupts already masked, the caller's mask is restored.
+HAL_RAMFUNC uint8_t fifo_push(fifo_t *fifo, char val)
 {
+  uint32_t irq;
+
+  irq = hal_irq_save();
   if( fifo->count == fifo->size ) {
+    hal_irq_restore(irq);
     return FIFO_ERR;
   }
-  __disable_irq();
   if( ++(fifo->head) == (fifo->buffer + fifo->size) )
     {
       fifo->head = fifo->buffer;
     }
   *(fifo->head) = val;
   fifo->count++;
-  __enable_irq();
+  hal_irq_restore(irq);
   return FIFO_OK;
 }
 
@@ -47,19 +52,22 @@ uint8_t fifo_push(fifo_t *fifo, char val)
 //
 // Pops the head of the FIFO queue and returns it in val.
 // Val will be unchanged if called with an empty queue.
-uint8_t fifo_pop(fifo_t *fifo, char *val)
+HAL_RAMFUNC uint8_t fifo_pop(fifo_t *fifo, char *val)
 {
+  uint32_t irq;
+
+  irq = hal_irq_save();
   if( fifo->count == 0 ) {
+    hal_irq_restore(irq);
     return FIFO_ERR;
   }
-  __disable_irq();
   if( ++(fifo->tail) == (fifo->buffer + fifo->size) )
     {
       fifo->tail = fifo->buffer;
     }
   *val = *(fifo->tail);
   fifo->count--;
-  __enable_irq();
+  hal_irq_restore(irq);
   return FIFO_OK;
 }
 
@@ -9,6 +9,7 @@
 #include <stddef.h>
 #include "fifo.h"
 #include "uart.h"
+#include "log.h"
 #include "motion.h"
 #include "gcode.h"
 
@@ -48,16 +49,20 @@ void gcode_to_motion(size_t index)
   uint16_t id = index;
   /* uart_queue_str("Running G-code:\r\n"); */
   /* print_gcode_line(index); */
-  uart_queue_str("\r\nRunning G-code cmd # ");
-  uart_queue_dec(index);
   //if (gcode_cmd_queue[index].set[GCODE('N')]) {
   if (GCODE_IS_SET(&gcode_cmd_queue[index], 'N')) {
-    uart_queue_str(" (line #");
-    uart_queue_dec(gcode_cmd_queue[index].value[GCODE('N')]);
-    uart_queue_str(")");
     id = gcode_cmd_queue[index].value[GCODE('N')];
   }
-  uart_queue_str("\r\n");
+  if (LOG_ON(LOG_INFO)) {
+    uart_queue_str("\r\nRunning G-code cmd # ");
+    uart_queue_dec(index);
+    if (GCODE_IS_SET(&gcode_cmd_queue[index], 'N')) {
+      uart_queue_str(" (line #");
+      uart_queue_dec(id);
+      uart_queue_str(")");
+    }
+    uart_queue_str("\r\n");
+  }
 
   /* if( line->set[GCODE('G')] ) { */
   if( GCODE_IS_SET(line, 'G') ) {
@@ -162,11 +167,17 @@ void init_parser(void)
   // init raw text character fifo
   fifo_init(&gcode_input_fifo, GCODE_INPUT_FIFO_SIZE);
 
-  // init cmd queue
+  clear_gcode_queue();
+}
+
+// Function: clear_gcode_queue
+//
+// Drops parsed commands that have not been run
+void clear_gcode_queue(void)
+{
   gcode_cmd_head = 0;
   gcode_cmd_tail = 0;
   gcode_cmd_count = 0;
-
 }
 
 
@@ -215,9 +226,9 @@ void end_gcode_line()
 void parse_gcode()
 {
   char c;
-  char code;
-  int32_t value;
-  int8_t sign;
+  char code = 0;
+  int32_t value = 0;
+  int8_t sign = 1;
   gcode_parser_state_t state = GCODE_PARSE_CODE;
 
   gcode_zero_line(gcode_cmd_head);
@@ -242,7 +253,9 @@ void parse_gcode()
               code = c;
               state = GCODE_PARSE_VALUE_START;
             } else {
-              uart_queue_str("Unexpected G-code char!\r\n");
+              if (LOG_ON(LOG_ERROR)) {
+                uart_queue_str("Unexpected G-code char!\r\n");
+              }
             }
             break;
         }
@@ -260,7 +273,9 @@ void parse_gcode()
             }
             break;
         case '.':
-          uart_queue_str("Decimal not supported!\r\n");
+          if (LOG_ON(LOG_ERROR)) {
+            uart_queue_str("Decimal not supported!\r\n");
+          }
           break;
         case ' ':
           add_to_gcode_line(gcode_cmd_head, code, value*sign);
@@ -268,7 +283,9 @@ void parse_gcode()
           break;
         case '\r':
           add_to_gcode_line(gcode_cmd_head, code, value*sign);
-          print_gcode_line(gcode_cmd_head);
+          if (LOG_ON(LOG_DEBUG)) {
+            print_gcode_line(gcode_cmd_head);
+          }
           end_gcode_line();
           state = GCODE_PARSE_CODE;
           break;
@@ -279,7 +296,9 @@ void parse_gcode()
             value *= 10;
             value += c - '0';
           } else {
-            uart_queue_str("Expected digit!\r\n");
+            if (LOG_ON(LOG_ERROR)) {
+              uart_queue_str("Expected digit!\r\n");
+            }
           }
           break;
         }
@@ -288,6 +307,8 @@ void parse_gcode()
 
   } // end while FIFO_OK
 
-  uart_queue_str("\r\n");
-  uart_queue_str("Done parsing\r\n");
+  if (LOG_ON(LOG_DEBUG)) {
+    uart_queue_str("\r\n");
+    uart_queue_str("Done parsing\r\n");
+  }
 }
@@ -7,10 +7,10 @@
 // Version    : See GitHub repository jschornick/cnc for revision details
 
 #include <stdint.h>
-#include "msp432p401r.h"
+#include "hal.h"
 #include "gpio.h"
 
-void gpio_set(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits, uint8_t val)
+void gpio_set(hal_port_t *port, uint8_t pin_bits, uint8_t val)
 {
   if (val) {
     port->OUT |= pin_bits;
@@ -19,17 +19,17 @@ void gpio_set(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits, uint8_t v
   }
 }
 
-void gpio_set_input(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits)
+void gpio_set_input(hal_port_t *port, uint8_t pin_bits)
 {
   port->DIR &= ~pin_bits;
 }
 
-void gpio_set_output(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits)
+void gpio_set_output(hal_port_t *port, uint8_t pin_bits)
 {
   port->DIR |= pin_bits;
 }
 
-void gpio_set_pullup(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits, uint8_t pull_dir)
+void gpio_set_pullup(hal_port_t *port, uint8_t pin_bits, uint8_t pull_dir)
 {
   if(pull_dir == GPIO_PULL_UP) {
     port->DIR |= pin_bits;
@@ -40,11 +40,11 @@ void gpio_set_pullup(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits, ui
   port->REN |= pin_bits;
 }
 
-void gpio_disable_interrupt(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits) {
+void gpio_disable_interrupt(hal_port_t *port, uint8_t pin_bits) {
   port->IE &= ~pin_bits;
 }
 
-void gpio_set_interrupt(DIO_PORT_Odd_Interruptable_Type *port, uint8_t pin_bits, uint8_t edge)
+void gpio_set_interrupt(hal_port_t *port, uint8_t pin_bits, uint8_t edge)
 {
   if(edge == GPIO_FALLING) {
     port->IES |= pin_bits;
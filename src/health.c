@@ -0,0 +1,142 @@
+// File       : health.c
+// Author     : Jeff Schornick
+//
+// Periodic TMC26x driver health polling and fault latching
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include "uart.h"
+#include "log.h"
+#include "timer.h"
+#include "tmc.h"
+#include "motion.h"
+#include "gcode.h"
+#include "homing.h"
+#include "health.h"
+
+uint16_t health_period_ms = 100;
+uint8_t health_latched[3];
+uint16_t health_counts[3][HEALTH_COUNTERS];
+
+static uint32_t health_seq[3];      // last tmc_status[].seq examined
+static uint32_t health_seen_ms[3];  // time of the last examined response
+static uint8_t health_last[3];      // flags from the last examined response
+
+static const char *health_names[] = { "OT", "OTPW", "S2GA", "S2GB", "OLA", "OLB" };
+
+// Controlled stop: stepping halts, queued motion and g-code are kept so the
+// job can resume with 'm' / 'G' once the fault is understood and cleared.
+static void health_feed_hold(uint8_t tmc, uint8_t faults)
+{
+  if (!(motion_inhibit & MOTION_INHIBIT_FAULT) && LOG_ON(LOG_ERROR)) {
+    uart_queue_str("\r\n!! Driver ");
+    uart_queue_hex(tmc, 4);
+    uart_queue_str(" fault ");
+    uart_queue_hex(faults, 8);
+    uart_queue_str(", feed hold !!\r\n");
+  }
+  motion_inhibit |= MOTION_INHIBIT_FAULT;
+  motion_stop();
+  gcode_enabled = 0;
+  homing_cancel();
+}
+
+static void health_check(uint8_t tmc, uint8_t flags)
+{
+  uint8_t faults = flags & HEALTH_FAULTS;
+  uint8_t rising = faults & ~health_last[tmc];
+  uint8_t i;
+
+  health_last[tmc] = faults;
+  if (!rising) {
+    return;
+  }
+
+  health_latched[tmc] |= rising;
+  for(i=0; i<HEALTH_COUNTERS; i++) {
+    if (rising & (TMC_STAT_OT << i)) {
+      health_counts[tmc][i]++;
+    }
+  }
+
+  if (rising & HEALTH_HARD_FAULTS) {
+    health_feed_hold(tmc, rising);
+  } else if (LOG_ON(LOG_WARN)) {
+    uart_queue_str("\r\nDriver ");
+    uart_queue_hex(tmc, 4);
+    uart_queue_str(" warning ");
+    uart_queue_hex(rising, 8);
+    uart_queue_str("\r\n");
+  }
+}
+
+// Function: health_poll
+//
+// Called from the main loop. Checks every fresh driver response for
+// faults, and requests a reading from any driver that has been quiet for
+// health_period_ms. Requests go through the async SPI queue, so polling
+// never blocks the main loop or delays the step interrupt.
+void health_poll(void)
+{
+  uint8_t i;
+  uint32_t now = systick_ms;
+
+  for(i=0; i<3; i++) {
+    if (tmc_status[i].seq != health_seq[i]) {
+      health_seq[i] = tmc_status[i].seq;
+      health_seen_ms[i] = now;
+      health_check(i, tmc_status[i].flags);
+    }
+
+    // keep whatever reading is selected, the flags come with all of them
+    if ( health_period_ms && (now - health_seen_ms[i] >= health_period_ms) ) {
+      if (tmc_request_status(i, tmc_config[i].drvconf.RDSEL) == SPI_OK) {
+        health_seen_ms[i] = now;
+      }
+    }
+  }
+}
+
+// Function: health_clear
+//
+// Clears latched faults and releases the feed hold. Counters are kept.
+void health_clear(void)
+{
+  uint8_t i;
+
+  for(i=0; i<3; i++) {
+    health_latched[i] = 0;
+  }
+  motion_inhibit &= ~MOTION_INHIBIT_FAULT;
+}
+
+void health_report(void)
+{
+  uint8_t i;
+  uint8_t j;
+
+  uart_queue_str("\r\nDriver health (poll ");
+  uart_queue_dec(health_period_ms);
+  uart_queue_str(" ms)");
+  if (motion_inhibit & MOTION_INHIBIT_FAULT) {
+    uart_queue_str(" : FEED HOLD");
+  }
+  uart_queue_str("\r\n");
+
+  for(i=0; i<3; i++) {
+    uart_queue_str("  #");
+    uart_queue_hex(i, 4);
+    uart_queue_str(" latched ");
+    uart_queue_hex(health_latched[i], 8);
+    uart_queue_str(" :");
+    for(j=0; j<HEALTH_COUNTERS; j++) {
+      uart_queue(' ');
+      uart_queue_str((char *) health_names[j]);
+      uart_queue('=');
+      uart_queue_dec(health_counts[i][j]);
+    }
+    uart_queue_str("\r\n");
+  }
+}
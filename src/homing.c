@@ -0,0 +1,205 @@
+// File       : homing.c
+// Author     : Jeff Schornick
+//
+// Sensorless homing using TMC26x StallGuard2
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include "hal.h"
+#include "uart.h"
+#include "log.h"
+#include "timer.h"
+#include "tmc.h"
+#include "motion.h"
+#include "homing.h"
+
+int8_t homing_dir[]     = { -1, -1, 1 };    // Z homes up
+int8_t homing_sgt[]     = { 4, 4, 4 };
+uint8_t homing_cscale[] = { 0x4, 0x2, 0x6 };
+
+uint16_t homing_sg_stall = 0;
+uint16_t homing_rate = 150;
+uint32_t homing_travel = 20000;
+uint16_t homing_backoff = 100;
+
+homing_state_t homing_state = HOMING_IDLE;
+
+// Z first, so the tool is clear before the table moves
+static const uint8_t homing_order[] = { Z_AXIS, X_AXIS, Y_AXIS };
+
+static uint8_t homing_index;
+static uint8_t homing_axis;
+static uint32_t homing_queued;     // seek steps queued so far
+static uint32_t homing_seek_ms;    // seek start time
+static uint32_t homing_sample_ms;  // last StallGuard request
+static uint32_t homing_seq;        // last tmc_status[].seq examined
+static sgcsconf_t homing_saved_sgcsconf;
+
+static char axis_name(uint8_t axis)
+{
+  if (axis == X_AXIS) {
+    return 'X';
+  } else if (axis == Y_AXIS) {
+    return 'Y';
+  }
+  return 'Z';
+}
+
+// Queue a single-axis move, returns 0 if the motion queue is busy
+static uint8_t homing_queue_move(int32_t steps, uint16_t rate)
+{
+  int32_t xyz[] = {0, 0, 0};
+
+  if (next_motion) {
+    return 0;
+  }
+  xyz[homing_axis] = steps;
+  next_motion = new_linear_motion(xyz[X_AXIS], xyz[Y_AXIS], xyz[Z_AXIS], rate, HOMING_MOTION_ID);
+  motion_start();
+  return 1;
+}
+
+static void homing_restore_driver(void)
+{
+  tmc_config[homing_axis].sgcsconf = homing_saved_sgcsconf;
+  tmc_update(homing_axis);
+}
+
+static void homing_fail(const char *reason)
+{
+  motion_abort();
+  homing_restore_driver();
+  homing_state = HOMING_FAILED;
+  if (LOG_ON(LOG_ERROR)) {
+    uart_queue_str("\r\nHoming ");
+    uart_queue(axis_name(homing_axis));
+    uart_queue_str(" failed: ");
+    uart_queue_str((char *) reason);
+    uart_queue_str("\r\n");
+  }
+}
+
+// Function: homing_start
+//
+// Begins a homing cycle over all axes. Progress is made by homing_poll().
+void homing_start(void)
+{
+  if (motion || next_motion) {
+    uart_queue_str("Motion in progress, not homing!\r\n");
+    return;
+  }
+  homing_index = 0;
+  homing_state = HOMING_SEEK_START;
+}
+
+// Function: homing_cancel
+//
+// Stops an active homing cycle, leaving the axis position unchanged.
+void homing_cancel(void)
+{
+  if ((homing_state == HOMING_SEEK) || (homing_state == HOMING_BACKOFF)) {
+    homing_fail("cancelled");
+  } else if (homing_state == HOMING_SEEK_START) {
+    homing_state = HOMING_FAILED;
+  }
+}
+
+// True while a cycle owns the drivers' StallGuard and current settings
+HAL_RAMFUNC uint8_t homing_active(void)
+{
+  return (homing_state == HOMING_SEEK_START) || (homing_state == HOMING_SEEK) ||
+    (homing_state == HOMING_BACKOFF);
+}
+
+// Function: homing_poll
+//
+// Advances the homing state machine, called from the main loop. While
+// seeking, StallGuard is sampled every HOMING_SAMPLE_MS through the
+// asynchronous status path so stepping is never held up by SPI traffic.
+void homing_poll(void)
+{
+  volatile tmc_status_t *status;
+  uint32_t now = systick_ms;
+
+  switch (homing_state) {
+
+    case HOMING_SEEK_START:
+      homing_axis = homing_order[homing_index];
+      if (LOG_ON(LOG_INFO)) {
+        uart_queue_str("\r\nHoming ");
+        uart_queue(axis_name(homing_axis));
+        uart_queue_str("...\r\n");
+      }
+      homing_saved_sgcsconf = tmc_config[homing_axis].sgcsconf;
+      tmc_config[homing_axis].sgcsconf.SGT = homing_sgt[homing_axis];
+      tmc_config[homing_axis].sgcsconf.CSCALE = homing_cscale[homing_axis];
+      tmc_update(homing_axis);
+
+      homing_queued = 0;
+      homing_seek_ms = now;
+      homing_sample_ms = now;
+      homing_seq = tmc_status[homing_axis].seq;
+      homing_state = HOMING_SEEK;
+      break;
+
+    case HOMING_SEEK:
+      // keep the seek going a chunk at a time (step tables are per-step)
+      if (homing_queued < homing_travel) {
+        if (homing_queue_move(homing_dir[homing_axis] * HOMING_SEEK_CHUNK, homing_rate)) {
+          homing_queued += HOMING_SEEK_CHUNK;
+        }
+      } else if (!motion && !next_motion) {
+        homing_fail("no stall detected");
+        break;
+      }
+
+      if (now - homing_sample_ms >= HOMING_SAMPLE_MS) {
+        if (tmc_request_status(homing_axis, TMC_RDSEL_SG) == SPI_OK) {
+          homing_sample_ms = now;
+        }
+      }
+
+      status = &tmc_status[homing_axis];
+      if ( (status->seq != homing_seq) && (status->rdsel == TMC_RDSEL_SG) ) {
+        homing_seq = status->seq;
+        if (LOG_ON(LOG_TRACE)) {
+          uart_queue_str("SG: ");
+          uart_queue_dec(status->sg);
+          uart_queue_str("\r\n");
+        }
+        if ( (now - homing_seek_ms >= HOMING_BLANK_MS) &&
+             ((status->flags & TMC_STAT_SG) || (status->sg <= homing_sg_stall)) ) {
+          motion_abort();
+          homing_restore_driver();
+          if (LOG_ON(LOG_INFO)) {
+            uart_queue_str("Stall at ");
+            uart_queue_sdec(pos[homing_axis]);
+            uart_queue_str(", backing off\r\n");
+          }
+          homing_queue_move(-homing_dir[homing_axis] * homing_backoff, rapid_rate);
+          homing_state = HOMING_BACKOFF;
+        }
+      }
+      break;
+
+    case HOMING_BACKOFF:
+      if (!motion && !next_motion) {
+        pos[homing_axis] = 0;
+        homing_index++;
+        if (homing_index < sizeof(homing_order)) {
+          homing_state = HOMING_SEEK_START;
+        } else {
+          homing_state = HOMING_DONE;
+          if (LOG_ON(LOG_INFO)) {
+            uart_queue_str("Homing complete\r\n");
+          }
+        }
+      }
+      break;
+
+    default:
+      break;
+  }
+}
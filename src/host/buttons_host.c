@@ -0,0 +1,34 @@
+// File       : buttons_host.c
+// Author     : Jeff Schornick
+//
+// Button flags and limit switch control for the Linux host build. There
+// are no button interrupts; the flags only change if a caller sets them.
+//
+// Compilation: host GCC, see `make host`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include "hal.h"
+#include "gpio.h"
+#include "buttons.h"
+
+volatile uint8_t B1_flag;
+volatile uint8_t B2_flag;
+volatile uint8_t B3_flag;
+
+void button_init(void)
+{
+  B1_flag = 0;
+  B2_flag = 0;
+  B3_flag = 0;
+}
+
+void enable_limit_switch(void)
+{
+  gpio_set_interrupt(BUTTON3, GPIO_FALLING);
+}
+
+void disable_limit_switch(void)
+{
+  gpio_disable_interrupt(BUTTON3);
+}
@@ -0,0 +1,25 @@
+// File       : hal_host.c
+// Author     : Jeff Schornick
+//
+// Hardware abstraction layer, Linux host backend: GPIO, IRQ mask state
+// and the cycle counter
+//
+// Compilation: host GCC, see `make host`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <time.h>
+#include "hal.h"
+
+hal_port_t hal_ports[HAL_PORTS];
+volatile uint32_t hal_irq_masked = 0;
+
+uint32_t hal_cycles(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t) ((uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec);
+}
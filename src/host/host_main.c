@@ -0,0 +1,220 @@
+// File       : host_main.c
+// Author     : Jeff Schornick
+//
+// Native test and benchmark driver for the G-code parser and planner.
+//
+// Reads a G-code file, parses and plans each line as the firmware would,
+// then walks every motion's step table the same way the step ISR does to
+// track position and step time.
+//
+//   cnc_host [-v] [-b runs] [-e x,y,z] file.gcode
+//   cnc_host -B
+//
+//   -B        run the micro-benchmarks (bench.h) and exit
+//   -v        echo firmware output (log level from the build)
+//   -b runs   repeat the job and report parse+plan time per block
+//   -e x,y,z  exit non-zero unless the job ends at this position
+//
+// Compilation: host GCC, see `make host`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hal.h"
+#include "uart.h"
+#include "log.h"
+#include "fifo.h"
+#include "tmc.h"
+#include "motion.h"
+#include "stepper.h"
+#include "gcode.h"
+#include "bench.h"
+
+typedef struct {
+  uint32_t blocks;
+  uint64_t edges;      // step table entries walked
+  uint64_t ticks;      // step timer ticks (ACLK)
+  uint64_t plan_ns;    // time spent parsing and planning
+} job_stats_t;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Same bookkeeping as TA1_0_IRQHandler, without the pins
+static void execute(motion_t *block, job_stats_t *stats)
+{
+  int8_t dir[3];
+  int32_t step = 1 << block->shift;
+  uint32_t i;
+  uint16_t k;
+
+  for(i=0; i<3; i++) {
+    dir[i] = (block->dirs[i] == TMC_FWD) ? 1 : -1;
+  }
+
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+  // per-axis streams, each axis independently
+  for(uint8_t a=0; a<3; a++) {
+    for(i=0; i<block->axis_count[a]; i++) {
+      uint8_t code = block->axis_steps[a][i].step_data >> STEPPER_BIT(a);
+
+      for(k=0; k<=block->axis_steps[a][i].repeat; k++) {
+        if (code & 1) {
+          pos[a] += dir[a] * step;
+        }
+        if (code & 2) {
+          dir[a] = -dir[a];
+        }
+      }
+    }
+  }
+  stats->ticks += block->ticks;
+#else
+  for(i=0; i<block->count; i++) {
+    step_timing_t *s = &block->steps[i];
+
+    for(k=0; k<=s->repeat; k++) {
+      stats->ticks += s->timer_ticks + 1;
+      if (s->x) {
+        pos[X_AXIS] += dir[X_AXIS] * step;
+      }
+      if (s->y) {
+        pos[Y_AXIS] += dir[Y_AXIS] * step;
+      }
+      if (s->z) {
+        pos[Z_AXIS] += dir[Z_AXIS] * step;
+      }
+      if (s->x_flip) {
+        dir[X_AXIS] = -dir[X_AXIS];
+      }
+      if (s->y_flip) {
+        dir[Y_AXIS] = -dir[Y_AXIS];
+      }
+      if (s->z_flip) {
+        dir[Z_AXIS] = -dir[Z_AXIS];
+      }
+    }
+  }
+#endif
+  stats->edges += block->count;
+  stats->blocks++;
+}
+
+static void run_job(FILE *in, job_stats_t *stats)
+{
+  char line[256];
+  char *c;
+  uint64_t start;
+  motion_t *block;
+
+  init_gcode_state();
+  pos[X_AXIS] = pos[Y_AXIS] = pos[Z_AXIS] = 0;
+
+  while (fgets(line, sizeof(line), in)) {
+    start = now_ns();
+    for(c = line; *c && (*c != '\n') && (*c != '\r'); c++) {
+      fifo_push(&gcode_input_fifo, *c);
+    }
+    fifo_push(&gcode_input_fifo, '\r');
+    parse_gcode();
+
+    while (gcode_cmd_count) {
+      run_gcode();
+      block = next_motion;
+      next_motion = 0;
+      stats->plan_ns += now_ns() - start;
+      if (block) {
+        execute(block, stats);
+        free_motion(block);
+      }
+      start = now_ns();
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  FILE *in;
+  job_stats_t stats;
+  uint32_t runs = 1;
+  uint32_t run;
+  int32_t expect[3];
+  uint8_t check = 0;
+  int opt = 1;
+
+  log_level = LOG_WARN;
+  while ( (opt < argc) && (argv[opt][0] == '-') ) {
+    if (!strcmp(argv[opt], "-v")) {
+      uart_host_echo = 1;
+      log_level = LOG_LEVEL;
+    } else if (!strcmp(argv[opt], "-B")) {
+      uart_host_echo = 1;
+      uart_init();
+      init_parser();
+      tmc_init();
+      stepper_init();
+      bench_run();
+      return 0;
+    } else if (!strcmp(argv[opt], "-b") && (opt + 1 < argc)) {
+      runs = atoi(argv[++opt]);
+    } else if (!strcmp(argv[opt], "-e") && (opt + 1 < argc)) {
+      if (sscanf(argv[++opt], "%d,%d,%d", &expect[0], &expect[1], &expect[2]) != 3) {
+        fprintf(stderr, "bad position: %s\n", argv[opt]);
+        return 2;
+      }
+      check = 1;
+    } else {
+      break;
+    }
+    opt++;
+  }
+  if ( (opt >= argc) || (runs == 0) ) {
+    fprintf(stderr, "usage: %s [-v] [-b runs] [-e x,y,z] file.gcode\n       %s -B\n", argv[0], argv[0]);
+    return 2;
+  }
+
+  in = fopen(argv[opt], "r");
+  if (!in) {
+    perror(argv[opt]);
+    return 2;
+  }
+
+  uart_init();
+  init_parser();
+  tmc_init();
+
+  memset(&stats, 0, sizeof(stats));
+  for(run=0; run<runs; run++) {
+    rewind(in);
+    run_job(in, &stats);
+  }
+  fclose(in);
+
+  printf("blocks       : %u\n", stats.blocks / runs);
+  printf("step entries : %llu\n", (unsigned long long) (stats.edges / runs));
+  printf("step time    : %.3f s\n", (double) (stats.ticks / runs) / 32768.0);
+  printf("final pos    : %d, %d, %d\n", pos[X_AXIS], pos[Y_AXIS], pos[Z_AXIS]);
+  if (stats.blocks) {
+    printf("parse+plan   : %.2f us/block (%u runs)\n",
+           (double) stats.plan_ns / stats.blocks / 1000.0, runs);
+  }
+
+  if (check) {
+    if ( (pos[X_AXIS] != expect[0]) || (pos[Y_AXIS] != expect[1]) || (pos[Z_AXIS] != expect[2]) ) {
+      printf("FAIL: expected %d, %d, %d\n", expect[0], expect[1], expect[2]);
+      return 1;
+    }
+    printf("PASS\n");
+  }
+  return 0;
+}
@@ -0,0 +1,575 @@
+// File       : sim_main.c
+// Author     : Jeff Schornick
+//
+// Deterministic virtual-time simulator for whole G-code jobs.
+//
+// A discrete-event clock drives the firmware's interrupt handlers at their
+// hardware rates: the step timer (TA1_0_IRQHandler, ACLK up mode, and the
+// emulated DMA of STEP_BACKEND_DMA), the
+// coil timer (TA2_0_IRQHandler), SysTick and the UART (EUSCIA0_IRQHandler,
+// 57600 8N1). After every interrupt the real main loop work runs once
+// (control_poll), as the firmware does after waking from __sleep. The main
+// loop itself takes no virtual time, so ISR latency is not modelled.
+//
+// The job is typed into the G-code prompt ('r' from the main menu) one
+// character per UART frame. A new line is only sent while fewer than
+// `depth` commands are queued, like a sender waiting for the queue to
+// drain. The queue is run (gcode_enabled) once the prompt is up.
+//
+// Every STEP and DIR pin edge is recorded with its virtual time and can be
+// written as CSV (time_ns,signal,value,pos) or VCD, chosen by file
+// extension. A CSV trace can be kept as a reference and later runs compared
+// against it (see trace.h); the run passes if it is identical, or with -d
+// if path deviation and final position error stay within the bound.
+//
+//   cnc_sim [-v] [-q depth] [-t seconds] [-o trace.csv|trace.vcd]
+//           [-c reference.csv [-d steps]] file.gcode
+//
+//   -v          echo firmware output (log level capped at INFO)
+//   -q depth    queued commands before the sender waits (default 8)
+//   -t seconds  give up after this much virtual time (default 3600)
+//   -o file     write the pin trace
+//   -c file     compare against a reference CSV trace
+//   -d steps    allowed deviation when not identical
+//
+// The report gives, per axis, step count, interval range and jitter (the
+// change between consecutive step intervals within a block), the maximum
+// step rate achieved, the gaps between blocks and any time the motion
+// queue ran dry while the job still had commands to run (starvation).
+//
+// Compilation: host GCC, see `make host`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hal.h"
+#include "uart.h"
+#include "log.h"
+#include "fifo.h"
+#include "timer.h"
+#include "tmc.h"
+#include "motion.h"
+#include "gcode.h"
+#include "menu.h"
+#include "drive.h"
+#include "coil.h"
+#include "control.h"
+#include "stepper.h"
+#include "trace.h"
+
+#define NS_PER_S      1000000000ull
+#define ACLK_HZ       32768
+#define SMCLK_HZ      COIL_SMCLK
+#define UART_BAUD     57600
+#define UART_FRAME_NS (10 * NS_PER_S / UART_BAUD)  /* 8N1, 10 bits */
+#define SYSTICK_NS    (NS_PER_S / 1000)
+#define NEVER         UINT64_MAX
+
+#define SIGNALS 6  /* STEP and DIR per axis */
+
+static const char *axis_names = "YZX";  // indexed by axis number
+
+typedef struct {
+  uint64_t steps;
+  uint64_t last_ns;     // time of the previous step edge
+  uint64_t last_dt;     // previous interval, 0 at the start of a block
+  uint64_t min_dt;
+  uint64_t max_dt;
+  uint64_t jitter_max;
+  double jitter_sq;
+  uint64_t jitter_n;
+} axis_stats_t;
+
+typedef struct {
+  uint32_t blocks;
+  uint8_t gap_open;     // a block has started, its first edge ends the gap
+  uint64_t first_ns;    // first step edge of the job
+  uint64_t last_ns;     // last step edge of the job
+  uint64_t gap_max;
+  uint64_t gap_sum;
+  uint32_t gaps;
+  uint32_t starved;     // times the motion queue ran dry mid-job
+  uint64_t starved_ns;
+  uint64_t isr_calls;
+} job_stats_t;
+
+static uint64_t now;
+static axis_stats_t axis[3];
+static job_stats_t job;
+
+static FILE *trace;
+static uint8_t trace_vcd;
+static uint8_t pin_state[SIGNALS];
+static trace_t run_trace;
+static int32_t trace_pos[3];  // as rebuilt from the CSV rows
+
+// Signal k: axis k/2, STEP when k is even, DIR when odd
+static uint8_t read_pin(uint8_t k)
+{
+  uint8_t i = k >> 1;
+
+  if (k & 1) {
+    return (tmc_pins[i].dir_port->OUT & tmc_pins[i].dir_pin) ? 1 : 0;
+  }
+  return (tmc_pins[i].step_port->OUT & tmc_pins[i].step_pin) ? 1 : 0;
+}
+
+static void trace_open(const char *name)
+{
+  uint8_t k;
+  size_t len = strlen(name);
+
+  trace = fopen(name, "w");
+  if (!trace) {
+    perror(name);
+    exit(2);
+  }
+  trace_vcd = (len > 4) && !strcmp(name + len - 4, ".vcd");
+
+  if (trace_vcd) {
+    fprintf(trace, "$timescale 1 ns $end\n$scope module cnc $end\n");
+    for(k=0; k<SIGNALS; k++) {
+      fprintf(trace, "$var wire 1 %c %c_%s $end\n", '!' + k,
+              axis_names[k >> 1], (k & 1) ? "DIR" : "STEP");
+    }
+    fprintf(trace, "$upscope $end\n$enddefinitions $end\n#0\n$dumpvars\n");
+    for(k=0; k<SIGNALS; k++) {
+      fprintf(trace, "%u%c\n", pin_state[k], '!' + k);
+    }
+    fprintf(trace, "$end\n");
+  } else {
+    fprintf(trace, "time_ns,signal,value,pos\n");
+  }
+}
+
+static void trace_edge(uint8_t k, uint8_t value)
+{
+  static uint64_t vcd_time = 0;
+
+  if (!(k & 1)) {
+#if STEP_BACKEND == STEP_BACKEND_DMA
+    // pos[] only catches up at the end of each half of the table
+    trace_pos[k >> 1] += stepper_delta[k >> 1];
+#else
+    trace_pos[k >> 1] = pos[k >> 1];
+#endif
+    trace_add(&run_trace, now, trace_pos);
+  }
+  if (!trace) {
+    return;
+  }
+  if (trace_vcd) {
+    if (now != vcd_time) {
+      fprintf(trace, "#%llu\n", (unsigned long long) now);
+      vcd_time = now;
+    }
+    fprintf(trace, "%u%c\n", value, '!' + k);
+  } else {
+    if (k & 1) {
+      fprintf(trace, "%llu,%c_DIR,%u,\n", (unsigned long long) now, axis_names[k >> 1], value);
+    } else {
+      fprintf(trace, "%llu,%c_STEP,%u,%d\n", (unsigned long long) now, axis_names[k >> 1],
+              value, trace_pos[k >> 1]);
+    }
+  }
+}
+
+static void step_edge(uint8_t i, uint8_t block_start)
+{
+  axis_stats_t *a = &axis[i];
+  uint64_t dt, jitter;
+
+  if (a->steps && !block_start) {
+    dt = now - a->last_ns;
+    if (!a->min_dt || (dt < a->min_dt)) {
+      a->min_dt = dt;
+    }
+    if (dt > a->max_dt) {
+      a->max_dt = dt;
+    }
+    if (a->last_dt) {
+      jitter = (dt > a->last_dt) ? dt - a->last_dt : a->last_dt - dt;
+      if (jitter > a->jitter_max) {
+        a->jitter_max = jitter;
+      }
+      a->jitter_sq += (double) jitter * jitter;
+      a->jitter_n++;
+    }
+    a->last_dt = dt;
+  } else {
+    a->last_dt = 0;
+  }
+  a->last_ns = now;
+  a->steps++;
+}
+
+// Record pin changes since the last call. block_start marks the edges of
+// the first step of a block, which start new interval runs.
+static void sample_pins(uint8_t block_start)
+{
+  uint8_t k, value;
+  uint8_t stepped = 0;
+
+  for(k=0; k<SIGNALS; k++) {
+    value = read_pin(k);
+    if (value == pin_state[k]) {
+      continue;
+    }
+    pin_state[k] = value;
+    trace_edge(k, value);
+    if (!(k & 1)) {
+      step_edge(k >> 1, block_start);
+      stepped = 1;
+    }
+  }
+
+  if (stepped) {
+    if (block_start && job.gap_open && (job.blocks > 1)) {
+      job.gap_sum += now - job.last_ns;
+      job.gaps++;
+      if (now - job.last_ns > job.gap_max) {
+        job.gap_max = now - job.last_ns;
+      }
+    }
+    if (block_start) {
+      job.gap_open = 0;
+    }
+    if (!job.first_ns) {
+      job.first_ns = now;
+    }
+    job.last_ns = now;
+  }
+}
+
+static uint64_t aclk_to_ns(uint64_t ticks)
+{
+  return ticks * NS_PER_S / ACLK_HZ;
+}
+
+static void print_axis(uint8_t i)
+{
+  axis_stats_t *a = &axis[i];
+
+  printf("%c: %8llu steps", axis_names[i], (unsigned long long) a->steps);
+  if (a->min_dt) {
+    printf(", interval %.1f-%.1f us, max rate %.0f/s, jitter max %.1f us rms %.1f us",
+           a->min_dt / 1000.0, a->max_dt / 1000.0, (double) NS_PER_S / a->min_dt,
+           a->jitter_max / 1000.0,
+           a->jitter_n ? sqrt(a->jitter_sq / a->jitter_n) / 1000.0 : 0.0);
+  }
+  printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+  FILE *in;
+  char line[256];
+  char *sending = 0;        // rest of the line being typed, 0 between lines
+  uint8_t fed_all = 0;
+  uint32_t depth = 8;
+  uint64_t limit = 3600 * NS_PER_S;
+  const char *trace_name = 0;
+  const char *ref_name = 0;
+  double bound = -1;
+  trace_t ref_trace;
+  trace_diff_t diff;
+  int status;
+  int opt = 1;
+
+  uint64_t step_tick = 0;   // ACLK tick of the next step timer wrap
+  uint64_t step_next, coil_next, tick_next, rx_next, tx_next, next;
+  uint64_t axis_next[3];
+  uint8_t axis_fresh = 0;   // axes yet to make their first step of a block
+#if STEP_BACKEND == STEP_BACKEND_DMA
+  uint8_t frame_fresh = 0;  // next DMA frame is a block's first step
+#endif
+  uint64_t coil_period;
+  uint8_t tx_busy = 0;
+  uint8_t block_start;
+  uint8_t starving = 0;
+  uint64_t starve_start = 0;
+  uint8_t pending;
+
+  log_level = LOG_WARN;
+  while ( (opt < argc) && (argv[opt][0] == '-') ) {
+    if (!strcmp(argv[opt], "-v")) {
+      uart_host_echo = 1;
+      // uart_flush() at TRACE would wait forever on the paced UART
+      log_level = (LOG_LEVEL < LOG_INFO) ? LOG_LEVEL : LOG_INFO;
+    } else if (!strcmp(argv[opt], "-q") && (opt + 1 < argc)) {
+      depth = atoi(argv[++opt]);
+    } else if (!strcmp(argv[opt], "-t") && (opt + 1 < argc)) {
+      limit = (uint64_t) (atof(argv[++opt]) * NS_PER_S);
+    } else if (!strcmp(argv[opt], "-o") && (opt + 1 < argc)) {
+      trace_name = argv[++opt];
+    } else if (!strcmp(argv[opt], "-c") && (opt + 1 < argc)) {
+      ref_name = argv[++opt];
+    } else if (!strcmp(argv[opt], "-d") && (opt + 1 < argc)) {
+      bound = atof(argv[++opt]);
+    } else {
+      break;
+    }
+    opt++;
+  }
+  if ( (opt >= argc) || (depth == 0) || (depth > GCODE_CMD_QUEUE_SIZE) ) {
+    fprintf(stderr, "usage: %s [-v] [-q depth] [-t seconds] [-o trace.csv|trace.vcd]\n"
+            "       [-c reference.csv [-d steps]] file.gcode\n", argv[0]);
+    return 2;
+  }
+
+  in = fopen(argv[opt], "r");
+  if (!in) {
+    perror(argv[opt]);
+    return 2;
+  }
+  if (ref_name && !trace_load_csv(ref_name, &ref_trace)) {
+    return 2;
+  }
+  trace_init(&run_trace);
+
+  // same order as main() in cnc.c
+  uart_host_paced = 1;
+  uart_init();
+  timer_init();
+  coil_init();
+  init_parser();
+  tmc_init();
+  stepper_init();
+  drive_init();
+  input_state = INPUT_MENU;
+
+  for(opt=0; opt<SIGNALS; opt++) {
+    pin_state[opt] = read_pin(opt);
+  }
+  if (trace_name) {
+    trace_open(trace_name);
+  }
+  memset(axis, 0, sizeof(axis));
+  memset(&job, 0, sizeof(job));
+
+  coil_period = (uint64_t) (timer_host_coil_ccr + 1) * NS_PER_S / SMCLK_HZ;
+  coil_next = coil_period;
+  tick_next = SYSTICK_NS;
+  tx_next = NEVER;
+
+  // enter the G-code prompt
+  uart_host_receive('r');
+  control_poll();
+  rx_next = UART_FRAME_NS;
+
+  while (now < limit) {
+    // next event, a timer stopped by CCR0 = 0 restarts from now
+    if (timer_host_step_ccr) {
+      if (aclk_to_ns(step_tick) < now) {
+        step_tick = now * ACLK_HZ / NS_PER_S + 1;
+      }
+      step_next = aclk_to_ns(step_tick);
+    } else {
+      step_next = NEVER;
+    }
+    next = step_next;
+    for(opt=0; opt<3; opt++) {
+      axis_next[opt] = timer_host_axis_ie[opt] ? aclk_to_ns(timer_host_axis_at[opt]) : NEVER;
+      if (axis_next[opt] < next) {
+        next = axis_next[opt];
+      }
+    }
+    if (timer_host_coil_ie && (coil_next < next)) {
+      next = coil_next;
+    }
+    if (tick_next < next) {
+      next = tick_next;
+    }
+    if (rx_next < next) {
+      next = rx_next;
+    }
+    if (tx_next < next) {
+      next = tx_next;
+    }
+    now = next;
+    block_start = 0;
+
+    // STEP_BACKEND_AXIS compare channels, ahead of a block clock tick on
+    // the same ACLK tick as the target's TA1_0 handler does
+    for(opt=0; opt<3; opt++) {
+      if (timer_host_axis_ie[opt] && (now == axis_next[opt])) {
+        block_start |= (axis_fresh >> opt) & 1;
+        axis_fresh &= ~(1 << opt);
+        timer_host_aclk = timer_host_axis_at[opt];
+        job.isr_calls++;
+        timer_host_axis_match(opt);
+      }
+    }
+
+    if (now == step_next) {
+      // up mode: the counter wraps after CCR0 + 1 ticks. Armed compare
+      // outputs (STEP_BACKEND_TIMER) toggle at the match; they are parked
+      // whenever the interrupt is off.
+#if STEP_BACKEND == STEP_BACKEND_DMA
+      // while streaming the DMA writes a frame at each wrap, the handlers
+      // only run at the end of a half or to start from idle
+      if (timer_host_dma_on || timer_host_step_ie) {
+        motion_t *running = motion;
+
+        if (timer_host_dma_on) {
+          block_start = frame_fresh;
+          frame_fresh = 0;
+          timer_host_dma_match();
+          // the half's edges are recorded before its interrupt moves on
+          sample_pins(block_start);
+          block_start = 0;
+          if (timer_host_dma_irq) {
+            DMA_INT3_IRQHandler();
+            job.isr_calls++;
+          }
+        } else {
+          TA1_0_IRQHandler();
+          job.isr_calls++;
+        }
+        if (motion && (motion != running)) {
+          job.blocks++;
+          job.gap_open = 1;
+          frame_fresh = 1;
+        }
+      }
+#else
+      if (timer_host_step_ie) {
+        timer_host_step_match();
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+        // blocks start at the tick that promotes them, their first edges
+        // come later from the axis channels
+        motion_t *running = motion;
+
+        timer_host_aclk = step_tick;
+        TA1_0_IRQHandler();
+        if (motion && (motion != running)) {
+          job.blocks++;
+          job.gap_open = 1;
+          axis_fresh = 0x7;
+        }
+#else
+        block_start = motion && (motion_tick == 0);
+        if (block_start) {
+          job.blocks++;
+          job.gap_open = 1;
+        }
+        TA1_0_IRQHandler();
+#endif
+        job.isr_calls++;
+      }
+#endif
+      step_tick += timer_host_step_ccr + 1;
+    }
+    if (now >= coil_next) {
+      if (timer_host_coil_ie) {
+        TA2_0_IRQHandler();
+      }
+      coil_next = now + coil_period;
+    }
+    if (now == tick_next) {
+      SysTick_Handler();
+      tick_next += SYSTICK_NS;
+    }
+    if (now == tx_next) {
+      tx_busy = 0;
+      tx_next = NEVER;
+      uart_host_tx_done();
+    }
+    if (now == rx_next) {
+      rx_next = NEVER;
+      if (!sending && !fed_all && (input_state == INPUT_GCODE) && (gcode_cmd_count < depth)) {
+        if (fgets(line, sizeof(line), in)) {
+          line[strcspn(line, "\r\n")] = '\r';
+          sending = line;
+          gcode_enabled = 1;
+        } else {
+          fed_all = 1;
+        }
+      }
+      if (sending) {
+        uart_host_receive(*sending);
+        sending = (*sending == '\r') ? 0 : sending + 1;
+      }
+      if (!fed_all) {
+        rx_next = now + UART_FRAME_NS;
+      }
+    }
+
+    sample_pins(block_start);
+    control_poll();
+    sample_pins(0);
+
+    if (!(uart_host_ifg & UART_HOST_TXIFG) && !tx_busy) {
+      tx_busy = 1;
+      tx_next = now + UART_FRAME_NS;
+    }
+
+    pending = !fed_all || sending || gcode_cmd_count || gcode_input_fifo.count || rx_fifo.count;
+    if (!motion && !next_motion) {
+      if (!pending) {
+        break;
+      }
+      if (job.blocks && !starving) {
+        starving = 1;
+        starve_start = now;
+        job.starved++;
+      }
+    } else if (starving) {
+      starving = 0;
+      job.starved_ns += now - starve_start;
+    }
+  }
+  fclose(in);
+
+  // let the rest of the output through unpaced
+  uart_host_paced = 0;
+  uart_prime_tx();
+
+  if (trace) {
+    fclose(trace);
+  }
+
+  if (now >= limit) {
+    printf("TIMEOUT after %.3f s virtual time\n", (double) now / NS_PER_S);
+  }
+  printf("blocks       : %u\n", job.blocks);
+  printf("step ISRs    : %llu\n", (unsigned long long) job.isr_calls);
+  printf("job time     : %.6f s (first to last step %.6f s)\n", (double) now / NS_PER_S,
+         (double) (job.last_ns - job.first_ns) / NS_PER_S);
+  print_axis(X_AXIS);
+  print_axis(Y_AXIS);
+  print_axis(Z_AXIS);
+  if (job.gaps) {
+    printf("block gaps   : %u, mean %.1f us, max %.1f us\n", job.gaps,
+           (double) job.gap_sum / job.gaps / 1000.0, job.gap_max / 1000.0);
+  }
+  printf("starvation   : %u times, %.3f ms total\n", job.starved, job.starved_ns / 1e6);
+  printf("final pos    : %d, %d, %d\n", pos[X_AXIS], pos[Y_AXIS], pos[Z_AXIS]);
+
+  status = (now >= limit) ? 1 : 0;
+  if (ref_name) {
+    trace_diff(&ref_trace, &run_trace, &diff);
+    printf("reference    : %s, %u steps\n", ref_name, ref_trace.count);
+    printf("deviation    : max %.2f, mean %.3f steps\n", diff.dev_max, diff.dev_mean);
+    printf("final error  : %d, %d, %d\n",
+           diff.final_err[X_AXIS], diff.final_err[Y_AXIS], diff.final_err[Z_AXIS]);
+    printf("time error   : %+.6f s\n", (double) diff.time_err_ns / NS_PER_S);
+    if (diff.identical) {
+      printf("PASS: identical\n");
+    } else if ( (bound >= 0) && (diff.dev_max <= bound) &&
+                (abs(diff.final_err[0]) <= bound) && (abs(diff.final_err[1]) <= bound) &&
+                (abs(diff.final_err[2]) <= bound) ) {
+      printf("PASS: within %.2f steps\n", bound);
+    } else {
+      printf("FAIL\n");
+      status = 1;
+    }
+    trace_free(&ref_trace);
+  }
+  trace_free(&run_trace);
+
+  return status;
+}
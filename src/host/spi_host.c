@@ -0,0 +1,52 @@
+// File       : spi_host.c
+// Author     : Jeff Schornick
+//
+// SPI backend for the Linux host build. Jobs complete as soon as they are
+// queued, with rx[] supplied by spi_host_device if one is attached.
+//
+// Compilation: host GCC, see `make host`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include <string.h>
+#include "hal.h"
+#include "spi.h"
+
+void (*spi_host_device)(struct spi_job_s *job) = 0;
+
+void spi_init(void)
+{
+}
+
+uint8_t spi_send_byte(uint8_t byte)
+{
+  return 0;
+}
+
+uint8_t spi_queue_job(spi_job_t *job)
+{
+  spi_job_t done;
+
+  if ( (job->len == 0) || (job->len > SPI_JOB_MAX_LEN) ) {
+    return SPI_ERR;
+  }
+
+  done = *job;
+  memset(done.rx, 0, sizeof(done.rx));
+  if (spi_host_device) {
+    spi_host_device(&done);
+  }
+  if (done.callback) {
+    done.callback(&done);
+  }
+  return SPI_OK;
+}
+
+uint8_t spi_pending(void)
+{
+  return 0;
+}
+
+void spi_flush(void)
+{
+}
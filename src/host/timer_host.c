@@ -0,0 +1,269 @@
+// File       : timer_host.c
+// Author     : Jeff Schornick
+//
+// Timer backend for the Linux host build. The step (TA1) and coil (TA2)
+// timers are reduced to their period and interrupt enable; the simulator
+// (sim_main.c) advances them on its virtual clock and calls the handlers.
+// STEP_BACKEND_DMA's two DMA channels are emulated on the step timer.
+//
+// Compilation: host GCC, see `make host`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <time.h>
+#include "hal.h"
+#include "timer.h"
+#include "stepper.h"
+#include "gpio.h"
+#include "tmc.h"
+#include "coil.h"
+#include "profile.h"
+
+volatile uint32_t systick_ms = 0;
+
+volatile uint16_t timer_host_step_ccr = 0;
+volatile uint8_t timer_host_step_ie = 0;
+volatile uint16_t timer_host_coil_ccr = 0;
+volatile uint8_t timer_host_coil_ie = 0;
+
+void timer_init(void)
+{
+  timer_host_step_ccr = 500;  // as the target's initial period
+  timer_host_step_ie = 0;
+}
+
+void systick_init(void)
+{
+}
+
+// Wall clock at LOAD_TIMER_HZ
+uint32_t load_timer_ticks(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t) ((uint64_t) ts.tv_sec * LOAD_TIMER_HZ +
+                     (uint64_t) ts.tv_nsec * LOAD_TIMER_HZ / 1000000000ull);
+}
+
+void SysTick_Handler(void)
+{
+  systick_ms++;
+}
+
+volatile uint8_t timer_host_dma_on = 0;
+volatile uint8_t timer_host_dma_irq = 0;
+#if STEP_BACKEND == STEP_BACKEND_DMA
+static uint8_t dma_half, dma_frame;       // frame channel position
+static uint8_t dma_period_half;           // period channel position
+static uint8_t dma_period_next[2];
+static uint8_t dma_period_armed[2];
+#endif
+
+void step_timer_on(void)
+{
+  // as the target, a running stream starts the next block itself
+  if (!timer_host_dma_on) {
+    timer_host_step_ie = 1;
+  }
+}
+
+void step_timer_off(void)
+{
+  timer_host_step_ie = 0;
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+  timer_host_axis_ie[0] = timer_host_axis_ie[1] = timer_host_axis_ie[2] = 0;
+#endif
+#if STEP_BACKEND == STEP_BACKEND_DMA
+  if (timer_host_dma_on || timer_host_dma_irq) {
+    stepper_dma_abort(dma_half, dma_frame);
+  }
+  dma_period_armed[0] = dma_period_armed[1] = 0;
+#endif
+  timer_host_dma_on = 0;
+  timer_host_dma_irq = 0;
+}
+
+void step_timer_period(uint16_t period)
+{
+  timer_host_step_ccr = period;
+}
+
+volatile uint32_t step_timer_slips = 0;
+volatile uint8_t timer_host_step_armed = 0;
+
+// Function: step_timer_arm
+//
+// The target's compare outputs toggle at the tick itself; here the
+// simulator applies the armed toggles just before calling the handler,
+// see timer_host_step_match().
+void step_timer_arm(uint8_t code)
+{
+#if STEP_BACKEND == STEP_BACKEND_TIMER
+  timer_host_step_armed = code;
+#endif
+}
+
+void timer_host_step_match(void)
+{
+  uint8_t i;
+
+  for(i=0; i<3; i++) {
+    if ((timer_host_step_armed >> STEPPER_BIT(i)) & 1) {
+      gpio_toggle(tmc_pins[i].step_port, tmc_pins[i].step_pin);
+    }
+  }
+}
+
+uint64_t timer_host_aclk = 0;
+volatile uint64_t timer_host_axis_at[3];
+volatile uint8_t timer_host_axis_ie[3];
+static uint8_t timer_host_axis_step[3];
+
+void step_axis_next(uint8_t axis, uint16_t ticks, uint8_t step)
+{
+  timer_host_axis_at[axis] += ticks;
+  timer_host_axis_step[axis] = step;
+  timer_host_axis_ie[axis] = 1;
+}
+
+void step_axis_start(uint8_t axis, uint16_t ticks, uint8_t step)
+{
+  timer_host_axis_at[axis] = timer_host_aclk;
+  step_axis_next(axis, ticks, step);
+}
+
+void step_axis_stop(uint8_t axis)
+{
+  timer_host_axis_ie[axis] = 0;
+}
+
+// Function: timer_host_axis_match
+//
+// An axis' compare match: the output toggle, then the TA1_N handler's work
+void timer_host_axis_match(uint8_t axis)
+{
+  uint32_t start = hal_cycles();
+
+  if (timer_host_axis_step[axis]) {
+    gpio_toggle(tmc_pins[axis].step_port, tmc_pins[axis].step_pin);
+  }
+  timer_host_axis_ie[axis] = 0;
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+  stepper_axis_isr(axis);
+#endif
+
+  prof_isr(PROF_STEP, start, 0);
+}
+
+#if STEP_BACKEND == STEP_BACKEND_DMA
+
+void step_dma_frames(uint8_t half)
+{
+  dma_half = half;
+  dma_frame = 0;
+  timer_host_dma_on = 1;
+}
+
+void step_dma_periods(uint8_t half, uint8_t first)
+{
+  dma_period_next[half] = first;
+  dma_period_armed[half] = (first < stepper_half[half].frames);
+}
+
+void step_dma_start(uint16_t period)
+{
+  timer_host_step_ccr = period;
+  timer_host_step_ie = 0;
+  step_dma_periods(0, 1);
+  step_dma_periods(1, 0);
+  dma_period_half = dma_period_armed[0] ? 0 : 1;
+  step_dma_frames(0);
+}
+
+uint8_t step_dma_level(uint8_t axis)
+{
+  return gpio_get_output(tmc_pins[axis].step_port, tmc_pins[axis].step_pin) ? 1 : 0;
+}
+
+// Function: timer_host_dma_match
+//
+// A step timer wrap while streaming: the frame written at the CCR0 match,
+// then the next period loaded at the wrap. Sets timer_host_dma_irq when the
+// frame channel has finished a half, the simulator then records the edges
+// before calling DMA_INT3_IRQHandler().
+void timer_host_dma_match(void)
+{
+  stepper_half_t *h = &stepper_half[dma_half];
+  stepper_half_t *p = &stepper_half[dma_period_half];
+  uint8_t i;
+
+  if (!timer_host_dma_on) {
+    return;
+  }
+  for(i=0; i<3; i++) {
+    gpio_set(tmc_pins[i].step_port, tmc_pins[i].step_pin,
+             (h->out[dma_frame][i] & STEP_DMA_HIGH) ? 1 : 0);
+  }
+  if (++dma_frame == h->frames) {
+    timer_host_dma_on = 0;
+    timer_host_dma_irq = 1;
+  }
+
+  // ping-pong: a half is handed over once its last period is loaded
+  if (dma_period_armed[dma_period_half]) {
+    timer_host_step_ccr = p->period[dma_period_next[dma_period_half]++];
+    if (dma_period_next[dma_period_half] == p->frames) {
+      dma_period_armed[dma_period_half] = 0;
+      dma_period_half ^= 1;
+    }
+  }
+}
+
+void DMA_INT3_IRQHandler(void)
+{
+  uint32_t start = hal_cycles();
+
+  if (!timer_host_dma_irq) {
+    return;
+  }
+  timer_host_dma_irq = 0;
+  stepper_dma_isr(dma_half);
+
+  prof_isr(PROF_DMA, start, PROF_NO_LATENCY);
+}
+
+#endif
+
+void TA1_0_IRQHandler(void)
+{
+  uint32_t start = hal_cycles();
+
+  timer_host_step_ie = 0;
+  stepper_isr();
+
+  // called on time by the simulator
+  prof_isr(PROF_STEP, start, 0);
+}
+
+void coil_timer_init(uint16_t period)
+{
+  timer_host_coil_ccr = period;
+}
+
+void coil_timer_on(void)
+{
+  timer_host_coil_ie = 1;
+}
+
+void coil_timer_off(void)
+{
+  timer_host_coil_ie = 0;
+}
+
+void TA2_0_IRQHandler(void)
+{
+  coil_isr();
+}
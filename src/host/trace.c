@@ -0,0 +1,191 @@
+// File       : trace.c
+// Author     : Jeff Schornick
+//
+// Step traces for the host simulator: loading and comparison
+//
+// Compilation: host GCC, see `make host`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "trace.h"
+
+static const char *axis_names = "YZX";  // indexed by axis number, as motion.h
+
+void trace_init(trace_t *trace)
+{
+  trace->points = 0;
+  trace->count = 0;
+  trace->size = 0;
+}
+
+void trace_free(trace_t *trace)
+{
+  free(trace->points);
+  trace_init(trace);
+}
+
+void trace_add(trace_t *trace, uint64_t time_ns, volatile int32_t *pos)
+{
+  trace_point_t *p;
+
+  if (trace->count == trace->size) {
+    trace->size = trace->size ? 2 * trace->size : 4096;
+    trace->points = realloc(trace->points, trace->size * sizeof(trace_point_t));
+    if (!trace->points) {
+      perror("trace");
+      exit(2);
+    }
+  }
+  p = &trace->points[trace->count++];
+  p->time_ns = time_ns;
+  p->pos[0] = pos[0];
+  p->pos[1] = pos[1];
+  p->pos[2] = pos[2];
+}
+
+uint8_t trace_load_csv(const char *name, trace_t *trace)
+{
+  FILE *in;
+  char line[128];
+  char signal[16];
+  unsigned long long time_ns;
+  unsigned value;
+  int axis_pos;
+  int32_t pos[3] = {0, 0, 0};
+  const char *axis;
+
+  in = fopen(name, "r");
+  if (!in) {
+    perror(name);
+    return 0;
+  }
+  trace_init(trace);
+
+  while (fgets(line, sizeof(line), in)) {
+    if (sscanf(line, "%llu,%15[^,],%u,%d", &time_ns, signal, &value, &axis_pos) != 4) {
+      continue;  // header and DIR rows
+    }
+    axis = strchr(axis_names, signal[0]);
+    if (!axis || strcmp(signal + 1, "_STEP")) {
+      continue;
+    }
+    pos[axis - axis_names] = axis_pos;
+    trace_add(trace, time_ns, pos);
+  }
+  fclose(in);
+  return 1;
+}
+
+static double distance(trace_point_t *a, trace_point_t *b)
+{
+  double dx = a->pos[0] - b->pos[0];
+  double dy = a->pos[1] - b->pos[1];
+  double dz = a->pos[2] - b->pos[2];
+
+  return sqrt(dx*dx + dy*dy + dz*dz);
+}
+
+// First reference point in the band of run point i
+static int64_t band_start(trace_t *ref, trace_t *run, int64_t i)
+{
+  int64_t center = 0;
+
+  if (run->count > 1) {
+    center = i * (int64_t) (ref->count - 1) / (run->count - 1);
+  }
+  return center - TRACE_DIFF_BAND;
+}
+
+// Discrete Frechet distance, restricted to a band of TRACE_DIFF_BAND points
+// either side of the proportional diagonal, keeping one row of the coupling
+// table at a time. The mean is over the run's points, of the distance to
+// the closest reference point in the band.
+static void path_deviation(trace_t *ref, trace_t *run, trace_diff_t *diff)
+{
+  const int64_t width = 2 * TRACE_DIFF_BAND + 1;
+  double *prev, *row, *swap;
+  double d, best, reach, sum = 0;
+  int64_t i, j, k, lo, prev_lo = 0;
+
+  prev = malloc(width * sizeof(double));
+  row = malloc(width * sizeof(double));
+  if (!prev || !row) {
+    perror("trace");
+    exit(2);
+  }
+
+  for(i=0; i<run->count; i++) {
+    lo = band_start(ref, run, i);
+    best = HUGE_VAL;
+    for(k=0; k<width; k++) {
+      j = lo + k;
+      row[k] = HUGE_VAL;
+      if ( (j < 0) || (j >= ref->count) ) {
+        continue;
+      }
+      d = distance(&run->points[i], &ref->points[j]);
+      if (d < best) {
+        best = d;
+      }
+
+      // cheapest way to reach (i, j) from (i, j-1), (i-1, j), (i-1, j-1)
+      reach = ( (i == 0) && (j == 0) ) ? 0 : HUGE_VAL;
+      if ( (k > 0) && (row[k-1] < reach) ) {
+        reach = row[k-1];
+      }
+      if (i > 0) {
+        if ( (j - prev_lo >= 0) && (j - prev_lo < width) && (prev[j - prev_lo] < reach) ) {
+          reach = prev[j - prev_lo];
+        }
+        if ( (j - 1 - prev_lo >= 0) && (j - 1 - prev_lo < width) && (prev[j - 1 - prev_lo] < reach) ) {
+          reach = prev[j - 1 - prev_lo];
+        }
+      }
+      row[k] = (d > reach) ? d : reach;
+    }
+    sum += best;
+    prev_lo = lo;
+    swap = prev;
+    prev = row;
+    row = swap;
+  }
+
+  // the coupling ends on the last point of both paths
+  diff->dev_max = prev[(ref->count - 1) - prev_lo];
+  diff->dev_mean = sum / run->count;
+
+  free(prev);
+  free(row);
+}
+
+void trace_diff(trace_t *ref, trace_t *run, trace_diff_t *diff)
+{
+  static trace_point_t origin;
+  trace_point_t *ref_end = ref->count ? &ref->points[ref->count - 1] : &origin;
+  trace_point_t *run_end = run->count ? &run->points[run->count - 1] : &origin;
+  uint32_t n;
+  uint8_t i;
+
+  memset(diff, 0, sizeof(trace_diff_t));
+
+  diff->identical = (ref->count == run->count);
+  for(n=0; diff->identical && (n<ref->count); n++) {
+    diff->identical = (ref->points[n].time_ns == run->points[n].time_ns) &&
+      (ref->points[n].pos[0] == run->points[n].pos[0]) &&
+      (ref->points[n].pos[1] == run->points[n].pos[1]) &&
+      (ref->points[n].pos[2] == run->points[n].pos[2]);
+  }
+
+  if (ref->count && run->count) {
+    path_deviation(ref, run, diff);
+  }
+
+  for(i=0; i<3; i++) {
+    diff->final_err[i] = run_end->pos[i] - ref_end->pos[i];
+  }
+  diff->time_err_ns = (int64_t) run_end->time_ns - (int64_t) ref_end->time_ns;
+}
@@ -0,0 +1,122 @@
+// File       : uart_host.c
+// Author     : Jeff Schornick
+//
+// UART backend for the Linux host build. Output is drained immediately,
+// to stdout when uart_host_echo is set.
+//
+// With uart_host_paced set, the EUSCI_A0 flags and buffers are emulated
+// instead and characters move only when the simulator calls
+// uart_host_receive() and uart_host_tx_done() at the baud rate.
+// EUSCIA0_IRQHandler mirrors the target's handler in uart.c.
+//
+// Compilation: host GCC, see `make host`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include <stdio.h>
+#include "hal.h"
+#include "fifo.h"
+#include "uart.h"
+#include "profile.h"
+
+fifo_t rx_fifo;
+fifo_t tx_fifo;
+
+uint8_t uart_host_echo = 0;
+uint8_t uart_host_paced = 0;
+
+// Emulated EUSCI_A0 registers
+volatile uint8_t uart_host_ifg;
+volatile uint8_t uart_host_ie;
+static volatile char uart_host_rxbuf;
+static volatile char uart_host_txbuf;
+
+void uart_init(void)
+{
+  uart_host_ifg = UART_HOST_TXIFG;
+  uart_host_ie = UART_HOST_RXIE;
+
+  fifo_init(&rx_fifo, UART_FIFO_SIZE);
+  fifo_init(&tx_fifo, UART_FIFO_SIZE);
+}
+
+void uart_putc(char c)
+{
+  if (uart_host_echo && (c != '\r')) {
+    putchar(c);
+  }
+}
+
+static void uart_host_write(char c)
+{
+  uart_host_txbuf = c;
+  uart_host_ifg &= ~UART_HOST_TXIFG;
+}
+
+void uart_prime_tx(void)
+{
+  char c;
+
+  if (!uart_host_paced) {
+    while (fifo_pop(&tx_fifo, &c) == FIFO_OK) {
+      uart_putc(c);
+    }
+    return;
+  }
+
+  if (tx_fifo.count && (uart_host_ifg & UART_HOST_TXIFG)) {
+    fifo_pop(&tx_fifo, &c);
+    uart_host_write(c);
+  }
+  uart_host_ie |= UART_HOST_TXIE | UART_HOST_RXIE;
+}
+
+void EUSCIA0_IRQHandler(void)
+{
+  uint32_t start = hal_cycles();
+  uint8_t flags = uart_host_ifg;
+  char val;
+
+  // Received a byte
+  if (flags & UART_HOST_RXIFG) {
+    uart_host_ifg &= ~UART_HOST_RXIFG;
+    fifo_push(&rx_fifo, uart_host_rxbuf);
+  }
+
+  // Clear to send
+  if (flags & UART_HOST_TXIFG) {
+    if(tx_fifo.count) {
+      fifo_pop(&tx_fifo, &val);
+      uart_host_write(val);
+    } else {
+      uart_host_ie &= ~UART_HOST_TXIE;
+    }
+  }
+
+  prof_isr(PROF_UART, start, PROF_NO_LATENCY);
+}
+
+// Function: uart_host_receive
+//
+// A character has arrived on RX
+void uart_host_receive(char c)
+{
+  uart_host_rxbuf = c;
+  uart_host_ifg |= UART_HOST_RXIFG;
+  if (uart_host_ie & UART_HOST_RXIE) {
+    EUSCIA0_IRQHandler();
+  }
+}
+
+// Function: uart_host_tx_done
+//
+// The character in TXBUF has been shifted out. The emulated transmitter is
+// single buffered, TXIFG returns one character time after each write.
+void uart_host_tx_done(void)
+{
+  uart_putc(uart_host_txbuf);
+  uart_host_ifg |= UART_HOST_TXIFG;
+  if (uart_host_ie & UART_HOST_TXIE) {
+    EUSCIA0_IRQHandler();
+  }
+}
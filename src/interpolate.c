@@ -13,22 +13,172 @@
 #include <string.h>  // memset
 #include <math.h>  // sqrtl
 #include "uart.h"
+#include "log.h"
 #include "tmc.h"
+#include "timer.h"
 #include "motion.h"
+#include "stepper.h"
 
-void rapid_interpolate(int32_t *start_pos, int32_t *end_pos, motion_t *motion)
+// Entries a step table first grows to
+#define STEP_TABLE_MIN 16
+
+// Fold repeated steps into one entry, cleared to build plain tables
+uint8_t interp_rle = 1;
+
+// Function: step_append
+//
+// Appends a step of `code` after `ticks` to a step table of `n` entries,
+// growing it as needed. A step with the same period and step_data as the
+// previous entry just repeats it, so uniform stretches take one entry per
+// STEP_REPEAT_MAX + 1 steps, unless interp_rle is 0. Returns the new entry
+// count.
+static uint32_t step_append(step_timing_t **s, uint32_t *size, uint32_t n, uint16_t ticks, uint8_t code)
+{
+  step_timing_t *e;
+
+  if (interp_rle && n && !(code & STEPPER_FLIP_BITS)) {
+    e = &(*s)[n-1];
+    if ( (e->timer_ticks == ticks) && (e->step_data == code) && (e->repeat < STEP_REPEAT_MAX) ) {
+      e->repeat++;
+      return n;
+    }
+  }
+  if (n == *size) {
+    *size = *size ? (*size * 2) : STEP_TABLE_MIN;
+    *s = realloc(*s, sizeof(step_timing_t) * *size);
+  }
+  e = &(*s)[n];
+  e->timer_ticks = ticks;
+  e->step_data = code;
+  e->repeat = 0;
+  return n + 1;
+}
+
+// Releases a step table's unused entries
+static step_timing_t *step_trim(step_timing_t *s, uint32_t n)
+{
+  return n ? realloc(s, sizeof(step_timing_t) * n) : s;
+}
+
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+
+// Longest interval a single axis stream entry holds
+#define AXIS_MAX_TICKS 0xffff
+
+// Appends an interval ending with `code` to an axis stream, preceded by
+// step-less waits while it is too long for one entry. Returns the next
+// free index.
+static uint32_t axis_append(step_timing_t **s, uint32_t *size, uint32_t i, uint32_t ticks, uint8_t code)
+{
+  while (ticks > AXIS_MAX_TICKS) {
+    i = step_append(s, size, i, AXIS_MAX_TICKS, 0);
+    ticks -= AXIS_MAX_TICKS;
+  }
+  return step_append(s, size, i, ticks, code);
+}
+
+// Function: axis_even
+//
+// Builds an axis stream of `n` steps spread evenly over `ticks`: step k
+// falls on tick round(k*ticks/n), so the only rounding is against the
+// axis' own ideal times and the last step lands on the final tick. The
+// block is stretched to the last step if it runs past motion->ticks.
+static void axis_even(motion_t *motion, uint8_t axis, uint32_t n, uint32_t ticks)
+{
+  step_timing_t *s = 0;
+  uint32_t size = 0;
+  uint32_t k, t;
+  uint32_t prev = 0;
+  uint32_t i = 0;
+
+  motion->axis_steps[axis] = 0;
+  motion->axis_count[axis] = 0;
+  if (!n) {
+    return;
+  }
+  for(k=1; k<=n; k++) {
+    t = ((uint64_t) k * ticks + n/2) / n;
+    if (t <= prev) {
+      t = prev + 1;  // faster than the step timer, one tick apart
+    }
+    i = axis_append(&s, &size, i, t - prev, 1 << STEPPER_BIT(axis));
+    prev = t;
+  }
+  motion->axis_steps[axis] = step_trim(s, i);
+  motion->axis_count[axis] = i;
+  motion->count += i;
+  if (prev > motion->ticks) {
+    motion->ticks = prev;
+  }
+}
+
+// Function: axis_split
+//
+// Converts a merged step table into per-axis streams with the same edge
+// times as the merged schedule, for interpolators that couple the axes
+// step by step (arcs). Frees the merged table.
+static void axis_split(motion_t *motion)
+{
+  step_timing_t *steps = motion->steps;
+  uint32_t size[3] = {0, 0, 0};
+  uint32_t last[3] = {0, 0, 0};
+  uint32_t t, i, k;
+  uint8_t axis, code;
+
+  for(axis=0; axis<3; axis++) {
+    motion->axis_steps[axis] = 0;
+    motion->axis_count[axis] = 0;
+  }
+
+  // as the step ISR: each step ends its own period
+  t = 0;
+  for(i=0; i<motion->count; i++) {
+    for(k=0; k<=steps[i].repeat; k++) {
+      t += steps[i].timer_ticks + 1;
+      for(axis=0; axis<3; axis++) {
+        code = steps[i].step_data & (3 << STEPPER_BIT(axis));
+        if (code) {
+          motion->axis_count[axis] = axis_append(&motion->axis_steps[axis], &size[axis],
+                                                 motion->axis_count[axis], t - last[axis], code);
+          last[axis] = t;
+        }
+      }
+    }
+  }
+  for(axis=0; axis<3; axis++) {
+    motion->axis_steps[axis] = step_trim(motion->axis_steps[axis], motion->axis_count[axis]);
+  }
+
+  motion->ticks = t ? t : 1;
+  motion->count = motion->axis_count[0] + motion->axis_count[1] + motion->axis_count[2];
+  free(motion->steps);
+  motion->steps = 0;
+}
+
+#endif
+
+// Adaptive multi-axis step smoothing (AMASS) for rapids: the DDA runs at
+// 2^level subticks per step of the longest axis, so a shorter axis' steps
+// fall between its steps instead of on them. The level is picked per block
+// from the step period, up to AMASS_MAX_LEVEL while a subtick still spans
+// a whole timer tick.
+#define AMASS_MAX_LEVEL 3
+
+void rapid_interpolate(int32_t *start_pos, int32_t *end_pos, uint32_t rate, motion_t *motion)
 {
   int32_t dx = end_pos[X_AXIS] - start_pos[X_AXIS];
   int32_t dy = end_pos[Y_AXIS] - start_pos[Y_AXIS];
   int32_t dz = end_pos[Z_AXIS] - start_pos[Z_AXIS];
-  uart_queue_str("\r\nRapid interpolate:\r\n");
-  uart_queue_str("  (dx, dy, dz) = (");
-  uart_queue_sdec(dx);
-  uart_queue_str(", ");
-  uart_queue_sdec(dy);
-  uart_queue_str(", ");
-  uart_queue_sdec(dz);
-  uart_queue_str(")\r\n");
+  if (LOG_ON(LOG_DEBUG)) {
+    uart_queue_str("\r\nRapid interpolate:\r\n");
+    uart_queue_str("  (dx, dy, dz) = (");
+    uart_queue_sdec(dx);
+    uart_queue_str(", ");
+    uart_queue_sdec(dy);
+    uart_queue_str(", ");
+    uart_queue_sdec(dz);
+    uart_queue_str(")\r\n");
+  }
 
   // determine direction for each axis
   motion->dirs[X_AXIS] = (dx>0) ? TMC_FWD : TMC_REV;
@@ -39,58 +189,118 @@ void rapid_interpolate(int32_t *start_pos, int32_t *end_pos, motion_t *motion)
   dy = abs(dy);
   dz = abs(dz);
 
-  uint32_t longest = (dx > dy) ?  ((dx > dz) ? dx : dz)  :  ((dy > dz) ? dy : dz);
-  motion->steps = malloc( sizeof(step_timing_t) * longest);
-  step_timing_t *steps = motion->steps;
-
   // stepper timer hits about every 30.5 us, calculate timer ticks per step at rapid rate
   // (1s * 1e6  / rate) / (30.5us)
-  uint32_t step_ticks = (2000000 / rapid_rate) / 61;
-
-  for( uint32_t i=0; i<longest; i++ ) {
-    steps[i].x = (i < dx) ? 1 : 0;
-    steps[i].y = (i < dy) ? 1 : 0;
-    steps[i].z = (i < dz) ? 1 : 0;
-    steps[i].x_flip = 0;
-    steps[i].y_flip = 0;
-    steps[i].z_flip = 0;
-    steps[i].timer_ticks = step_ticks;
+  uint32_t step_ticks = (2000000 / rate) / 61;
+
+  uint32_t longest = (dx > dy) ?  ((dx > dz) ? dx : dz)  :  ((dy > dz) ? dy : dz);
+
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+  // the longest axis at the rapid rate, the others spread over its time
+  motion->steps = 0;
+  motion->count = 0;
+  motion->ticks = 1;
+  axis_even(motion, X_AXIS, dx, longest * (step_ticks + 1));
+  axis_even(motion, Y_AXIS, dy, longest * (step_ticks + 1));
+  axis_even(motion, Z_AXIS, dz, longest * (step_ticks + 1));
+  return;
+#endif
+
+  uint32_t d[3];
+  uint32_t acc[3] = {0, 0, 0};
+  uint32_t period = step_ticks + 1;  // timer ticks per step of the longest axis
+  uint8_t level = 0;
+
+  d[X_AXIS] = dx;
+  d[Y_AXIS] = dy;
+  d[Z_AXIS] = dz;
+
+  // AMASS level: as many subticks as fit whole timer ticks
+  while ( (level < AMASS_MAX_LEVEL) && ((period >> (level + 1)) > 0) ) {
+    level++;
   }
-  motion->count = longest;
+
+  step_timing_t *steps = 0;
+  uint32_t size = 0;
+  uint32_t n = longest << level;
+  uint32_t i = 0;
+  uint32_t last = 0;     // tick of the last entry
+  uint32_t at = 0;       // tick of the steps not yet in the table
+  uint8_t pending = 0;
+  uint32_t j, t;
+  uint8_t a, code;
+
+  for( j=1; j<=n; j++ ) {
+    code = 0;
+    for( a=0; a<3; a++ ) {
+      acc[a] += d[a];
+      if (acc[a] >= n) {
+        acc[a] -= n;
+        code |= 1 << STEPPER_BIT(a);
+      }
+    }
+    if (!code) {
+      continue;
+    }
+
+    // subticks without a step only lengthen the next entry, steps on the
+    // same tick share one
+    t = ((uint64_t) j * period) >> level;
+    if (pending && (t != at)) {
+      i = step_append(&steps, &size, i, at - last - 1, pending);
+      last = at;
+      pending = 0;
+    }
+    at = t;
+    pending |= code;
+  }
+  if (pending) {
+    i = step_append(&steps, &size, i, at - last - 1, pending);
+  }
+  motion->steps = step_trim(steps, i);
+  motion->count = i;
 }
 
+// Longest period of a linear step table entry, longer gaps get step-less waits
+#define LINEAR_MAX_TICKS 0x10000
+
 // rate is in steps/s ??
 void linear_interpolate(int32_t *start_pos, int32_t *end_pos, uint16_t rate, motion_t *motion)
 {
   int32_t dx = end_pos[X_AXIS] - start_pos[X_AXIS];
   int32_t dy = end_pos[Y_AXIS] - start_pos[Y_AXIS];
   int32_t dz = end_pos[Z_AXIS] - start_pos[Z_AXIS];
-  int32_t d = sqrtl(dx*dx + dy*dy + dz*dz);
-
-  uart_queue_str("\r\nLinear interpolate:");
-  uart_queue_str("\r\n  step/s = ");
-  uart_queue_dec(rate);
-  uart_queue_str("\r\n");
-  uart_queue_str("  (dx, dy, dz) = (");
-  uart_queue_sdec(dx);
-  uart_queue_str(", ");
-  uart_queue_sdec(dy);
-  uart_queue_str(", ");
-  uart_queue_sdec(dz);
-  uart_queue_str(") = ");
-  uart_queue_dec(d);
-
-  uint32_t t_us = (1000000/rate) * d;    // move time in us
-  uart_queue_str("\r\n  move time =  ");
-  uart_queue_dec(t_us);
-  uart_queue_str(" us\r\n");
+  int32_t d = sqrtl((int64_t) dx*dx + (int64_t) dy*dy + (int64_t) dz*dz);
+
+  uint32_t t_us = ((uint64_t) 1000000 * d) / rate;    // move time in us
+  uint32_t ticks = ((uint64_t) STEP_TIMER_HZ * d + rate / 2) / rate;  // in step timer ticks
+
+  if (LOG_ON(LOG_DEBUG)) {
+    uart_queue_str("\r\nLinear interpolate:");
+    uart_queue_str("\r\n  step/s = ");
+    uart_queue_dec(rate);
+    uart_queue_str("\r\n");
+    uart_queue_str("  (dx, dy, dz) = (");
+    uart_queue_sdec(dx);
+    uart_queue_str(", ");
+    uart_queue_sdec(dy);
+    uart_queue_str(", ");
+    uart_queue_sdec(dz);
+    uart_queue_str(") = ");
+    uart_queue_dec(d);
+    uart_queue_str("\r\n  move time =  ");
+    uart_queue_dec(t_us);
+    uart_queue_str(" us\r\n");
+  }
 
   uint32_t max_x = (t_us * MAX_RATE)/1000000 + 1;
   uint32_t max_y = (t_us * MAX_RATE)/1000000 + 1;
   uint32_t max_z = (t_us * MAX_RATE)/1000000 + 1;
 
   if ((abs(dx) > max_x) || (abs(dy) > max_y) || (abs(dz) > max_z)) {
-    uart_queue_str("  WARNING: Motion interpolates above max rate!\r\n");
+    if (LOG_ON(LOG_WARN)) {
+      uart_queue_str("  WARNING: Motion interpolates above max rate!\r\n");
+    }
   }
 
   // determine direction for each axis
@@ -107,81 +317,97 @@ void linear_interpolate(int32_t *start_pos, int32_t *end_pos, uint16_t rate, mot
   uint32_t y_dt = dy ? (t_us / dy) : -1;
   uint32_t z_dt = dz ? (t_us / dz) : -1;
 
-  uart_queue_str("  dt = (");
-  uart_queue_dec(x_dt);
-  uart_queue_str(", ");
-  uart_queue_dec(y_dt);
-  uart_queue_str(", ");
-  uart_queue_dec(z_dt);
-  uart_queue_str(") us\r\n");
-
-  // Interpolate
-
-  uint32_t next_x = x_dt;
-  uint32_t next_y = y_dt;
-  uint32_t next_z = z_dt;
+  if (LOG_ON(LOG_DEBUG)) {
+    uart_queue_str("  dt = (");
+    uart_queue_dec(x_dt);
+    uart_queue_str(", ");
+    uart_queue_dec(y_dt);
+    uart_queue_str(", ");
+    uart_queue_dec(z_dt);
+    uart_queue_str(") us\r\n");
+  }
 
-  motion->steps = malloc( sizeof(step_timing_t) * (dx+dy+dz) );  // worst case, no simultaneous steps
-  step_timing_t *steps = motion->steps;
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+  // every axis spread over the whole move time on its own channel
+  motion->steps = 0;
+  motion->count = 0;
+  motion->ticks = ticks;
+  if (!motion->ticks) {
+    motion->ticks = 1;
+  }
+  axis_even(motion, X_AXIS, dx, motion->ticks);
+  axis_even(motion, Y_AXIS, dy, motion->ticks);
+  axis_even(motion, Z_AXIS, dz, motion->ticks);
+  return;
+#endif
+
+  // Interpolate: step k of an axis' n falls on tick round(k*ticks/n). Each
+  // axis keeps its next step as whole ticks plus a remainder in 1/n ticks,
+  // so no rounding carries over and the last step lands on the final tick.
+
+  uint32_t n[3], left[3];
+  uint32_t whole[3], frac[3];  // ticks/n as whole ticks and remainder
+  uint32_t at[3], rem[3];      // next step's tick, remainder with n/2 for rounding
+  uint8_t a, code;
+
+  n[X_AXIS] = dx;
+  n[Y_AXIS] = dy;
+  n[Z_AXIS] = dz;
+  for(a=0; a<3; a++) {
+    left[a] = n[a];
+    if (n[a]) {
+      whole[a] = ticks / n[a];
+      frac[a] = ticks % n[a];
+      at[a] = whole[a];
+      rem[a] = n[a] / 2 + frac[a];
+      if (rem[a] >= n[a]) {
+        rem[a] -= n[a];
+        at[a]++;
+      }
+    }
+  }
 
+  step_timing_t *steps = 0;
+  uint32_t size = 0;
   uint32_t i = 0;
-  uint32_t t = 0;
+  uint32_t t;
+  uint32_t last = 0;
 
-  uint32_t skip_ticks;
-  while( (dx>0) || (dy>0) || (dz>0) ) {
+  while( left[X_AXIS] || left[Y_AXIS] || left[Z_AXIS] ) {
 
     // see which axis steps soonest
-    if (next_x < next_y) {
-      // x or z
-      if (next_x < next_z) {
-        skip_ticks = (next_x - t) * 2 / 61 + 1;  // 61 us every 2 ticks
-      } else {
-        skip_ticks = (next_z - t) * 2 / 61 + 1;
+    t = UINT32_MAX;
+    for(a=0; a<3; a++) {
+      if (left[a] && (at[a] < t)) {
+        t = at[a];
       }
-    } else {
-      // y or z
-      if (next_y < next_z) {
-        skip_ticks = (next_y - t) * 2 / 61 + 1;
-      } else {
-        skip_ticks = (next_z - t) * 2 / 61 + 1;
-      }
-    }
-
-    // default to no step
-    steps[i].x = 0;
-    steps[i].y = 0;
-    steps[i].z = 0;
-    steps[i].x_flip = 0;
-    steps[i].y_flip = 0;
-    steps[i].z_flip = 0;
-
-    t += (61*skip_ticks) / 2;  // skip ahead ticks, 30.5us each
-    /* uart_queue_str("t = "); */
-    /* uart_queue_dec(t); */
-    steps[i].timer_ticks = skip_ticks;
-    if (t >= next_x) {
-      /* uart_queue_str(" X "); */
-      steps[i].x = 1;
-      next_x += x_dt;
-      dx--;
     }
-    if (t >= next_y) {
-      /* uart_queue_str("  Y"); */
-      steps[i].y = 1;
-      next_y += y_dt;
-      dy--;
+    if (t <= last) {
+      t = last + 1;  // faster than the step timer, one tick apart
     }
-    if (t >= next_z) {
-      /* uart_queue_str("  Y"); */
-      steps[i].z = 1;
-      next_z += z_dt;
-      dz--;
+    while (t - last > LINEAR_MAX_TICKS) {
+      i = step_append(&steps, &size, i, LINEAR_MAX_TICKS - 1, 0);
+      last += LINEAR_MAX_TICKS;
     }
-    /* uart_queue_str("\r\n"); */
 
-    i++;
+    code = 0;
+    for(a=0; a<3; a++) {
+      if (left[a] && (at[a] <= t)) {
+        code |= 1 << STEPPER_BIT(a);
+        left[a]--;
+        at[a] += whole[a];
+        rem[a] += frac[a];
+        if (rem[a] >= n[a]) {
+          rem[a] -= n[a];
+          at[a]++;
+        }
+      }
+    }
+    i = step_append(&steps, &size, i, t - last - 1, code);
+    last = t;
   }
 
+  motion->steps = step_trim(steps, i);
   motion->count = i;
 
   /* uart_queue_str("\r\n----\r\n"); */
@@ -202,289 +428,161 @@ void linear_interpolate(int32_t *start_pos, int32_t *end_pos, uint16_t rate, mot
 }
 
 
-//
-void arc_interpolate(int32_t *start_pos, int32_t *end_pos, int32_t x_off, int32_t y_off, int8_t rot, uint16_t rate, motion_t *motion)
+// Arc step table under construction. An entry is held back until the next
+// step is known, so a reversal can set its axis' flip bit.
+typedef struct {
+  step_timing_t *steps;
+  uint32_t size;
+  uint32_t n;
+  uint16_t ticks;     // period of every entry
+  uint8_t held;       // step_data of the entry held back, if any
+  uint8_t holding;
+  int8_t dir[2];      // current X and Y direction, 0 before the first step
+} arc_table_t;
+
+// Adds a step of (sx, sy), each -1, 0 or 1
+static void arc_step(arc_table_t *a, int8_t sx, int8_t sy, motion_t *motion)
 {
-
-  int32_t dx = end_pos[X_AXIS] - start_pos[X_AXIS];
-  int32_t dy = end_pos[Y_AXIS] - start_pos[Y_AXIS];
-
-  int32_t r = sqrtl(x_off*x_off + y_off*y_off);
-
-  int32_t x0 = x_off;
-  int32_t y0 = y_off;
-
-  uart_queue_str("\r\nArc interpolate:");
-  uart_queue_str("\r\n  step/s = ");
-  uart_queue_dec(rate);
-  uart_queue_str("\r\n");
-  uart_queue_str("  (dx, dy) = (");
-  uart_queue_sdec(dx);
-  uart_queue_str(", ");
-  uart_queue_sdec(dy);
-  uart_queue_str(")\r\n");
-
-  uart_queue_str("  (x0, y0) = (");
-  uart_queue_sdec(x0);
-  uart_queue_str(", ");
-  uart_queue_sdec(y0);
-  uart_queue_str(")\r\n");
-  uart_queue_str("  rot = ");
-  uart_queue_sdec(rot);
-
-  uart_queue_str("  r = ");
-  uart_queue_dec(r);
-  uart_queue_str("\r\n");
-
-
-  // counter clockwise arc with x_off<0, y_off=0
-  //    arc goes up and left
-
-  int8_t start_oct, end_oct;
-
-  int32_t end_x_off = x_off - dx;
-  int32_t end_y_off = y_off - dy;
-
-  if (x_off < 0) {
-    if (y_off < 0) {
-      start_oct = (abs(x_off) < abs(y_off)) ? 1 : 0;
-    } else {
-      start_oct = (abs(x_off) < abs(y_off)) ? 6 : 7;
+  int8_t s[2] = {sx, sy};
+  uint8_t axis[2] = {X_AXIS, Y_AXIS};
+  uint8_t code = 0;
+  uint8_t k;
+
+  for(k=0; k<2; k++) {
+    if (!s[k]) {
+      continue;
     }
-  } else {
-    if (y_off < 0) {
-      start_oct = (abs(x_off) < abs(y_off)) ? 2 : 3;
-    } else {
-      start_oct = (abs(x_off) < abs(y_off)) ? 5 : 4;
+    if (!a->dir[k]) {
+      motion->dirs[axis[k]] = (s[k] > 0) ? TMC_FWD : TMC_REV;
+    } else if (s[k] != a->dir[k]) {
+      a->held |= 1 << (STEPPER_BIT(axis[k]) + 1);  // reverse after the held step
     }
+    a->dir[k] = s[k];
+    code |= 1 << STEPPER_BIT(axis[k]);
   }
-
-  if (end_x_off < 0) {
-    if (end_y_off < 0) {
-      end_oct = (abs(end_x_off) < abs(end_y_off)) ? 1 : 0;
-    } else {
-      end_oct = (abs(end_x_off) < abs(end_y_off)) ? 6 : 7;
-    }
-  } else {
-    if (end_y_off < 0) {
-      end_oct = (abs(end_x_off) < abs(end_y_off)) ? 2 : 3;
-    } else {
-      end_oct = (abs(end_x_off) < abs(end_y_off)) ? 5 : 4;
-    }
+  if (a->holding) {
+    a->n = step_append(&a->steps, &a->size, a->n, a->ticks, a->held);
   }
-  uint8_t octants = ( (rot == 1)
-                      ? (8 + end_oct - start_oct) % 8 + 1
-                      : (8 + start_oct - end_oct) % 8 + 1 );
-
-  uart_queue_str("\r\n  S_oct: ");
-  uart_queue_sdec(start_oct);
-  uart_queue_str("\r\n  E_oct: ");
-  uart_queue_sdec(end_oct);
-  uart_queue_str("\r\n  Octs = ");
-  uart_queue_dec(octants);
-  uart_queue_str("\r\n");
-
-  int8_t oct2maj_axis[] = {'Y', 'X', 'X', 'Y', 'Y', 'X', 'X', 'Y'};
-  int8_t oct2min_axis[] = {'X', 'Y', 'Y', 'X', 'X', 'Y', 'Y', 'X'};
-
-  // G2 (CW)
-  /* int8_t oct2maj_pol[] = {-1, 1, 1, 1, 1, -1, -1, -1}; */
-  /* int8_t oct2min_pol[] = {1, -1, 1, 1, -1, 1, -1, -1}; */
-
-  // G3 (CCW)
-  int8_t oct2maj_pol[] = {1, -1, -1, -1, -1, 1, 1, 1};
-  int8_t oct2min_pol[] = {-1, 1, -1, -1, 1, -1, 1, 1};
-
-  // TODO: this should either vary during motion, or at least be based on arc length
-  uint32_t step_ticks = (2000000 / rate) / 61;
-
-  //motion->steps = malloc( sizeof(step_timing_t) * (abs(dx)+abs(dy)) );  // worst case
-  motion->steps = malloc( sizeof(step_timing_t) * 8*r );
-  memset(motion->steps, 0, sizeof(step_timing_t) * 8*r);
-
-  step_timing_t *steps = motion->steps;
-  uint32_t i = 0;
+  a->held = code;
+  a->holding = 1;
+}
 
+static int8_t arc_sign(int64_t v)
+{
+  return (v > 0) - (v < 0);
+}
 
-  uart_flush();
+// Distance of (x, y) from the circle of squared radius r2, in the units
+// the midpoint test compares
+static int64_t arc_err(int64_t x, int64_t y, int64_t r2)
+{
+  int64_t e = x*x + y*y - r2;
+  return (e < 0) ? -e : e;
+}
 
-  char maj_axis = oct2maj_axis[start_oct];   // axis with a larger delta across the octant
-  char min_axis;
-  int8_t maj_pol = rot * oct2maj_pol[start_oct];  // CCW --> increasing octants
-  int8_t min_pol = rot * oct2min_pol[start_oct];
-  /* char maj_axis = 'Y'; // axis that changes every */
-  /* int8_t maj_pol = 1; */
-  /* int8_t min_pol = -1; */
+// Function: arc_interpolate
+//
+// Steps the arc from start_pos to end_pos around the center at (x_off,
+// y_off) from the start, counter clockwise for rot = 1 (G03) and clockwise
+// for rot = -1 (G02). An end equal to the start is a full circle.
+//
+// Each step moves the axis running faster along the tangent, plus the other
+// axis when that keeps x^2 + y^2 closer to r^2, so any octant and any
+// number of them are traced alike. Tracing stops once the ray to the end
+// point is crossed and the last few steps go straight to the end, which
+// need not lie exactly on the stepped circle.
+void arc_interpolate(int32_t *start_pos, int32_t *end_pos, int32_t x_off, int32_t y_off, int8_t rot, uint16_t rate, motion_t *motion)
+{
+  int32_t dx = end_pos[X_AXIS] - start_pos[X_AXIS];
+  int32_t dy = end_pos[Y_AXIS] - start_pos[Y_AXIS];
 
-  // starting direction for motion based on octant and rotation direction
-  if (maj_axis == 'X') {
-    motion->dirs[X_AXIS] = (maj_pol == 1) ? TMC_FWD : TMC_REV;
-    motion->dirs[Y_AXIS] = (min_pol == 1) ? TMC_FWD : TMC_REV;
-  } else {
-    motion->dirs[Y_AXIS] = (maj_pol == 1) ? TMC_FWD : TMC_REV;
-    motion->dirs[X_AXIS] = (min_pol == 1) ? TMC_FWD : TMC_REV;
+  // positions relative to the center
+  int64_t x = -(int64_t) x_off;
+  int64_t y = -(int64_t) y_off;
+  int64_t ex = (int64_t) dx - x_off;
+  int64_t ey = (int64_t) dy - y_off;
+  int64_t r2 = x*x + y*y;
+  int64_t tx, ty, cross, last_cross;
+  uint64_t limit;
+  int8_t sx, sy, m;
+  arc_table_t a;
+
+  if (LOG_ON(LOG_DEBUG)) {
+    uart_queue_str("\r\nArc interpolate:");
+    uart_queue_str("\r\n  step/s = ");
+    uart_queue_dec(rate);
+    uart_queue_str("\r\n");
+    uart_queue_str("  (dx, dy) = (");
+    uart_queue_sdec(dx);
+    uart_queue_str(", ");
+    uart_queue_sdec(dy);
+    uart_queue_str(")\r\n");
+
+    uart_queue_str("  (x0, y0) = (");
+    uart_queue_sdec(x_off);
+    uart_queue_str(", ");
+    uart_queue_sdec(y_off);
+    uart_queue_str(")\r\n");
+    uart_queue_str("  rot = ");
+    uart_queue_sdec(rot);
+    uart_queue_str("\r\n");
   }
 
-
-  //for( uint8_t octant = 0; octant<8; octant++ ) {
-  for( uint8_t oct_i = 0; oct_i < octants; oct_i++) {
-    uint8_t octant = (8+start_oct + (rot*oct_i)) % 8;
-
-    maj_axis = oct2maj_axis[octant];
-    min_axis = oct2min_axis[octant];
-    maj_pol = rot * oct2maj_pol[octant];
-    min_pol = rot * oct2min_pol[octant];
-
-    int32_t min_pos = r - 1;
-    int32_t maj_pos = 0;
-    int32_t maj_err_mod = 1;
-    int32_t min_err_mod = 1;
-    int32_t err = 1 - (2*r);
-    int8_t do_min_step;
-
-    uart_queue_str("Octant: "); uart_queue_dec(octant); uart_queue_str(" Maj: "); uart_queue(maj_axis);
-    uart_queue_str(" Pols: "); uart_queue_sdec(maj_pol); uart_queue_str(", "); uart_queue_sdec(min_pol); uart_queue_str("\r\n");
-
-    // r- minor >= major
-    while (min_pos >= maj_pos) {
-      steps[i].timer_ticks = step_ticks;
-
-      /* uart_queue_dec(i); uart_queue_str(": ("); uart_queue_dec(maj_steps); uart_queue_str(", "); uart_queue_dec(min_steps); uart_queue_str(") "); */
-      uart_queue_str("Pt: ");
-      if (maj_axis == 'X') {
-        uart_queue_sdec(maj_pos); uart_queue_str(", "); uart_queue_sdec(min_pos);
-      } else {
-        uart_queue_sdec(min_pos); uart_queue_str(", "); uart_queue_sdec(maj_pos);
-      }
-      uart_queue_str("\r\n");
-
-      // determine if we should step the major (fast changing) axis
-      if (err <= 0) {
-        /* uart_queue_sdec(maj_pol); */
-        if (maj_axis == 'X') {
-          steps[i].x = 1;
-          /* uart_queue_str("X "); */
-        } else {
-          steps[i].y = 1;
-          /* uart_queue_str("Y "); */
-        }
-
-        maj_pos++;
-        err += maj_err_mod;
-        maj_err_mod +=2;
-      }
-
-      // determine if we should step the minor access
-      do_min_step = 0;
-      if (err > 0) {
-        do_min_step = 1;
-        min_pos--;
-        min_err_mod += 2;
-        err += min_err_mod - (2*r);
-      }
-
-      // adjacent quadrants have mirrored minor axis step rates
-      if ( (octant % 2) == (rot == -1)) { // normal behavior
-        if (do_min_step) {
-          /* uart_queue_sdec(min_pol); */
-          if (min_axis == 'Y') {
-            steps[i].y = 1;
-            /* uart_queue_str("Y"); */
-          } else {
-            steps[i].x = 1;
-            /* uart_queue_str("X"); */
-          }
-        }
-      } else { // mirrored behavior
-        if (!do_min_step) {
-          /* uart_queue_sdec(min_pol); */
-          if (min_axis == 'Y') {
-            steps[i].y = 1;
-            /* uart_queue_str("Y"); */
-          } else {
-            steps[i].x = 1;
-            /* uart_queue_str("X"); */
-          }
-        }
-      }
-
-      /* uart_queue_str("Data: ["); */
-      /* uart_queue_hex(steps[i].step_data,6); */
-      /* uart_queue_str("]\r\n"); */
-
-      /* uart_queue_str("\r\n"); */
-      i++;
-      /* uart_flush(); */
+  memset(&a, 0, sizeof(a));
+  // TODO: this should either vary during motion, or at least be based on arc length
+  a.ticks = (2000000 / rate) / 61;
+  motion->dirs[X_AXIS] = TMC_FWD;
+  motion->dirs[Y_AXIS] = TMC_FWD;
+  motion->dirs[Z_AXIS] = TMC_FWD;
+
+  // a full turn is under 8r steps, the limit only guards a degenerate end
+  limit = 8 * ((uint64_t) sqrtl(r2) + 1);
+  last_cross = rot * (x*ey - y*ex);
+  while (r2 && limit--) {
+    // tangent, counter clockwise (-y, x)
+    tx = -rot * y;
+    ty = rot * x;
+    if (llabs(tx) >= llabs(ty)) {
+      sx = arc_sign(tx);
+      m = ty ? arc_sign(ty) : -arc_sign(y);
+      sy = (arc_err(x+sx, y+m, r2) < arc_err(x+sx, y, r2)) ? m : 0;
+    } else {
+      sy = arc_sign(ty);
+      m = tx ? arc_sign(tx) : -arc_sign(x);
+      sx = (arc_err(x+m, y+sy, r2) < arc_err(x, y+sy, r2)) ? m : 0;
     }
-    /* uart_queue_str("---\r\n"); */
-
-    // axis polarity only changes when it is the minor axis
-    // if there's a change coming, flip axis direction
-
-    // polarity of minor access flips when
-    //     CW  (-1)  goes even -> odd
-    //     CCW (+1)  goes odd -> even
-    if( ((octant%2 == 0) && (rot == -1)) ||
-        ((octant%2 == 1) && (rot == 1)) ) {
-      if (min_axis == 'X') {
-        steps[i].x_flip = 1;
-      } else {
-        steps[i].y_flip = 1;
-      }
+    arc_step(&a, sx, sy, motion);
+    x += sx;
+    y += sy;
+
+    // crossed the ray from the center through the end point
+    cross = rot * (x*ey - y*ex);
+    if ( (last_cross > 0) && (cross <= 0) && (x*ex + y*ey > 0) ) {
+      break;
     }
-
+    last_cross = cross;
+  }
+  while ( (x != ex) || (y != ey) ) {
+    sx = arc_sign(ex - x);
+    sy = arc_sign(ey - y);
+    arc_step(&a, sx, sy, motion);
+    x += sx;
+    y += sy;
+  }
+  if (a.holding) {
+    a.n = step_append(&a.steps, &a.size, a.n, a.ticks, a.held);
   }
 
-  motion->count = i;
-
-  int32_t x = start_pos[X_AXIS];
-  int32_t y = start_pos[Y_AXIS];
-
-  int8_t xmod = (motion->dirs[X_AXIS] == TMC_FWD) ? +1 : -1;
-  int8_t ymod = (motion->dirs[Y_AXIS] == TMC_FWD) ? +1 : -1;
-
-  uart_queue_str("\r\n----\r\n");
-  for( i = 0; i < motion->count; i++ ) {
-    uart_queue_dec(i);
-    /* uart_queue_str(": ["); */
-    /* uart_queue_hex(steps[i].step_data,6); */
-    /* uart_queue_str("] "); */
-    /* uart_queue_str("tk = "); */
-    /* uart_queue_dec(motion->steps[i].timer_ticks); */
-
-    if(steps[i].x_flip) {
-      xmod *= -1;
-      uart_queue('*');
-    }
-    if (steps[i].x) {
-      if (xmod == 1) {
-        uart_queue_str(" +X");
-      }else {
-        uart_queue_str(" -X");
-      }
-      x += xmod;
-    } else {
-      uart_queue_str("   ");
-    }
-
-    if(steps[i].y_flip) {
-      ymod *= -1;
-      uart_queue('*');
-    }
-    if (steps[i].y) {
-      if (ymod == 1) {
-        uart_queue_str(" +Y");
-      } else {
-        uart_queue_str(" -Y");
-      }
-      y += ymod;
-    }
+  if (LOG_ON(LOG_DEBUG)) {
+    uart_queue_str("  entries = ");
+    uart_queue_dec(a.n);
     uart_queue_str("\r\n");
   }
 
-  uart_queue_str("End: (");
-  uart_queue_sdec(x);
-  uart_queue_str(", ");
-  uart_queue_sdec(y);
-  uart_queue_str(")\r\n");
+  motion->steps = step_trim(a.steps, a.n);
+  motion->count = a.n;
+
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+  axis_split(motion);
+#endif
 }
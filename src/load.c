@@ -0,0 +1,153 @@
+// File       : load.c
+// Author     : Jeff Schornick
+//
+// CPU load accounting for the main loop
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include <string.h>
+#include "hal.h"
+#include "timer.h"
+#include "uart.h"
+#include "profile.h"
+#include "load.h"
+
+static char *load_names[LOAD_PHASES] = { "idle", "input", "gcode", "poll", "other" };
+
+static load_window_t load_windows[LOAD_WINDOWS];  // closed windows, ring
+static uint8_t load_head;                         // next slot to fill
+static uint8_t load_count;
+
+static load_window_t load_now;                    // window being filled
+static uint8_t load_phase = LOAD_OTHER;
+static uint32_t load_last;                        // load_timer_ticks() at the last mark
+static uint32_t load_start_ms;
+static uint64_t load_isr_last;
+static uint8_t load_clock_div = 1;
+
+void load_mark(uint8_t phase)
+{
+  uint32_t now = load_timer_ticks();
+
+  load_now.ticks[load_phase] += now - load_last;
+  load_last = now;
+  load_phase = phase;
+}
+
+void load_clock(uint8_t div)
+{
+  load_clock_div = div;
+}
+
+static uint64_t load_isr_cycles(void)
+{
+  uint64_t sum = 0;
+  uint32_t irq;
+  uint8_t i;
+
+  irq = hal_irq_save();
+  for(i=0; i<PROF_ISRS; i++) {
+    sum += prof_isrs[i].exec_sum;
+  }
+  hal_irq_restore(irq);
+  return sum;
+}
+
+void load_poll(void)
+{
+  uint64_t isr;
+  uint8_t i;
+
+  if (systick_ms - load_start_ms < LOAD_WINDOW_MS) {
+    return;
+  }
+  load_mark(load_phase);
+
+  // a profile reset mid-window just loses that window's ISR share
+  isr = load_isr_cycles();
+  if (isr >= load_isr_last) {
+    load_now.isr = (isr - load_isr_last) * load_clock_div * LOAD_TIMER_HZ / HAL_CYCLE_HZ;
+  }
+  load_isr_last = isr;
+
+  load_now.total = 0;
+  for(i=0; i<LOAD_PHASES; i++) {
+    load_now.total += load_now.ticks[i];
+  }
+
+  load_windows[load_head] = load_now;
+  load_head = (load_head + 1) % LOAD_WINDOWS;
+  if (load_count < LOAD_WINDOWS) {
+    load_count++;
+  }
+  memset(&load_now, 0, sizeof(load_now));
+  load_start_ms = systick_ms;
+}
+
+static void load_queue_pct(uint64_t part, uint64_t total)
+{
+  uint32_t tenths = total ? (uint32_t) (part * 1000 / total) : 0;
+
+  uart_queue_dec(tenths / 10);
+  uart_queue('.');
+  uart_queue_dec(tenths % 10);
+  uart_queue('%');
+}
+
+// Function: load_report
+//
+// Prints each activity's share of the last window and of all kept
+// windows, and the lowest idle share of any kept window
+void load_report(void)
+{
+  load_window_t *last;
+  uint64_t sum[LOAD_PHASES];
+  uint64_t isr = 0, total = 0;
+  uint32_t idle_min = 1000, idle;
+  uint8_t i, w;
+
+  if (!load_count) {
+    uart_queue_str("No load window complete yet\r\n");
+    return;
+  }
+  last = &load_windows[(load_head + LOAD_WINDOWS - 1) % LOAD_WINDOWS];
+
+  memset(sum, 0, sizeof(sum));
+  for(w=0; w<load_count; w++) {
+    for(i=0; i<LOAD_PHASES; i++) {
+      sum[i] += load_windows[w].ticks[i];
+    }
+    isr += load_windows[w].isr;
+    total += load_windows[w].total;
+    if (load_windows[w].total) {
+      idle = (uint32_t) ((uint64_t) load_windows[w].ticks[LOAD_IDLE] * 1000 / load_windows[w].total);
+      if (idle < idle_min) {
+        idle_min = idle;
+      }
+    }
+  }
+
+  uart_queue_str("CPU load, last ");
+  uart_queue_dec(LOAD_WINDOW_MS);
+  uart_queue_str(" ms / last ");
+  uart_queue_dec(load_count * LOAD_WINDOW_MS);
+  uart_queue_str(" ms\r\n");
+  for(i=0; i<LOAD_PHASES; i++) {
+    uart_queue_str("  ");
+    uart_queue_str(load_names[i]);
+    uart_queue_str(": ");
+    load_queue_pct(last->ticks[i], last->total);
+    uart_queue_str(" / ");
+    load_queue_pct(sum[i], total);
+    uart_queue_str("\r\n");
+  }
+  uart_queue_str("  ISRs (profiled, included above): ");
+  load_queue_pct(last->isr, last->total);
+  uart_queue_str(" / ");
+  load_queue_pct(isr, total);
+  uart_queue_str("\r\n  Lowest idle: ");
+  load_queue_pct(idle_min, 1000);
+  uart_queue_str("\r\n");
+}
@@ -0,0 +1,24 @@
+// File       : log.c
+// Author     : Jeff Schornick
+//
+// Leveled debug output
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include "log.h"
+
+// Runtime level, starts at INFO (or a lower ceiling). DEBUG and TRACE are
+// opt-in from the menu, TRACE formats every TMC datagram.
+uint8_t log_level = (LOG_LEVEL < LOG_INFO) ? LOG_LEVEL : LOG_INFO;
+
+static const char *log_names[] = { "NONE", "ERROR", "WARN", "INFO", "DEBUG", "TRACE" };
+
+const char *log_level_name(uint8_t level)
+{
+  if (level > LOG_TRACE) {
+    return "?";
+  }
+  return log_names[level];
+}
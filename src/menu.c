@@ -12,6 +12,15 @@
 #include "motion.h"
 #include "gcode.h"
 #include "buttons.h"
+#include "homing.h"
+#include "coolstep.h"
+#include "health.h"
+#include "drive.h"
+#include "coil.h"
+#include "bench.h"
+#include "profile.h"
+#include "load.h"
+#include "log.h"
 #include "menu.h"
 
 // The selected stepper controller
@@ -35,6 +44,7 @@ void update_current_scale_cb(void *arg) {
   uint32_t val = *((uint32_t *) arg);
   if (val <= 0x1f) {
     tmc_set_current_scale(tmc, val);
+    drive_run_cs[tmc] = val;
     uart_queue_str("Config updated!\r\n");
   } else {
     uart_queue_str("Value ");
@@ -47,8 +57,11 @@ void update_current_scale_cb(void *arg) {
 void update_microstep_cb(void *arg) {
   uint32_t val = *((uint32_t *) arg);
   if (val <= 0x08) {
-    tmc_set_microstep(tmc, val);
-    uart_queue_str("Config updated!\r\n");
+    if (tmc_set_microstep(tmc, val) == SPI_OK) {
+      uart_queue_str("Config updated!\r\n");
+    } else {
+      uart_queue_str("Motion in progress, not updated!\r\n");
+    }
   } else {
     uart_queue_str("Value ");
     uart_queue_hex(val, 32);
@@ -63,15 +76,42 @@ void rapid_motion_cb(void *arg) {
 
 void set_rapid_rate_cb(void *arg) {
   uint32_t rate = *((uint32_t *) arg);
-  if (rate <= MAX_RATE) {
+  if (rate <= motion_rate_limit()) {
     rapid_rate = rate;
   } else {
     uart_queue_str("ERR: Rate limit is ");
-    uart_queue_dec(MAX_RATE);
+    uart_queue_dec(motion_rate_limit());
     uart_queue_str("!\r\n");
   }
 }
 
+void coil_velocity_cb(void *arg) {
+  coil_set_velocity(tmc, *((int32_t *) arg));
+}
+
+void set_log_level_cb(void *arg) {
+  uint32_t level = *((uint32_t *) arg);
+  if (level <= LOG_TRACE) {
+    log_level = level;
+    if (level > LOG_LEVEL) {
+      uart_queue_str("NB: levels above ");
+      uart_queue_str((char *) log_level_name(LOG_LEVEL));
+      uart_queue_str(" are not in this build\r\n");
+    }
+  } else {
+    uart_queue_str("Out of range!\r\n");
+  }
+}
+
+void set_health_period_cb(void *arg) {
+  uint32_t period = *((uint32_t *) arg);
+  if (period <= 10000) {
+    health_period_ms = period;
+  } else {
+    uart_queue_str("Out of range!\r\n");
+  }
+}
+
 void display_config(uint8_t tmc)
 {
   uart_queue_str("Configuration for stepper #");
@@ -286,6 +326,32 @@ void config_menu(char c)
       uart_queue_str("Read TMC status\r\n");
       display_tmc_status();
       break;
+    case 'k':
+      uart_queue_str("CoolStep status\r\n");
+      coolstep_report(tmc);
+      break;
+    case 'K':
+      coolstep_enable(tmc, !coolstep_axis[tmc].enabled);
+      uart_queue_str(coolstep_axis[tmc].enabled ? "CoolStep enabled\r\n" : "CoolStep disabled\r\n");
+      break;
+    case 'f':
+      uart_queue_str("Fault status\r\n");
+      health_report();
+      break;
+    case 'F':
+      uart_queue_str("Clear latched faults\r\n");
+      health_clear();
+      break;
+    case 'p':
+      uart_queue_str("Set health poll period\r\n");
+      uart_queue_str("Period is ");
+      uart_queue_dec(health_period_ms);
+      uart_queue_str(" ms. New period (0=off)? ");
+      input_state = INPUT_DEC;
+      input_callback = set_health_period_cb;
+      input_sign = 1;
+      show_menu = 0;
+      break;
     case ASCII_ESCAPE:
       uart_queue_str("Return to main\r\n");
       menu_state = MENU_MAIN;
@@ -344,9 +410,9 @@ void motion_menu(char c)
       gpio_toggle(tmc_pins[tmc].step_port, tmc_pins[tmc].step_pin);
       if( tmc_get_dir(tmc) == TMC_FWD ) {
         uart_queue_str("++\r\n");
-        pos[tmc]++;
+        pos[tmc] += tmc_step_size(tmc);
       } else {
-        pos[tmc]--;
+        pos[tmc] -= tmc_step_size(tmc);
         uart_queue_str("--\r\n");
       }
       break;
@@ -396,6 +462,24 @@ void motion_menu(char c)
       uart_queue_str("Return home\r\n");
       home();
       break;
+    case 'H':
+      uart_queue_str("Home axes (StallGuard)\r\n");
+      homing_start();
+      break;
+    case 'C':
+      coil_enable(tmc, !(coil_mode & (1 << tmc)));
+      uart_queue_str((coil_mode & (1 << tmc)) ? "Coil (SPI) drive\r\n" : "Step/dir drive\r\n");
+      break;
+    case 'v':
+      if (coil_mode & (1 << tmc)) {
+        uart_queue_str("Coil velocity (1/256 steps/s) ? ");
+        input_state = INPUT_DEC;
+        input_callback = coil_velocity_cb;
+        show_menu = 0;
+      } else {
+        uart_queue_str("Coil drive not enabled\r\n");
+      }
+      break;
     case '0':
       uart_queue_str("Zero axes\r\n");
       pos[X_AXIS] = 0;
@@ -518,6 +602,7 @@ void main_menu(char c)
   case 'i':
     uart_queue_str("Re-initalizing TMCs\r\n");
     tmc_init();
+    drive_init();
     break;
   case 'c':
     display_config_menu(2);
@@ -558,6 +643,33 @@ void main_menu(char c)
     uart_queue_str("Enable limit switch\r\n");
     enable_limit_switch();
     break;
+  case 'v':
+    uart_queue_str("Set log level\r\n");
+    uart_queue_str("Level is ");
+    uart_queue_dec(log_level);
+    uart_queue_str(" (");
+    uart_queue_str((char *) log_level_name(log_level));
+    uart_queue_str("). New level (0=NONE - 5=TRACE)? ");
+    input_state = INPUT_DEC;
+    input_callback = set_log_level_cb;
+    input_value = 0;
+    input_sign = 1;
+    show_menu = 0;
+    break;
+  case 'b':
+    uart_queue_str("Benchmark\r\n");
+    bench_run();
+    break;
+  case 'p':
+    prof_report();
+    break;
+  case 'P':
+    prof_reset();
+    uart_queue_str("ISR profile reset\r\n");
+    break;
+  case 'u':
+    load_report();
+    break;
   case '?':
     show_menu = 2;
     break;
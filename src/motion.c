@@ -8,32 +8,41 @@
 
 #include <stdint.h>
 #include <stdlib.h>  // malloc
+#include "hal.h"
 #include "uart.h"
+#include "log.h"
 #include "timer.h"
 #include "tmc.h"
 #include "interpolate.h"
 #include "motion.h"
+#include "stepper.h"
 
 volatile int32_t pos[] = {0, 0, 0} ;
+int32_t plan_pos[] = {0, 0, 0};  // pos[] at the end of the last planned motion
 uint32_t rapid_rate = 300;
 
 motion_t *motion = 0;
 motion_t *next_motion = 0;
 uint32_t motion_tick = 0;
 uint32_t motion_enabled = 0;
+uint8_t motion_inhibit = 0;
+
+static motion_t *volatile motion_retired;  // finished blocks, last first
 
 void rapid(uint8_t tmc, int32_t steps)
 {
   int32_t xyz[] = {0, 0, 0};
-  uart_queue_str("Rapid : ");
-  uart_queue_dec(steps);
+  if (LOG_ON(LOG_INFO)) {
+    uart_queue_str("Rapid : ");
+    uart_queue_sdec(steps);
+    uart_queue_str(" steps\r\n");
+  }
   /* if(tmc_get_dir(tmc) == TMC_FWD) { */
   /*   xyz[tmc] = steps; */
   /* } else { */
   /*   xyz[tmc] = -steps; */
   /* } */
   xyz[tmc] = steps;
-  uart_queue_str(" steps\r\n");
   if (!next_motion) {
     next_motion = new_rapid_motion(xyz[X_AXIS], xyz[Y_AXIS], xyz[Z_AXIS], 1);
     motion_start();
@@ -61,7 +70,15 @@ void home(void)
 
 void motion_start(void)
 {
-  if(!motion_enabled) {
+  if (motion_inhibit & MOTION_INHIBIT_FAULT) {
+    uart_queue_str("Driver fault latched, clear it first!\r\n");
+    return;
+  }
+  if (motion_inhibit & MOTION_INHIBIT_COIL) {
+    uart_queue_str("Coil drive active, no step motion!\r\n");
+    return;
+  }
+  if(!motion_enabled && LOG_ON(LOG_INFO)) {
     uart_queue_str("Motion enabled\r\n");
   }
   /* TIMER_A1->CCR[0] = 1; */
@@ -70,17 +87,139 @@ void motion_start(void)
   step_timer_on();
 }
 
+// Function: motion_stop
+//
+// Halts stepping within a tick. The current and queued motions are kept
+// and motion_start() resumes the current one where it stopped.
 void motion_stop(void)
 {
   motion_enabled = 0;
-  uart_queue_str("Motion disabled\r\n");
+  stepper_hold();
+  if (LOG_ON(LOG_INFO)) {
+    uart_queue_str("Motion disabled\r\n");
+  }
+}
+
+// Function: motion_abort
+//
+// Stops stepping immediately and discards the current and queued motions.
+// Position counts remain valid since pos[] is updated per step.
+void motion_abort(void)
+{
+  motion_t *current;
+  motion_t *queued;
+  uint32_t irq;
+
+  irq = hal_irq_save();
+  step_timer_off();
+  step_timer_arm(0);  // a step armed for the next tick was never made
+  motion_enabled = 0;
+  current = motion;
+  queued = next_motion;
+  motion = 0;
+  next_motion = 0;
+  motion_tick = 0;
+  hal_irq_restore(irq);
+
+  if (current) {
+    free_motion(current);
+  }
+  if (queued) {
+    free_motion(queued);
+  }
+  if (LOG_ON(LOG_INFO)) {
+    uart_queue_str("Motion aborted\r\n");
+  }
+}
+
+// Function: motion_rate_limit
+//
+// Fastest per-axis rate (base steps/s) that can be planned, allowing for
+// blocks stepped at a coarser driver resolution.
+uint32_t motion_rate_limit(void)
+{
+  uint8_t shift = MOTION_MAX_SHIFT;
+  uint8_t i;
+
+  for(i=0; i<3; i++) {
+    if (tmc_max_shift(i) < shift) {
+      shift = tmc_max_shift(i);
+    }
+  }
+  return MAX_RATE << shift;
 }
 
+// Picks the step resolution for a new block and advances plan_pos.
+//
+// Fast blocks are stepped 2^shift base steps per edge so the ISR edge rate
+// stays under MAX_RATE. The switch is only made when the block starts and
+// ends on a 2^shift boundary on every moving axis (and the arc center is
+// aligned), so the driver's microstep table position matches pos[] at the
+// switch; otherwise a finer shift is used.
+static uint8_t motion_plan(int32_t *delta, int32_t x_off, int32_t y_off, uint32_t rate, uint8_t axes, motion_t *block)
+{
+  uint8_t shift = 0;
+  uint8_t max_shift = MOTION_MAX_SHIFT;
+  uint8_t aligned;
+  int32_t mask;
+  uint8_t i;
+
+  // nothing queued, so plan from where the machine actually is
+  if (!motion && !next_motion) {
+    for(i=0; i<3; i++) {
+      plan_pos[i] = pos[i];
+    }
+  }
+
+  for(i=0; i<3; i++) {
+    if (delta[i]) {
+      axes |= 1 << i;
+    }
+    if ( (axes & (1 << i)) && (tmc_max_shift(i) < max_shift) ) {
+      max_shift = tmc_max_shift(i);
+    }
+  }
+
+  while ( (shift < max_shift) && ((rate >> shift) > MAX_RATE) ) {
+    shift++;
+  }
+  while (shift) {
+    mask = (1 << shift) - 1;
+    aligned = !(x_off & mask) && !(y_off & mask);
+    for(i=0; i<3; i++) {
+      if ( (axes & (1 << i)) && ((delta[i] & mask) || (plan_pos[i] & mask)) ) {
+        aligned = 0;
+      }
+    }
+    if (aligned) {
+      break;
+    }
+    shift--;
+  }
+
+  for(i=0; i<3; i++) {
+    plan_pos[i] += delta[i];
+  }
+
+  if (shift && LOG_ON(LOG_DEBUG)) {
+    uart_queue_str("Block step shift ");
+    uart_queue_dec(shift);
+    uart_queue_str("\r\n");
+  }
+  block->axes = axes;
+  block->shift = shift;
+  block->rate = rate;
+  return shift;
+}
 
 motion_t * new_rapid_motion(int32_t x, int32_t y, int32_t z, uint16_t id)
 {
   int32_t start[3];
   int32_t end[3];
+  uint8_t shift;
+
+  motion_t *motion = malloc( sizeof(motion_t) );
+  motion->id = id;
 
   start[X_AXIS] = 0;
   start[Y_AXIS] = 0;
@@ -89,10 +228,12 @@ motion_t * new_rapid_motion(int32_t x, int32_t y, int32_t z, uint16_t id)
   end[Y_AXIS] = y;
   end[Z_AXIS] = z;
 
-  motion_t *motion = malloc( sizeof(motion_t) );
-  motion->id = id;
+  shift = motion_plan(end, 0, 0, rapid_rate, 0, motion);
+  end[X_AXIS] >>= shift;
+  end[Y_AXIS] >>= shift;
+  end[Z_AXIS] >>= shift;
 
-  rapid_interpolate(start, end, motion);
+  rapid_interpolate(start, end, rapid_rate >> shift, motion);
   return motion;
 }
 
@@ -100,6 +241,10 @@ motion_t * new_linear_motion(int32_t x, int32_t y, int32_t z, uint16_t speed, ui
 {
   int32_t start[3];
   int32_t end[3];
+  uint8_t shift;
+
+  motion_t *motion = malloc( sizeof(motion_t) );
+  motion->id = id;
 
   start[X_AXIS] = 0;
   start[Y_AXIS] = 0;
@@ -108,10 +253,12 @@ motion_t * new_linear_motion(int32_t x, int32_t y, int32_t z, uint16_t speed, ui
   end[Y_AXIS] = y;
   end[Z_AXIS] = z;
 
-  motion_t *motion = malloc( sizeof(motion_t) );
-  motion->id = id;
+  shift = motion_plan(end, 0, 0, speed, 0, motion);
+  end[X_AXIS] >>= shift;
+  end[Y_AXIS] >>= shift;
+  end[Z_AXIS] >>= shift;
 
-  linear_interpolate(start, end, speed, motion);
+  linear_interpolate(start, end, speed >> shift, motion);
   return motion;
 }
 
@@ -121,6 +268,10 @@ motion_t *new_arc_motion(int32_t x, int32_t y, int32_t x_off, int32_t y_off, int
 {
   int32_t start[3];
   int32_t end[3];
+  uint8_t shift;
+
+  motion_t *motion = malloc( sizeof(motion_t) );
+  motion->id = id;
 
   start[X_AXIS] = 0;
   start[Y_AXIS] = 0;
@@ -129,23 +280,58 @@ motion_t *new_arc_motion(int32_t x, int32_t y, int32_t x_off, int32_t y_off, int
   end[Y_AXIS] = y;
   end[Z_AXIS] = 0;
 
-  motion_t *motion = malloc( sizeof(motion_t) );
-  motion->id = id;
+  // a full circle has no delta but still moves both axes
+  shift = motion_plan(end, x_off, y_off, speed, (1 << X_AXIS) | (1 << Y_AXIS), motion);
+  end[X_AXIS] >>= shift;
+  end[Y_AXIS] >>= shift;
 
-  arc_interpolate(start, end, x_off, y_off, rotation, speed, motion);
+  arc_interpolate(start, end, x_off >> shift, y_off >> shift, rotation, speed >> shift, motion);
   return motion;
 }
 
 
+HAL_RAMFUNC void motion_retire(motion_t *block)
+{
+  block->done = motion_retired;
+  motion_retired = block;
+}
+
+void motion_reap(void)
+{
+  motion_t *block;
+  motion_t *done;
+  uint32_t irq;
+
+  irq = hal_irq_save();
+  block = motion_retired;
+  motion_retired = 0;
+  hal_irq_restore(irq);
+
+  while (block) {
+    done = block->done;
+    free_motion(block);
+    block = done;
+  }
+}
+
 void free_motion(motion_t *motion)
 {
   if(motion) {
     if(motion->steps) {
       free(motion->steps);
     }
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+    for(uint8_t i=0; i<3; i++) {
+      if(motion->axis_steps[i]) {
+        free(motion->axis_steps[i]);
+      }
+    }
+#endif
     free(motion);
   } else {
-    uart_queue_str("\r\n !! Tried to free NULL !!\r\n");
+    if (LOG_ON(LOG_ERROR)) {
+      uart_queue_str("\r\n !! Tried to free NULL !!\r\n");
+    }
   }
 }
 
@@ -0,0 +1,133 @@
+// File       : profile.c
+// Author     : Jeff Schornick
+//
+// Interrupt execution time and entry latency profiling
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include <string.h>
+#include "hal.h"
+#include "uart.h"
+#include "profile.h"
+
+prof_isr_t prof_isrs[PROF_ISRS];
+
+static char *prof_names[PROF_ISRS] = { "Step  (TA1_0)", "UART  (EUSCIA0)", "Button (PORT1)",
+                                       "Step DMA (INT3)" };
+
+#if PROF_ENABLE
+
+HAL_INLINE uint8_t prof_bin(uint32_t value)
+{
+  uint8_t bin;
+
+  if (!value) {
+    return 0;
+  }
+  bin = 32 - __builtin_clz(value);
+  return (bin < PROF_BINS) ? bin : PROF_BINS - 1;
+}
+
+// Called from the handlers, each of which runs at its own priority, so
+// an entry is only ever updated by one ISR
+HAL_RAMFUNC void prof_record(uint8_t isr, uint32_t exec, uint32_t latency)
+{
+  prof_isr_t *p = &prof_isrs[isr];
+  uint8_t bin;
+
+  if (!p->count || (exec < p->exec_min)) {
+    p->exec_min = exec;
+  }
+  if (exec > p->exec_max) {
+    p->exec_max = exec;
+  }
+  p->exec_sum += exec;
+  p->count++;
+  bin = prof_bin(exec);
+  if (p->exec_hist[bin] != 0xffff) {
+    p->exec_hist[bin]++;
+  }
+
+  if (latency == PROF_NO_LATENCY) {
+    return;
+  }
+  if (!p->lat_count || (latency < p->lat_min)) {
+    p->lat_min = latency;
+  }
+  if (latency > p->lat_max) {
+    p->lat_max = latency;
+  }
+  p->lat_sum += latency;
+  p->lat_count++;
+  bin = prof_bin(latency);
+  if (p->lat_hist[bin] != 0xffff) {
+    p->lat_hist[bin]++;
+  }
+}
+
+#endif
+
+void prof_reset(void)
+{
+  uint32_t irq = hal_irq_save();
+
+  memset(prof_isrs, 0, sizeof(prof_isrs));
+  hal_irq_restore(irq);
+}
+
+static void prof_queue_stats(char *name, uint32_t count, uint32_t min, uint32_t max, uint64_t sum,
+                             uint16_t *hist)
+{
+  uint8_t i;
+
+  uart_queue_str(name);
+  uart_queue_str(" min/mean/max ");
+  uart_queue_dec(min);
+  uart_queue('/');
+  uart_queue_dec(count ? (uint32_t) (sum / count) : 0);
+  uart_queue('/');
+  uart_queue_dec(max);
+  uart_queue_str("\r\n     <2^n:");
+  for(i=0; i<PROF_BINS; i++) {
+    if (hist[i]) {
+      uart_queue(' ');
+      uart_queue_dec(i);
+      uart_queue(':');
+      uart_queue_dec(hist[i]);
+    }
+  }
+  uart_queue_str("\r\n");
+}
+
+// Function: prof_report
+//
+// Prints a snapshot of every handler's statistics and histograms
+void prof_report(void)
+{
+  prof_isr_t snap;
+  uint32_t irq;
+  uint8_t i;
+
+  uart_queue_str("ISR profile (" HAL_CYCLE_UNIT ")\r\n");
+  for(i=0; i<PROF_ISRS; i++) {
+    irq = hal_irq_save();
+    snap = prof_isrs[i];
+    hal_irq_restore(irq);
+
+    uart_queue_str(prof_names[i]);
+    uart_queue_str(": ");
+    uart_queue_dec(snap.count);
+    uart_queue_str(" runs\r\n");
+    if (!snap.count) {
+      continue;
+    }
+    prof_queue_stats("  exec   ", snap.count, snap.exec_min, snap.exec_max, snap.exec_sum,
+                     snap.exec_hist);
+    if (snap.lat_count) {
+      prof_queue_stats("  latency", snap.lat_count, snap.lat_min, snap.lat_max, snap.lat_sum,
+                       snap.lat_hist);
+    }
+  }
+}
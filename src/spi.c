@@ -1,22 +1,36 @@
 // File       : spi.c
 // Author     : Jeff Schornick
 //
-// MSP432 SPI driver using interrupts and a pair of RX/TX buffers.
+// MSP432 SPI driver using DMA and a queue of transactions.
 // EUSCIB1 is connected SPI bus for the TMC stepper drivers
 //
+// Transactions (jobs) are queued with spi_queue_job() and clocked out by a
+// pair of DMA channels, one feeding TXBUF and one draining RXBUF. The RX
+// channel completion interrupt releases chip select, runs the job callback
+// and starts the next job, so callers never wait on the bus.
+//
 // Compilation: GCC cross compiler for ARM, v4.9.3+
 // Version    : See GitHub repository jschornick/cnc for revision details
 
 #include <stdint.h>
 #include <stdio.h>
 #include "msp432p401r.h"
+#include "hal.h"
 #include "gpio.h"
 #include "uart.h"
+#include "dma.h"
+#include "spi.h"
+#include "clock.h"
 
 volatile uint8_t spi_tx_data;
 volatile uint8_t spi_rx_data;
 volatile uint8_t spi_rx_flag;
 
+spi_job_t spi_jobs[SPI_JOB_QUEUE_SIZE];
+volatile uint8_t spi_job_head;   // job in flight (oldest)
+volatile uint8_t spi_job_tail;   // next free slot
+volatile uint8_t spi_job_count;  // jobs queued, including the one in flight
+
 // Based on TI Resource explorer example msp432p401x_euscib0_spi_09
 void spi_init(void)
 {
@@ -48,14 +62,30 @@ void spi_init(void)
 
   //EUSCI_B1->CTLW0 |= EUSCI_B_CTLW0_SSEL__ACLK; // ACLK
   EUSCI_B1->CTLW0 |= EUSCI_B_CTLW0_SSEL__SMCLK; // SMCLK
-  EUSCI_B1->BRW = 0x08;       // clock div=5, fBitClock = fBRCLK/(UCBRx+1).
+  EUSCI_B1->BRW = CLOCK_SPI_BRW; // fBitClock = fBRCLK/UCBRx, at most CLOCK_SPI_HZ
   EUSCI_B1->CTLW0 &= ~EUSCI_B_CTLW0_SWRST;// Initialize USCI state machine
 
   spi_rx_flag = 0x0;
 
   // slave select initialized in tmc_init()
+
+  spi_job_head = 0;
+  spi_job_tail = 0;
+  spi_job_count = 0;
+
+  // DMA requests from the EUSCI flags, interrupt when the last byte is read
+  dma_set_source(DMA_CH_SPI_TX, DMA_SRC_EUSCI_B1_TX0);
+  dma_set_source(DMA_CH_SPI_RX, DMA_SRC_EUSCI_B1_RX0);
+  DMA_Channel->INT1_SRCCFG = DMA_INT1_SRCCFG_EN | DMA_CH_SPI_RX;
+
+  // below the step timer, so bus traffic never delays a step
+  __NVIC_SetPriority(DMA_INT1_IRQn, 1);
+  __NVIC_EnableIRQ(DMA_INT1_IRQn);
 }
 
+// Function: spi_send_byte
+//
+// Blocking single byte exchange. Only valid while the job queue is idle.
 uint8_t spi_send_byte(uint8_t tx_data)
 {
   uint8_t rx_data = 0;
@@ -76,3 +106,81 @@ uint8_t spi_send_byte(uint8_t tx_data)
 }
 
 
+// Start the job at the head of the queue. Called with interrupts masked or
+// from the DMA ISR.
+HAL_RAMFUNC static void spi_start(spi_job_t *job)
+{
+  gpio_low(job->cs_port, job->cs_pin);
+
+  // discard any stale byte so every RX request belongs to this job
+  spi_rx_data = EUSCI_B1->RXBUF;
+
+  dma_ctl_table[DMA_CH_SPI_RX].src_end = (volatile void *) &EUSCI_B1->RXBUF;
+  dma_ctl_table[DMA_CH_SPI_RX].dst_end = &job->rx[job->len - 1];
+  dma_ctl_table[DMA_CH_SPI_RX].ctl = UDMA_CHCTL_DSTINC_8 | UDMA_CHCTL_DSTSIZE_8
+    | UDMA_CHCTL_SRCINC_NONE | UDMA_CHCTL_SRCSIZE_8
+    | UDMA_CHCTL_ARBSIZE_1 | DMA_XFER_COUNT(job->len)
+    | UDMA_CHCTL_XFERMODE_BASIC;
+
+  dma_ctl_table[DMA_CH_SPI_TX].src_end = &job->tx[job->len - 1];
+  dma_ctl_table[DMA_CH_SPI_TX].dst_end = &EUSCI_B1->TXBUF;
+  dma_ctl_table[DMA_CH_SPI_TX].ctl = UDMA_CHCTL_DSTINC_NONE | UDMA_CHCTL_DSTSIZE_8
+    | UDMA_CHCTL_SRCINC_8 | UDMA_CHCTL_SRCSIZE_8
+    | UDMA_CHCTL_ARBSIZE_1 | DMA_XFER_COUNT(job->len)
+    | UDMA_CHCTL_XFERMODE_BASIC;
+
+  dma_enable(DMA_CH_SPI_RX);
+
+  // Re-arm TXIFG around enabling the TX channel, so the first byte is
+  // requested whether the trigger is taken on the edge or the level
+  EUSCI_B1->IFG &= ~EUSCI_B_IFG_TXIFG;
+  dma_enable(DMA_CH_SPI_TX);
+  EUSCI_B1->IFG |= EUSCI_B_IFG_TXIFG;
+}
+
+HAL_RAMFUNC uint8_t spi_queue_job(spi_job_t *job)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if (spi_job_count == SPI_JOB_QUEUE_SIZE) {
+    __set_PRIMASK(primask);
+    return SPI_ERR;
+  }
+  spi_jobs[spi_job_tail] = *job;
+  spi_job_tail = (spi_job_tail + 1) % SPI_JOB_QUEUE_SIZE;
+  if (spi_job_count++ == 0) {
+    spi_start(&spi_jobs[spi_job_head]);
+  }
+  __set_PRIMASK(primask);
+  return SPI_OK;
+}
+
+uint8_t spi_pending(void)
+{
+  return spi_job_count;
+}
+
+void spi_flush(void)
+{
+  while(spi_job_count);
+}
+
+// Interrupt handler for DMA completion of the SPI RX channel
+void DMA_INT1_IRQHandler(void)
+{
+  spi_job_t *job = &spi_jobs[spi_job_head];
+
+  gpio_high(job->cs_port, job->cs_pin);
+
+  // slot is not released until the callback returns
+  if (job->callback) {
+    job->callback(job);
+  }
+
+  spi_job_head = (spi_job_head + 1) % SPI_JOB_QUEUE_SIZE;
+  spi_job_count--;
+  if (spi_job_count) {
+    spi_start(&spi_jobs[spi_job_head]);
+  }
+}
@@ -45,6 +45,9 @@ extern void SystemInit(void);
 extern uint32_t __data_load__;
 extern uint32_t __data_start__;
 extern uint32_t __data_end__;
+extern uint32_t __ramfunc_load__;
+extern uint32_t __ramfunc_start__;
+extern uint32_t __ramfunc_end__;
 extern uint32_t __StackTop;
 
 typedef void( *pFunc )( void );
@@ -192,6 +195,15 @@ void Reset_Handler(void)
         *pui32Dest++ = *pui32Src++;
     }
 
+    //
+    // Copy the RAM-resident functions (.ramfunc) from flash to SRAM_CODE.
+    //
+    pui32Src = &__ramfunc_load__;
+    for(pui32Dest = &__ramfunc_start__; pui32Dest < &__ramfunc_end__; )
+    {
+        *pui32Dest++ = *pui32Src++;
+    }
+
     /* Call system initialization routine */
     SystemInit();
 
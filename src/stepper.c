@@ -0,0 +1,600 @@
+// File       : stepper.c
+// Author     : Jeff Schornick
+//
+// Step generation, run from the step timer interrupt
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include "hal.h"
+#include "timer.h"
+#include "gpio.h"
+#include "tmc.h"
+#include "spi.h"
+#include "motion.h"
+#include "stepper.h"
+#include "uart.h"
+#include "log.h"
+#include "drive.h"
+
+// Unused port slots point here, so every tick writes STEPPER_PORTS ports
+static hal_port_t stepper_null_port;
+
+hal_port_t *stepper_ports[STEPPER_PORTS];
+stepper_masks_t stepper_lut[STEPPER_CODES];
+int32_t stepper_delta[3];  // pos[] change per STEP edge, sign is the direction
+
+static uint8_t stepper_nports;
+
+static uint8_t stepper_port_index(hal_port_t *port)
+{
+  uint8_t i;
+
+  for(i=0; i<stepper_nports; i++) {
+    if (stepper_ports[i] == port) {
+      return i;
+    }
+  }
+  if (stepper_nports == STEPPER_PORTS) {
+    if (LOG_ON(LOG_ERROR)) {
+      uart_queue_str("STEP/DIR pins span more than STEPPER_PORTS ports!\r\n");
+    }
+    return 0;
+  }
+  stepper_ports[stepper_nports] = port;
+  return stepper_nports++;
+}
+
+void stepper_init(void)
+{
+  uint8_t step_port[3], dir_port[3];
+  uint8_t code, i;
+
+  stepper_nports = 0;
+  for(i=0; i<3; i++) {
+    step_port[i] = stepper_port_index(tmc_pins[i].step_port);
+    dir_port[i] = stepper_port_index(tmc_pins[i].dir_port);
+  }
+  for(i=stepper_nports; i<STEPPER_PORTS; i++) {
+    stepper_ports[i] = &stepper_null_port;
+  }
+
+  for(code=0; code<STEPPER_CODES; code++) {
+    for(i=0; i<STEPPER_PORTS; i++) {
+      stepper_lut[code].step[i] = 0;
+      stepper_lut[code].dir[i] = 0;
+    }
+    for(i=0; i<3; i++) {
+      if (code & (1 << STEPPER_BIT(i))) {
+        stepper_lut[code].step[step_port[i]] |= tmc_pins[i].step_pin;
+      }
+      if (code & (2 << STEPPER_BIT(i))) {
+        stepper_lut[code].dir[dir_port[i]] |= tmc_pins[i].dir_pin;
+      }
+    }
+  }
+}
+
+// Switch the moving axes of a block to its chopper band and step
+// resolution. Returns 0 until the writes are all queued and sent: the SPI
+// queue may hold other traffic ahead of them, and a step made before the
+// driver has its new MRES would move it by the wrong amount.
+HAL_RAMFUNC static uint8_t motion_set_resolution(motion_t *block)
+{
+  uint8_t ready = 1;
+  uint8_t i;
+
+  if (!drive_block_start(block)) {
+    return 0;
+  }
+  for(i=0; i<3; i++) {
+    if (block->axes & (1 << i)) {
+      if (tmc_set_step_shift(i, block->shift) == SPI_ERR) {
+        return 0;
+      }
+      if (tmc_block_pending(i)) {
+        ready = 0;
+      }
+    }
+  }
+  return ready;
+}
+
+// Set the DIR pins and position deltas for a block's first step
+HAL_INLINE void stepper_begin(motion_t *block)
+{
+  int32_t step = 1 << block->shift;
+  uint8_t i;
+
+  for(i=0; i<3; i++) {
+    tmc_set_dir(i, block->dirs[i]);
+    stepper_delta[i] = (block->dirs[i] == TMC_FWD) ? step : -step;
+  }
+}
+
+HAL_INLINE void stepper_log_begin(motion_t *block)
+{
+  if (LOG_ON(LOG_INFO)) {
+    uart_queue_str("\r\nBegin motion #");
+    uart_queue_dec(block->id);
+    uart_queue_str(" (");
+    uart_queue_dec(block->count);
+    uart_queue_str(" entries)\r\n");
+  }
+}
+
+HAL_INLINE void stepper_log_complete(motion_t *block)
+{
+  if (LOG_ON(LOG_INFO)) {
+    uart_queue_str("\r\nMotion # ");
+    uart_queue_dec(block->id);
+    uart_queue_str(" complete\r\n");
+  }
+}
+
+#if (STEP_BACKEND == STEP_BACKEND_GPIO) || (STEP_BACKEND == STEP_BACKEND_TIMER)
+
+static uint32_t stepper_entry;   // step table entry in progress
+static uint8_t stepper_repeat;   // its repeats already output
+
+HAL_RAMFUNC void stepper_isr(void)
+{
+  step_timing_t *s, *next;
+
+  if(motion) {
+    if(stepper_entry < motion->count) {
+      if (motion_tick == 0) {
+        stepper_log_begin(motion);
+#if STEP_BACKEND == STEP_BACKEND_GPIO
+        stepper_begin(motion);
+#endif
+      }
+
+      // an entry's period ends at its own step, load the next one's. A
+      // repeat keeps the period already loaded.
+      s = &motion->steps[stepper_entry];
+      if (stepper_repeat < s->repeat) {
+        stepper_repeat++;
+        next = s;
+      } else {
+        stepper_repeat = 0;
+        stepper_entry++;
+        next = (stepper_entry < motion->count) ? s + 1 : 0;
+        if (next) {
+          step_timer_period(next->timer_ticks);
+        }
+      }
+      stepper_output(s->step_data);
+#if STEP_BACKEND == STEP_BACKEND_TIMER
+      // this tick's edges were made by the timer, arm the next tick's
+      step_timer_arm(next ? next->step_data : 0);
+#endif
+      motion_tick++;
+    }
+
+    if(stepper_entry < motion->count) {
+      if(motion_enabled) {
+        step_timer_on();
+      }
+    } else {  // motion complete, the next one is timed from this step
+      stepper_log_complete(motion);
+      motion_retire(motion);
+      motion = 0;
+    }
+  }
+
+  // promote queued motion if available
+  if(!motion) {
+    if (next_motion && !motion_set_resolution(next_motion)) {
+      // resolution not set yet, retry on the next tick
+      step_timer_period(1);
+      if(motion_enabled) {
+        step_timer_on();
+      }
+    } else if (next_motion) {
+      if (LOG_ON(LOG_DEBUG)) {
+        uart_queue_str("\r\nPrep queued motion!\r\n");
+      }
+      motion = next_motion;
+      next_motion = 0;
+      motion_tick = 0;
+      stepper_entry = 0;
+      stepper_repeat = 0;
+      step_timer_period(motion->steps[0].timer_ticks);
+#if STEP_BACKEND == STEP_BACKEND_TIMER
+      // DIR must be settled before the timer makes the first edge
+      stepper_begin(motion);
+      step_timer_arm(motion->steps[0].step_data);
+#endif
+      if(motion_enabled) {
+        step_timer_on();
+      }
+    } else {
+      if (LOG_ON(LOG_DEBUG)) {
+        uart_queue_str("Motion queue empty!\r\n");
+      }
+    }
+  }
+
+}
+
+// With motion_enabled cleared the ISR outputs the step already due and
+// stops, the table position is kept for the restart
+void stepper_hold(void)
+{
+}
+
+#elif STEP_BACKEND == STEP_BACKEND_AXIS
+
+// Longest block clock period, blocks longer than this take several ticks
+#define STEPPER_BLOCK_CHUNK 0x8000
+
+static uint32_t stepper_block_left;      // block clock ticks after this period
+static uint32_t stepper_axis_tick[3];    // entry of each axis stream in progress
+static uint8_t stepper_axis_repeat[3];   // its repeats already output
+static uint8_t stepper_held;             // streams halted mid-block by a stop
+
+// Sets the block clock to the next chunk of the active block
+HAL_INLINE void stepper_block_clock(void)
+{
+  uint32_t chunk = (stepper_block_left > STEPPER_BLOCK_CHUNK) ?
+    STEPPER_BLOCK_CHUNK : stepper_block_left;
+
+  stepper_block_left -= chunk;
+  step_timer_period(chunk - 1);
+}
+
+HAL_RAMFUNC void stepper_axis_isr(uint8_t axis)
+{
+  step_timing_t *s;
+  uint32_t i = stepper_axis_tick[axis];
+
+  if (!motion || (i >= motion->axis_count[axis])) {
+    step_axis_stop(axis);
+    return;
+  }
+  s = &motion->axis_steps[axis][i];
+  stepper_output(s->step_data);
+  motion_tick++;
+
+  if (stepper_axis_repeat[axis] < s->repeat) {
+    stepper_axis_repeat[axis]++;
+  } else {
+    stepper_axis_repeat[axis] = 0;
+    stepper_axis_tick[axis] = ++i;
+    if (i >= motion->axis_count[axis]) {
+      step_axis_stop(axis);
+      return;
+    }
+    s++;
+  }
+  step_axis_next(axis, s->timer_ticks, (s->step_data >> STEPPER_BIT(axis)) & 1);
+}
+
+// Starts each axis' stream at its entry in progress on the tick being
+// handled, the entry's interval counting from here
+HAL_INLINE void stepper_axis_resume(void)
+{
+  step_timing_t *s;
+  uint8_t i;
+
+  for(i=0; i<3; i++) {
+    if (stepper_axis_tick[i] < motion->axis_count[i]) {
+      s = &motion->axis_steps[i][stepper_axis_tick[i]];
+      step_axis_start(i, s->timer_ticks, (s->step_data >> STEPPER_BIT(i)) & 1);
+    }
+  }
+}
+
+// Parks the streams. The block clock then covers the longest of what the
+// axes have left, each from the start of its entry in progress.
+void stepper_hold(void)
+{
+  step_timing_t *s;
+  uint32_t irq, left, t;
+  uint32_t k;
+  uint8_t i;
+
+  irq = hal_irq_save();
+  step_timer_off();
+  if (!motion || stepper_held) {
+    hal_irq_restore(irq);
+    return;
+  }
+  stepper_held = 1;
+  hal_irq_restore(irq);
+
+  // every step interrupt is off, the streams are ours to read
+  left = 0;
+  for(i=0; i<3; i++) {
+    t = 0;
+    for(k=stepper_axis_tick[i]; k<motion->axis_count[i]; k++) {
+      s = &motion->axis_steps[i][k];
+      t += (uint32_t) s->timer_ticks * (s->repeat + 1);
+    }
+    if (t) {
+      t -= (uint32_t) motion->axis_steps[i][stepper_axis_tick[i]].timer_ticks *
+        stepper_axis_repeat[i];
+    }
+    if (t > left) {
+      left = t;
+    }
+  }
+  stepper_block_left = left;
+}
+
+// Block clock: the axis streams run on their own between block boundaries
+HAL_RAMFUNC void stepper_isr(void)
+{
+  step_timing_t *s;
+  uint8_t i;
+
+  if (motion) {
+    if (stepper_block_left) {
+      stepper_block_clock();
+      if (stepper_held) {
+        // restarted after a stop, carry on with the held block
+        stepper_held = 0;
+        stepper_axis_resume();
+      }
+      step_timer_on();
+      return;
+    }
+    stepper_log_complete(motion);
+    motion_retire(motion);
+    motion = 0;
+  }
+
+  if (!motion_enabled) {
+    return;
+  }
+
+  if (next_motion && !motion_set_resolution(next_motion)) {
+    // resolution not set yet, retry on the next tick
+    step_timer_period(1);
+    step_timer_on();
+  } else if (next_motion) {
+    if (LOG_ON(LOG_DEBUG)) {
+      uart_queue_str("\r\nPrep queued motion!\r\n");
+    }
+    motion = next_motion;
+    next_motion = 0;
+    motion_tick = 0;
+    stepper_held = 0;
+    stepper_log_begin(motion);
+
+    // the block starts on this tick, DIR is settled before any axis' first
+    // match, which is at least one tick away
+    stepper_block_left = motion->ticks;
+    stepper_block_clock();
+    stepper_begin(motion);
+    for(i=0; i<3; i++) {
+      stepper_axis_tick[i] = 0;
+      stepper_axis_repeat[i] = 0;
+      if (motion->axis_count[i]) {
+        s = &motion->axis_steps[i][0];
+        step_axis_start(i, s->timer_ticks, (s->step_data >> STEPPER_BIT(i)) & 1);
+      }
+    }
+    step_timer_on();
+  } else {
+    if (LOG_ON(LOG_DEBUG)) {
+      uart_queue_str("Motion queue empty!\r\n");
+    }
+  }
+}
+
+#else  // STEP_BACKEND_DMA
+
+stepper_half_t stepper_half[2];
+
+static uint32_t stepper_dma_tick;     // next entry of the active block
+static uint8_t stepper_dma_repeat;    // its repeats already in frames
+static uint16_t stepper_dma_out[3];   // output words after the frames so far
+
+// Function: stepper_dma_fill
+//
+// Turns the next entries of the active block into frames, each landing at
+// the end of its entry's period as the GPIO backend makes its edges. The
+// half holding the last step ends the block.
+HAL_RAMFUNC static void stepper_dma_fill(stepper_half_t *half)
+{
+  step_timing_t *s;
+  uint8_t code, i;
+  uint8_t n = 0;
+
+  half->flip = 0;
+  half->tick = stepper_dma_tick;
+  half->repeat = stepper_dma_repeat;
+  for(i=0; i<3; i++) {
+    half->edges[i] = 0;
+    half->from[i] = stepper_dma_out[i];
+  }
+
+  while ((stepper_dma_tick < motion->count) && (n < STEPPER_DMA_FRAMES)) {
+    s = &motion->steps[stepper_dma_tick];
+    if (stepper_dma_repeat < s->repeat) {
+      stepper_dma_repeat++;
+    } else {
+      stepper_dma_repeat = 0;
+      stepper_dma_tick++;
+    }
+    code = s->step_data;
+    half->period[n] = s->timer_ticks;
+    for(i=0; i<3; i++) {
+      if ((code >> STEPPER_BIT(i)) & 1) {
+        stepper_dma_out[i] ^= STEP_DMA_HIGH;
+        half->edges[i]++;
+      }
+      half->out[n][i] = stepper_dma_out[i];
+    }
+    n++;
+
+    // DIR must change between this frame and the next
+    if (code & STEPPER_FLIP_BITS) {
+      half->flip = code & STEPPER_FLIP_BITS;
+      break;
+    }
+  }
+  half->frames = n;
+  half->end = (n > 0) && (stepper_dma_tick == motion->count);
+}
+
+// Streams the active block from stepper_dma_tick, the outputs as they are
+HAL_RAMFUNC static void stepper_dma_stream(void)
+{
+  uint8_t i;
+
+  for(i=0; i<3; i++) {
+    stepper_dma_out[i] = step_dma_level(i) ? STEP_DMA_HIGH : 0;
+  }
+  stepper_dma_fill(&stepper_half[0]);
+  stepper_dma_fill(&stepper_half[1]);
+  step_dma_start(stepper_half[0].period[0]);
+}
+
+// Promotes next_motion and starts streaming it from the tick being handled.
+// A block held by a stop carries on from its first frame not written.
+HAL_RAMFUNC static void stepper_dma_begin(void)
+{
+  if (!motion_enabled) {
+    return;
+  }
+
+  if (motion) {
+    if (stepper_dma_tick < motion->count) {
+      stepper_dma_stream();
+      return;
+    }
+    // held on its last step
+    stepper_log_complete(motion);
+    motion_retire(motion);
+    motion = 0;
+  }
+
+  if (next_motion && !motion_set_resolution(next_motion)) {
+    // resolution not set yet, retry on the next tick
+    step_timer_period(1);
+    step_timer_on();
+  } else if (next_motion) {
+    if (LOG_ON(LOG_DEBUG)) {
+      uart_queue_str("\r\nPrep queued motion!\r\n");
+    }
+    motion = next_motion;
+    next_motion = 0;
+    motion_tick = 0;
+    stepper_log_begin(motion);
+    if (!motion->count) {
+      // nothing to stream, move on to the next block on the next tick
+      stepper_log_complete(motion);
+      motion_retire(motion);
+      motion = 0;
+      step_timer_period(1);
+      step_timer_on();
+      return;
+    }
+
+    // DIR is settled before the first frame, at least one tick away
+    stepper_begin(motion);
+    stepper_dma_tick = 0;
+    stepper_dma_repeat = 0;
+    stepper_dma_stream();
+  } else {
+    if (LOG_ON(LOG_DEBUG)) {
+      uart_queue_str("Motion queue empty!\r\n");
+    }
+  }
+}
+
+HAL_RAMFUNC void stepper_dma_isr(uint8_t h)
+{
+  stepper_half_t *half = &stepper_half[h];
+  uint8_t i;
+
+  if (!motion) {
+    // the block went away under the stream
+    step_timer_off();
+    return;
+  }
+
+  // the other half's first frame is due one period from now
+  if (stepper_half[h ^ 1].frames) {
+    step_dma_frames(h ^ 1);
+  }
+
+  for(i=0; i<3; i++) {
+    pos[i] += (int32_t) half->edges[i] * stepper_delta[i];
+  }
+  if (half->flip) {
+    stepper_output(half->flip);
+  }
+  motion_tick += half->frames;
+
+  if (!half->end) {
+    stepper_dma_fill(half);
+    step_dma_periods(h, 0);
+    return;
+  }
+
+  // the block's last step, the next block is timed from here
+  half->frames = 0;
+  stepper_log_complete(motion);
+  motion_retire(motion);
+  motion = 0;
+  stepper_dma_begin();
+}
+
+void stepper_dma_abort(uint8_t h, uint8_t written)
+{
+  stepper_half_t *half = &stepper_half[h];
+  step_timing_t *s;
+  uint8_t i, k;
+
+  for(i=0; i<3; i++) {
+    for(k=0; k<written; k++) {
+      if (half->out[k][i] != (k ? half->out[k-1][i] : half->from[i])) {
+        pos[i] += stepper_delta[i];
+      }
+    }
+  }
+  // a reversal ends its half, so it is due once the whole half is out
+  if ((written == half->frames) && half->flip) {
+    stepper_output(half->flip);
+  }
+  motion_tick += written;
+
+  // each frame is one repeat of an entry
+  stepper_dma_tick = half->tick;
+  stepper_dma_repeat = half->repeat;
+  for(k=0; motion && (k<written); k++) {
+    s = &motion->steps[stepper_dma_tick];
+    if (stepper_dma_repeat < s->repeat) {
+      stepper_dma_repeat++;
+    } else {
+      stepper_dma_repeat = 0;
+      stepper_dma_tick++;
+    }
+  }
+  stepper_half[0].frames = 0;
+  stepper_half[1].frames = 0;
+}
+
+// Stopping the stream accounts for the frames out and rewinds the block to
+// the rest, stepper_dma_begin() picks it up from there
+void stepper_hold(void)
+{
+  uint32_t irq;
+
+  irq = hal_irq_save();
+  step_timer_off();
+  hal_irq_restore(irq);
+}
+
+// Step timer interrupt, only enabled while no stream runs
+HAL_RAMFUNC void stepper_isr(void)
+{
+  stepper_dma_begin();
+}
+
+#endif
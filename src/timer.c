@@ -8,36 +8,60 @@
 
 #include <stdint.h>
 #include "msp432p401r.h"
+#include "hal.h"
 
-#include "motion.h"
+#include "timer.h"
+#include "stepper.h"
 #include "tmc.h"
+#include "coil.h"
+#include "profile.h"
+#include "dma.h"
+
+#if STEP_BACKEND != STEP_BACKEND_GPIO
+static void step_output_init(void);
+#endif
+#if STEP_BACKEND == STEP_BACKEND_DMA
+static void step_dma_init(void);
+#endif
 
 // Function: timer_init
 //
 // Initializes two timers, one fast, one slow.
-// The fast timer (A0) is configured with a short period to be used for PWM.
-// The slow timer (A1) is configured to interrupt every 1 second.
+// The fast timer (A0) free-runs as the load timer, see load_timer_ticks().
+// The slow timer (A1) is the step timer.
 void timer_init(void)
 {
   // ACLK = auxillary clock, set to LFXT = 32768 KHz
-  // SMCLK =  DCO freq (3MHz)
+  // SMCLK = CLOCK_SMCLK_HZ (24MHz), see clock.h
 
   // Timer A0, fast clock
   //----------------------
 
-  // Up counting mode (0 -> CCR0)
-  TIMER_A0->CTL = TIMER_A_CTL_MC__UP | TIMER_A_CTL_SSEL__SMCLK | TIMER_A_CTL_CLR;
-
-  // Set a short period (in timer ticks) for PWM
-  //   ...then the duty cycle can be set as a fraction of this value in CCR[1..3]
-  TIMER_A0->CCR[0] = 200;
+  // Continuous mode at SMCLK/64 (ID /8, TAIDEX /8), interrupt on each wrap
+  // to 0, every ~175 ms, so the wraps seldom wake the CPU from LPM0. This
+  // was the PWM timer; pwm.c is not built and would need a timer of its own.
+  TIMER_A0->EX0 = TIMER_A_EX0_IDEX__8;
+  TIMER_A0->CTL = TIMER_A_CTL_MC__CONTINUOUS | TIMER_A_CTL_SSEL__SMCLK | TIMER_A_CTL_ID__8 |
+    TIMER_A_CTL_CLR | TIMER_A_CTL_IE;
+  __NVIC_EnableIRQ(TA0_N_IRQn);
 
 
   // Timer A1, slow clock
   //---------------------
 
+#if STEP_BACKEND == STEP_BACKEND_GPIO
   // Up counting mode (0 -> CCR0)
   TIMER_A1->CTL = TIMER_A_CTL_MC__UP | TIMER_A_CTL_SSEL__ACLK | TIMER_A_CTL_CLR;
+#elif STEP_BACKEND == STEP_BACKEND_DMA
+  // Left stopped, the compare outputs only follow the OUT bits. The step
+  // timer is TA3.
+  step_output_init();
+  step_dma_init();
+#else
+  // Continuous mode, CCR0 is advanced by each tick's period
+  TIMER_A1->CTL = TIMER_A_CTL_MC__CONTINUOUS | TIMER_A_CTL_SSEL__ACLK | TIMER_A_CTL_CLR;
+  step_output_init();
+#endif
 
   // capture control interrupt enable (CCIFG set when TA0R counts to CCR0)
   // TIMER_A1->CCTL[0] |= TIMER_A_CCTLN_CCIE;
@@ -48,99 +72,535 @@ void timer_init(void)
   TIMER_A1->CCR[0] = 500;  //   ~65 Hz
 
   // enable interrupt associated with CCR0 match
+#if STEP_BACKEND != STEP_BACKEND_DMA
   __NVIC_EnableIRQ(TA1_0_IRQn);
+#endif
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+  // and the per-axis CCR1-3 matches
+  __NVIC_EnableIRQ(TA1_N_IRQn);
+#endif
+}
+
+
+static volatile uint32_t load_timer_high;  // TA0 wraps, in ticks
+
+// Function: load_timer_ticks
+//
+// TA0 extended to 32 bits by its wrap count. A wrap the handler has not
+// counted yet is still pending in TAIFG, and then R is read again past it.
+// SMCLK and MCLK come from the same oscillator in every clock mode, so R
+// reads need no majority vote.
+uint32_t load_timer_ticks(void)
+{
+  uint32_t irq = hal_irq_save();
+  uint32_t high = load_timer_high;
+  uint16_t r = TIMER_A0->R;
+
+  if (TIMER_A0->CTL & TIMER_A_CTL_IFG) {
+    high += 0x10000;
+    r = TIMER_A0->R;
+  }
+  hal_irq_restore(irq);
+  return high + r;
+}
+
+// Interrupt handler for the TA0 wrap (load timer)
+void TA0_N_IRQHandler(void)
+{
+  TIMER_A0->CTL &= ~TIMER_A_CTL_IFG;
+  load_timer_high += 0x10000;
+}
+
+volatile uint32_t systick_ms = 0;
+
+// Function: systick_init
+//
+// Starts a 1 kHz SysTick interrupt for scheduling background work (driver
+// polling, homing) from the main loop. The tick also wakes the main loop.
+void systick_init(void)
+{
+  SysTick_Config(SystemCoreClock / 1000);
+}
+
+// Function: systick_rescale
+//
+// Reloads the SysTick period after SystemCoreClock changes. Clearing the
+// counter restarts the current millisecond, so at most one tick runs long.
+void systick_rescale(void)
+{
+  SysTick->LOAD = SystemCoreClock / 1000 - 1;
+  SysTick->VAL = 0;
 }
 
+void SysTick_Handler(void)
+{
+  systick_ms++;
+}
+
+volatile uint32_t step_timer_slips = 0;
+
+#if STEP_BACKEND != STEP_BACKEND_GPIO
+
+// TA1 compare output (CCR1-3) driving each driver's STEP pin, by axis
+static const struct {
+  volatile uint8_t *pmap;
+  uint8_t pmap_id;
+} step_outputs[3] = {
+  { &P7MAP->PMAP_REGISTER0, PMAP_TA1CCR1A },  // TMC0 STEP, P7.0
+  { &P7MAP->PMAP_REGISTER7, PMAP_TA1CCR2A },  // TMC1 STEP, P7.7
+  { &P3MAP->PMAP_REGISTER7, PMAP_TA1CCR3A },  // TMC2 STEP, P3.7
+};
+#define STEP_CCR(axis) ((axis) + 1)
+
+// Function: step_output_init
+//
+// Hands the STEP pins to the TA1 compare outputs. The outputs start parked
+// (OUTMOD 0, following their OUT bit) until the timer is switched on.
+static void step_output_init(void)
+{
+  uint8_t i;
+
+  PMAP->KEYID = PMAP_KEYID_VAL;
+  PMAP->CTL = PMAP_CTL_PRECFG;
+  for(i=0; i<3; i++) {
+    *step_outputs[i].pmap = step_outputs[i].pmap_id;
+    tmc_pins[i].step_port->SEL0 |= tmc_pins[i].step_pin;
+    tmc_pins[i].step_port->SEL1 &= ~tmc_pins[i].step_pin;
+    tmc_pins[i].step_port->DIR |= tmc_pins[i].step_pin;
+    TIMER_A1->CCTL[STEP_CCR(i)] = TIMER_A_CCTLN_OUTMOD_0;
+  }
+  PMAP->KEYID = 0;
+}
 
-void step_timer_on(void) {
+// OUTMOD 0 control word holding an axis' STEP output at its current level
+HAL_RAMFUNC static uint16_t step_output_hold(uint8_t axis)
+{
+  return TIMER_A_CCTLN_OUTMOD_0 |
+    ((tmc_pins[axis].step_port->IN & tmc_pins[axis].step_pin) ? TIMER_A_CCTLN_OUT : 0);
+}
+
+#endif
+
+#if STEP_BACKEND == STEP_BACKEND_GPIO
+
+HAL_RAMFUNC void step_timer_on(void) {
   TIMER_A1->CCTL[0] |= TIMER_A_CCTLN_CCIE;
 }
 
-void step_timer_period(uint16_t period) {
+HAL_RAMFUNC void step_timer_off(void) {
+  TIMER_A1->CCTL[0] &= ~TIMER_A_CCTLN_CCIE;
+}
+
+HAL_RAMFUNC void step_timer_period(uint16_t period) {
   TIMER_A1->CCR[0] = period;
 }
 
-#include "uart.h"
+HAL_RAMFUNC void step_timer_arm(uint8_t code) {
+}
 
 // Interrupt handler for timer compare TA1CCR0 (stepping)
 // Max freq = 32768 kHz (evey ~30.5us)
-void TA1_0_IRQHandler(void)
+HAL_RAMFUNC void TA1_0_IRQHandler(void)
 {
+  uint32_t start = hal_cycles();
+  uint32_t late = TIMER_A1->R;  // ACLK ticks since the CCR0 match
+
   TIMER_A1->CCTL[0] &= ~TIMER_A_CCTLN_CCIE;
   // reset timer interrupt flag
   TIMER_A1->CCTL[0] &= ~TIMER_A_CCTLN_CCIFG;
 
-  if(motion) {
-    if (motion_tick == 0) {
-      uart_queue_str("\r\nBegin motion #");
-      uart_queue_dec(motion->id);
-      uart_queue_str(" (");
-      uart_queue_dec(motion->count);
-      uart_queue_str(" steps)\r\n");
-      tmc_set_dir(X_AXIS, motion->dirs[X_AXIS]);
-      tmc_set_dir(Y_AXIS, motion->dirs[Y_AXIS]);
-      tmc_set_dir(Z_AXIS, motion->dirs[Z_AXIS]);
-    }
+  stepper_isr();
 
-    if(motion_tick < motion->count) {
-      TIMER_A1->CCR[0] = motion->steps[motion_tick].timer_ticks;
+  prof_isr(PROF_STEP, start, late * (SystemCoreClock / 32768));
+}
 
-      /* uart_queue_hex((uint32_t) motion->steps[motion_tick].axes[X_AXIS],4); */
-      /* uart_queue_hex((uint32_t) motion->steps[motion_tick].axes[Y_AXIS],4); */
-      /* uart_queue_hex((uint32_t) motion->steps[motion_tick].axes[Z_AXIS],4); */
-      /* uart_queue_str("\r\n"); */
+#elif STEP_BACKEND == STEP_BACKEND_DMA
 
-      if (motion->steps[motion_tick].x) {
-        gpio_toggle(tmc_pins[X_AXIS].step_port, tmc_pins[X_AXIS].step_pin);
-        pos[X_AXIS] += (tmc_get_dir(X_AXIS) == TMC_FWD) ? 1 : -1;
-      }
-      if (motion->steps[motion_tick].y) {
-        gpio_toggle(tmc_pins[Y_AXIS].step_port, tmc_pins[Y_AXIS].step_pin);
-        pos[Y_AXIS] += (tmc_get_dir(Y_AXIS) == TMC_FWD) ? 1 : -1;
-      }
-      if (motion->steps[motion_tick].z) {
-        gpio_toggle(tmc_pins[Z_AXIS].step_port, tmc_pins[Z_AXIS].step_pin);
-        pos[Z_AXIS] += (tmc_get_dir(Z_AXIS) == TMC_FWD) ? 1 : -1;
-      }
+// TA3 is the step timer, in up mode as with STEP_BACKEND_GPIO. While a
+// stream runs, each CCR0 match requests the next frame and each wrap
+// (CCR2 = 0) the next period, and the CCR0 interrupt stays off: it only
+// starts motion from idle. DMA_INT3 marks the end of each half.
+//
+// Frame channel: peripheral scatter-gather, one task per frame copying its
+// three words to TA1 CCTL1-3. The last task of a half is basic, so the
+// channel stops after it. Period channel: ping-pong into TA3 CCR0, the
+// primary on half 0 and the alternate on half 1.
 
-      if (motion->steps[motion_tick].x_flip) {
-        gpio_toggle(tmc_pins[X_AXIS].dir_port, tmc_pins[X_AXIS].dir_pin);
-      }
-      if (motion->steps[motion_tick].y_flip) {
-        gpio_toggle(tmc_pins[Y_AXIS].dir_port, tmc_pins[Y_AXIS].dir_pin);
-      }
-      if (motion->steps[motion_tick].z_flip) {
-        gpio_toggle(tmc_pins[Z_AXIS].dir_port, tmc_pins[Z_AXIS].dir_pin);
-      }
+#define STEP_DMA_TASK (UDMA_CHCTL_DSTINC_16 | UDMA_CHCTL_DSTSIZE_16 | \
+                       UDMA_CHCTL_SRCINC_16 | UDMA_CHCTL_SRCSIZE_16 | \
+                       UDMA_CHCTL_ARBSIZE_4 | DMA_XFER_COUNT(3))
 
+static dma_desc_t step_dma_tasks[2][STEPPER_DMA_FRAMES];
+static uint8_t step_dma_last[2];   // task made basic in each half
+static uint8_t step_dma_half;      // half the frame channel is on
+static uint8_t step_dma_running;   // frame channel armed
 
-      motion_tick++;
-      if(motion_enabled) {
-        TIMER_A1->CCTL[0] |= TIMER_A_CCTLN_CCIE;
-      }
-    } else {  // motion complete
-      uart_queue_str("\r\nMotion # ");
-      uart_queue_dec(motion->id);
-      uart_queue_str(" complete\r\n");
-      free_motion(motion);
-      motion = 0;
+static void step_dma_init(void)
+{
+  uint8_t h, k;
+
+  // Up counting mode (0 -> CCR0)
+  TIMER_A3->CTL = TIMER_A_CTL_MC__UP | TIMER_A_CTL_SSEL__ACLK | TIMER_A_CTL_CLR;
+  TIMER_A3->CCR[0] = 500;
+  TIMER_A3->CCR[2] = 0;
+
+  for(h=0; h<2; h++) {
+    for(k=0; k<STEPPER_DMA_FRAMES; k++) {
+      step_dma_tasks[h][k].src_end = &stepper_half[h].out[k][2];
+      step_dma_tasks[h][k].dst_end = &TIMER_A1->CCTL[STEP_CCR(2)];
+      step_dma_tasks[h][k].ctl = STEP_DMA_TASK | UDMA_CHCTL_XFERMODE_PER_SGA;
     }
   }
+  dma_set_source(DMA_CH_STEP_FRAMES, DMA_SRC_TA3_CCR0);
+  dma_set_source(DMA_CH_STEP_PERIODS, DMA_SRC_TA3_CCR2);
+  DMA_Channel->INT3_SRCCFG = DMA_INT3_SRCCFG_EN | DMA_CH_STEP_FRAMES;
 
-  // promote queued motion if available
-  if(!motion) {
-    if (next_motion) {
-      uart_queue_str("\r\nPrep queued motion!\r\n");
-      motion = next_motion;
-      next_motion = 0;
-      motion_tick = 0;
-      TIMER_A1->CCR[0] = motion->steps[motion_tick].timer_ticks;
-      if(motion_enabled) {
-        TIMER_A1->CCTL[0] |= TIMER_A_CCTLN_CCIE;
+  // a half's last frame leaves at least one tick to start the next
+  __NVIC_SetPriority(DMA_INT3_IRQn, 0);
+  __NVIC_EnableIRQ(DMA_INT3_IRQn);
+  __NVIC_EnableIRQ(TA3_0_IRQn);
+}
+
+HAL_RAMFUNC void step_dma_frames(uint8_t half)
+{
+  uint8_t last = stepper_half[half].frames - 1;
+
+  step_dma_tasks[half][step_dma_last[half]].ctl = STEP_DMA_TASK | UDMA_CHCTL_XFERMODE_PER_SGA;
+  step_dma_tasks[half][last].ctl = STEP_DMA_TASK | UDMA_CHCTL_XFERMODE_BASIC;
+  step_dma_last[half] = last;
+
+  dma_ctl_table[DMA_CH_STEP_FRAMES].src_end = &step_dma_tasks[half][last].spare;
+  dma_ctl_table[DMA_CH_STEP_FRAMES].dst_end = &dma_ctl_table[DMA_CHANNELS + DMA_CH_STEP_FRAMES].spare;
+  dma_ctl_table[DMA_CH_STEP_FRAMES].ctl = UDMA_CHCTL_DSTINC_32 | UDMA_CHCTL_DSTSIZE_32
+    | UDMA_CHCTL_SRCINC_32 | UDMA_CHCTL_SRCSIZE_32
+    | UDMA_CHCTL_ARBSIZE_4 | DMA_XFER_COUNT(4 * (last + 1))
+    | UDMA_CHCTL_XFERMODE_PER_SG;
+
+  step_dma_half = half;
+  step_dma_running = 1;
+  DMA_Control->ALTCLR = 1 << DMA_CH_STEP_FRAMES;
+  dma_enable(DMA_CH_STEP_FRAMES);
+}
+
+HAL_RAMFUNC void step_dma_periods(uint8_t half, uint8_t first)
+{
+  stepper_half_t *h = &stepper_half[half];
+  dma_desc_t *d = &dma_ctl_table[(half ? DMA_CHANNELS : 0) + DMA_CH_STEP_PERIODS];
+
+  if (first >= h->frames) {
+    d->ctl = UDMA_CHCTL_XFERMODE_STOP;
+    return;
+  }
+  d->src_end = &h->period[h->frames - 1];
+  d->dst_end = &TIMER_A3->CCR[0];
+  d->ctl = UDMA_CHCTL_DSTINC_NONE | UDMA_CHCTL_DSTSIZE_16
+    | UDMA_CHCTL_SRCINC_16 | UDMA_CHCTL_SRCSIZE_16
+    | UDMA_CHCTL_ARBSIZE_1 | DMA_XFER_COUNT(h->frames - first)
+    | UDMA_CHCTL_XFERMODE_PINGPONG;
+  // restarts the channel if it ran dry on the other half
+  dma_enable(DMA_CH_STEP_PERIODS);
+}
+
+HAL_RAMFUNC void step_dma_start(uint16_t period)
+{
+  // restart the count so the period runs from this tick and the wrap that
+  // would have followed the match does not consume a table period
+  TIMER_A3->CTL &= ~TIMER_A_CTL_MC_MASK;
+  TIMER_A3->R = 0;
+  TIMER_A3->CCR[0] = period;
+  TIMER_A3->CCTL[0] &= ~(TIMER_A_CCTLN_CCIE | TIMER_A_CCTLN_CCIFG);
+  TIMER_A3->CCTL[2] &= ~TIMER_A_CCTLN_CCIFG;
+
+  dma_disable(DMA_CH_STEP_PERIODS);
+  step_dma_periods(0, 1);
+  step_dma_periods(1, 0);
+  if (stepper_half[0].frames > 1) {
+    DMA_Control->ALTCLR = 1 << DMA_CH_STEP_PERIODS;
+  } else {
+    DMA_Control->ALTSET = 1 << DMA_CH_STEP_PERIODS;
+  }
+  step_dma_frames(0);
+
+  TIMER_A3->CTL |= TIMER_A_CTL_MC__UP;
+}
+
+HAL_RAMFUNC uint8_t step_dma_level(uint8_t axis)
+{
+  return (step_output_hold(axis) & TIMER_A_CCTLN_OUT) ? 1 : 0;
+}
+
+// Frames of the running half already written, from the tasks the frame
+// channel has left to fetch. A task fetched but not yet triggered counts
+// as written.
+static uint8_t step_dma_written(void)
+{
+  uint32_t left;
+
+  if (!(DMA_Control->ENASET & (1 << DMA_CH_STEP_FRAMES))) {
+    return stepper_half[step_dma_half].frames;
+  }
+  left = (dma_ctl_table[DMA_CH_STEP_FRAMES].ctl & UDMA_CHCTL_XFERSIZE_M) >> UDMA_CHCTL_XFERSIZE_S;
+  return stepper_half[step_dma_half].frames - (left + 1) / 4;
+}
+
+HAL_RAMFUNC void step_timer_on(void)
+{
+  // a running stream starts the next block itself
+  if (!step_dma_running) {
+    TIMER_A3->CCTL[0] |= TIMER_A_CCTLN_CCIE;
+  }
+}
+
+HAL_RAMFUNC void step_timer_off(void)
+{
+  TIMER_A3->CCTL[0] &= ~TIMER_A_CCTLN_CCIE;
+  dma_disable(DMA_CH_STEP_FRAMES);
+  dma_disable(DMA_CH_STEP_PERIODS);
+  if (step_dma_running) {
+    step_dma_running = 0;
+    stepper_dma_abort(step_dma_half, step_dma_written());
+  }
+}
+
+HAL_RAMFUNC void step_timer_period(uint16_t period)
+{
+  TIMER_A3->CCR[0] = period;
+}
+
+HAL_RAMFUNC void step_timer_arm(uint8_t code)
+{
+}
+
+// Interrupt handler for DMA completion of the frame channel, the last frame
+// of a half has just been written
+HAL_RAMFUNC void DMA_INT3_IRQHandler(void)
+{
+  uint32_t start = hal_cycles();
+
+  if (step_dma_running) {
+    step_dma_running = 0;
+    stepper_dma_isr(step_dma_half);
+  }
+
+  // no hardware reference for when the last frame was written
+  prof_isr(PROF_DMA, start, PROF_NO_LATENCY);
+}
+
+// Interrupt handler for timer compare TA3CCR0, starts motion from idle
+HAL_RAMFUNC void TA3_0_IRQHandler(void)
+{
+  uint32_t start = hal_cycles();
+  uint32_t late = TIMER_A3->R;  // ACLK ticks since the CCR0 match
+
+  TIMER_A3->CCTL[0] &= ~TIMER_A_CCTLN_CCIE;
+  TIMER_A3->CCTL[0] &= ~TIMER_A_CCTLN_CCIFG;
+
+  stepper_isr();
+
+  prof_isr(PROF_STEP, start, late * (SystemCoreClock / 32768));
+}
+
+#else  // STEP_BACKEND_TIMER, STEP_BACKEND_AXIS
+
+// Ticks to schedule ahead of the counter when a tick was missed or the
+// timer is restarted, enough for the writes to land first
+#define STEP_TIMER_LEAD 2
+
+static uint16_t step_timer_last;     // CCR0 of the tick being handled
+static uint16_t step_timer_len = 501;
+static uint8_t step_timer_armed;
+static uint8_t step_timer_live;      // set by step_timer_on() in the ISR
+
+// Freeze the STEP outputs at their current level, so counter wraps while
+// stopped can't match a stale CCRn
+HAL_RAMFUNC static void step_output_park(void)
+{
+  uint8_t i;
+
+  for(i=0; i<3; i++) {
+    TIMER_A1->CCTL[STEP_CCR(i)] = step_output_hold(i);
+  }
+}
+
+HAL_RAMFUNC void step_timer_arm(uint8_t code)
+{
+  uint8_t i;
+
+  step_timer_armed = code;
+  for(i=0; i<3; i++) {
+    // an unarmed CCRn sits on the current tick, a full wrap away
+    TIMER_A1->CCR[STEP_CCR(i)] = ((code >> STEPPER_BIT(i)) & 1) ?
+      TIMER_A1->CCR[0] : step_timer_last;
+  }
+}
+
+HAL_RAMFUNC void step_timer_on(void)
+{
+#if STEP_BACKEND == STEP_BACKEND_TIMER
+  uint8_t i;
+#endif
+
+  step_timer_live = 1;
+  if (TIMER_A1->CCTL[0] & TIMER_A_CCTLN_CCIE) {
+    return;
+  }
+  // restart: as up mode, the next tick is one period from now. The AXIS
+  // block clock only starts or resumes a block there, so it comes at once.
+  step_timer_last = TIMER_A1->R;
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+  TIMER_A1->CCR[0] = step_timer_last + STEP_TIMER_LEAD;
+#else
+  TIMER_A1->CCR[0] = step_timer_last + step_timer_len;
+#endif
+#if STEP_BACKEND == STEP_BACKEND_TIMER
+  step_timer_arm(step_timer_armed);
+  for(i=0; i<3; i++) {
+    TIMER_A1->CCTL[STEP_CCR(i)] = TIMER_A_CCTLN_OUTMOD_4;
+  }
+#endif
+  TIMER_A1->CCTL[0] &= ~TIMER_A_CCTLN_CCIFG;
+  TIMER_A1->CCTL[0] |= TIMER_A_CCTLN_CCIE;
+}
+
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+HAL_RAMFUNC static uint16_t step_axis_service(void);
+#endif
+
+HAL_RAMFUNC void step_timer_off(void)
+{
+  TIMER_A1->CCTL[0] &= ~TIMER_A_CCTLN_CCIE;
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+  // account for edges already made at a match not yet handled, parking
+  // clears its CCIFG
+  step_axis_service();
+#endif
+  step_output_park();
+}
+
+// Schedules the next tick `period` + 1 ticks after the current one, the
+// same spacing as up mode. A tick that is already due is pushed back.
+HAL_RAMFUNC void step_timer_period(uint16_t period)
+{
+  uint16_t now = TIMER_A1->R;
+
+  step_timer_last = TIMER_A1->CCR[0];
+  step_timer_len = period + 1;
+  if ((uint16_t) (now - step_timer_last) >= (uint32_t) period + 1) {
+    TIMER_A1->CCR[0] = now + STEP_TIMER_LEAD;
+    step_timer_slips++;
+  } else {
+    TIMER_A1->CCR[0] = step_timer_last + period + 1;
+  }
+}
+
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+
+HAL_RAMFUNC void step_axis_next(uint8_t axis, uint16_t ticks, uint8_t step)
+{
+  uint16_t prev = TIMER_A1->CCR[STEP_CCR(axis)];
+  uint16_t now = TIMER_A1->R;
+
+  if ((uint16_t) (now - prev) >= ticks) {
+    TIMER_A1->CCR[STEP_CCR(axis)] = now + STEP_TIMER_LEAD;
+    step_timer_slips++;
+  } else {
+    TIMER_A1->CCR[STEP_CCR(axis)] = prev + ticks;
+  }
+  // a wait entry holds the output, writing CCTL also clears CCIFG
+  TIMER_A1->CCTL[STEP_CCR(axis)] = TIMER_A_CCTLN_CCIE |
+    (step ? TIMER_A_CCTLN_OUTMOD_4 : step_output_hold(axis));
+}
+
+HAL_RAMFUNC void step_axis_start(uint8_t axis, uint16_t ticks, uint8_t step)
+{
+  TIMER_A1->CCR[STEP_CCR(axis)] = step_timer_last;
+  step_axis_next(axis, ticks, step);
+}
+
+HAL_RAMFUNC void step_axis_stop(uint8_t axis)
+{
+  TIMER_A1->CCTL[STEP_CCR(axis)] = step_output_hold(axis);
+}
+
+// Runs stepper_axis_isr() for every axis with a pending match. Returns the
+// ticks since the earliest of them, for profiling.
+HAL_RAMFUNC static uint16_t step_axis_service(void)
+{
+  uint16_t late = 0;
+  uint16_t cctl, since;
+  uint8_t i;
+
+  for(i=0; i<3; i++) {
+    cctl = TIMER_A1->CCTL[STEP_CCR(i)];
+    if ((cctl & TIMER_A_CCTLN_CCIE) && (cctl & TIMER_A_CCTLN_CCIFG)) {
+      since = TIMER_A1->R - TIMER_A1->CCR[STEP_CCR(i)];
+      if (since > late) {
+        late = since;
       }
-    } else {
-      uart_queue_str("Motion queue empty!\r\n");
+      TIMER_A1->CCTL[STEP_CCR(i)] &= ~TIMER_A_CCTLN_CCIFG;
+      stepper_axis_isr(i);
     }
   }
+  return late;
+}
+
+// Interrupt handler for the per-axis compares TA1CCR1-3. The STEP edge was
+// made at the match; the handler only has to finish before the axis' next.
+HAL_RAMFUNC void TA1_N_IRQHandler(void)
+{
+  uint32_t start = hal_cycles();
+  uint16_t late = step_axis_service();
+
+  prof_isr(PROF_STEP, start, late * (SystemCoreClock / 32768));
+}
+
+#endif
+
+// Interrupt handler for timer compare TA1CCR0 (stepping). The STEP edges
+// of this tick were made by CCR1-3 at the match; the handler only has to
+// finish before the next tick. With STEP_BACKEND_AXIS this is the block
+// clock, and any axis matches on the same tick are finished first.
+HAL_RAMFUNC void TA1_0_IRQHandler(void)
+{
+  uint32_t start = hal_cycles();
+  uint16_t late = TIMER_A1->R - TIMER_A1->CCR[0];
+
+  TIMER_A1->CCTL[0] &= ~TIMER_A_CCTLN_CCIFG;
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+  step_axis_service();
+#endif
+
+  step_timer_live = 0;
+  stepper_isr();
+  if (!step_timer_live) {
+    step_timer_off();
+  }
+
+  prof_isr(PROF_STEP, start, late * (SystemCoreClock / 32768));
+}
+
+#endif
+
+void coil_timer_init(uint16_t period)
+{
+  // Up counting mode (0 -> CCR0)
+  TIMER_A2->CTL = TIMER_A_CTL_MC__UP | TIMER_A_CTL_SSEL__SMCLK | TIMER_A_CTL_CLR;
+  TIMER_A2->CCR[0] = period;
+  __NVIC_EnableIRQ(TA2_0_IRQn);
+}
+
+void coil_timer_on(void) {
+  TIMER_A2->CCTL[0] |= TIMER_A_CCTLN_CCIE;
+}
+
+void coil_timer_off(void) {
+  TIMER_A2->CCTL[0] &= ~TIMER_A_CCTLN_CCIE;
+}
+
+// Interrupt handler for timer compare TA2CCR0 (coil updates)
+void TA2_0_IRQHandler(void)
+{
+  TIMER_A2->CCTL[0] &= ~TIMER_A_CCTLN_CCIFG;
 
+  coil_isr();
 }
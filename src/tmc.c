@@ -10,10 +10,22 @@
 #include "gpio.h"
 #include "tmc.h"
 #include "uart.h"
+#include "log.h"
+#include "motion.h"
 
 uint8_t tmc;
 
 tmc_config_t tmc_config[3];
+uint8_t tmc_base_mres[3];
+
+uint32_t tmc_shadow[3][TMC_REG_COUNT];
+uint8_t tmc_shadow_valid[3];  // bitmask of (1 << TMC_REG_*)
+
+volatile tmc_status_t tmc_status[3];
+
+// Writes from tmc_block_write() not yet on the wire
+static volatile uint8_t tmc_block_writes[3];
+
 tmc_pinout_t tmc_pins[3] = {
   { .cs_port   = TMC0_CS_PORT,   .cs_pin   = TMC0_CS_PIN,
     .en_port   = TMC0_EN_PORT,   .en_pin   = TMC0_EN_PIN,
@@ -58,6 +70,140 @@ uint8_t cscale_init[] =  { 0x6, 0x2, 0xa };
 
 uint8_t tmc_axis_conf[] = { TMC_POLARITY_NORMAL, TMC_POLARITY_NORMAL, TMC_POLARITY_NORMAL };
 
+// Function: tmc_send_async
+//
+// Queues a 20-bit datagram for the selected driver and returns immediately.
+// 24 bits are shifted out (the first 4 are ignored by the driver) and the
+// first 20 bits shifted in are the response. The callback may be NULL, or
+// runs from the SPI completion interrupt where tmc_job_response() decodes
+// the reply and job->tag holds the driver index.
+//
+// Returns SPI_ERR if the SPI queue is full.
+HAL_RAMFUNC uint8_t tmc_send_async(uint8_t tmc, uint32_t tx_data, spi_callback_t callback, void *arg)
+{
+  spi_job_t job;
+
+  if (LOG_ON(LOG_TRACE)) {
+    uart_queue_str("\r\nTMC[");
+    uart_queue_hex(tmc,4);
+    uart_queue_str("] Sending: ");
+    uart_queue_hex(tx_data, 20);
+    uart_queue_str("\r\n");
+  }
+
+  job.cs_port = tmc_pins[tmc].cs_port;
+  job.cs_pin = tmc_pins[tmc].cs_pin;
+  job.len = 3;
+  job.tx[0] = (tx_data >> 16) & 0xff;
+  job.tx[1] = (tx_data >> 8) & 0xff;  // next 8-bits
+  job.tx[2] = tx_data & 0xff;         // last 8 bits
+  job.tag = tmc;
+  job.arg = arg;
+  job.callback = callback;
+
+  if (spi_queue_job(&job) == SPI_ERR) {
+    return SPI_ERR;
+  }
+
+  // remember what the driver now holds, see tmc_update()
+  tmc_shadow[tmc][TMC_REG_INDEX(tx_data)] = tx_data;
+  tmc_shadow_valid[tmc] |= 1 << TMC_REG_INDEX(tx_data);
+  return SPI_OK;
+}
+
+uint32_t tmc_job_response(spi_job_t *job)
+{
+  return ((uint32_t) job->rx[0] << 12) | ((uint32_t) job->rx[1] << 4) | (job->rx[2] >> 4);
+}
+
+static volatile uint8_t tmc_sync_done;
+static volatile uint32_t tmc_sync_response;
+
+static void tmc_sync_cb(spi_job_t *job)
+{
+  tmc_sync_response = tmc_job_response(job);
+  tmc_sync_done = 1;
+}
+
+// Function: tmc_send
+//
+// Blocking datagram exchange, waits behind any queued traffic and returns
+// the driver response. Not for use from interrupt context.
+uint32_t tmc_send(uint8_t tmc, uint32_t tx_data)
+{
+  uint32_t response;
+
+  tmc_sync_done = 0;
+  while (tmc_send_async(tmc, tx_data, tmc_sync_cb, 0) == SPI_ERR);
+  while (!tmc_sync_done);
+  response = tmc_sync_response;
+
+  if (LOG_ON(LOG_TRACE)) {
+    uart_queue_str("TMC: Received: ");
+    uart_queue_hex(response, 20);
+    uart_queue_str("\r\n");
+  }
+
+  return response;
+}
+
+static void tmc_status_cb(spi_job_t *job)
+{
+  volatile tmc_status_t *status = &tmc_status[job->tag];
+  tmc_response_t resp;
+
+  resp.raw = tmc_job_response(job);
+  status->flags = resp.raw & 0xff;
+  status->rdsel = (uintptr_t) job->arg;
+  switch (status->rdsel) {
+    case TMC_RDSEL_USTEP:
+      status->mstep = resp.ustep.MSTEP;
+      break;
+    case TMC_RDSEL_SG:
+      status->sg = resp.sg.SG10;
+      break;
+    case TMC_RDSEL_SGCS:
+      status->se = resp.sgcs.SE5;
+      status->sg = resp.sgcs.SG5 << 5;  // upper bits only
+      break;
+  }
+  status->seq++;
+  status->pending = 0;
+}
+
+// Function: tmc_request_status
+//
+// Queues a DRVCONF write selecting the next reading (TMC_RDSEL_*) and
+// decodes the response into tmc_status[tmc] when it arrives. The response
+// carries the reading selected by the *previous* DRVCONF, so alternating
+// callers should expect one stale sample. Only one request per driver is
+// kept in flight; returns SPI_ERR if one is pending or the queue is full.
+uint8_t tmc_request_status(uint8_t tmc, uint8_t rdsel)
+{
+  drvconf_t current;
+
+  if (tmc_status[tmc].pending) {
+    return SPI_ERR;
+  }
+
+  if (tmc_shadow_valid[tmc] & (1 << TMC_REG_DRVCONF)) {
+    current.raw = tmc_shadow[tmc][TMC_REG_DRVCONF];
+  } else {
+    current = tmc_config[tmc].drvconf;
+  }
+
+  // keep the config in step so tmc_update() doesn't undo the selection
+  tmc_config[tmc].drvconf.RDSEL = rdsel;
+
+  tmc_status[tmc].pending = 1;
+  if (tmc_send_async(tmc, tmc_config[tmc].drvconf.raw, tmc_status_cb,
+                     (void *) (uintptr_t) current.RDSEL) == SPI_ERR) {
+    tmc_status[tmc].pending = 0;
+    return SPI_ERR;
+  }
+  return SPI_OK;
+}
+
 void tmc_init(void)
 {
   uint8_t i;
@@ -79,18 +225,21 @@ void tmc_init(void)
     gpio_high(tmc_pins[i].dir_port, tmc_pins[i].dir_pin);
   }
 
-  tmc_config_t config;
-  config.drvconf.raw = drvconf_init;
-  config.drvctl.raw = drvctl_init;
-  config.chopconf.raw = chopconf_init;
-  config.sgcsconf.raw = sgcsconf_init;
-  config.smarten.raw = smarten_init;
-
   for(i=0; i<3; i++) {
-    config.sgcsconf.CSCALE = cscale_init[i];
-    tmc_reconfigure(i, &config);
+    tmc_config[i].drvconf.raw = drvconf_init;
+    tmc_config[i].drvctl.raw = drvctl_init;
+    tmc_config[i].chopconf.raw = chopconf_init;
+    tmc_config[i].sgcsconf.raw = sgcsconf_init;
+    tmc_config[i].sgcsconf.CSCALE = cscale_init[i];
+    tmc_config[i].smarten.raw = smarten_init;
+    tmc_base_mres[i] = tmc_config[i].drvctl.MRES;
+
+    // driver state unknown (may have been power cycled), write everything
+    tmc_invalidate(i);
   }
 
+  tmc_update_all();
+
   tmc = 0;
 }
 
@@ -102,46 +251,107 @@ void tmc_reconfigure(uint8_t tmc, tmc_config_t *config)
   tmc_config[tmc].sgcsconf = config->sgcsconf;
   tmc_config[tmc].smarten = config->smarten;
 
-  tmc_send(tmc, tmc_config[tmc].drvconf.raw);
-  tmc_send(tmc, tmc_config[tmc].drvctl.raw);
-  tmc_send(tmc, tmc_config[tmc].chopconf.raw);
-  tmc_send(tmc, tmc_config[tmc].sgcsconf.raw);
-  tmc_send(tmc, tmc_config[tmc].smarten.raw);
+  tmc_update(tmc);
 }
 
-// shift in 24 bits (last 20 bits will be command)
-// read in 24 bits (first 20 bits will be response)?
-uint32_t tmc_send(uint8_t tmc, uint32_t tx_data)
+// Queue a register write only if it differs from what the driver holds.
+// The step ISR changes registers and their shadows as blocks start (see
+// tmc_block_write), so the value is read, compared and queued with
+// interrupts held off. They are
+// let in between attempts while the SPI queue is full.
+static uint8_t tmc_write_changed(uint8_t tmc, const uint32_t *data)
 {
+  uint32_t tx_data;
+  uint32_t irq;
+  uint8_t reg;
+  uint8_t sent;
+
+  do {
+    irq = hal_irq_save();
+    tx_data = *data;
+    reg = TMC_REG_INDEX(tx_data);
+    if ( (tmc_shadow_valid[tmc] & (1 << reg)) && (tmc_shadow[tmc][reg] == tx_data) ) {
+      hal_irq_restore(irq);
+      return 0;
+    }
+    sent = tmc_send_async(tmc, tx_data, 0, 0);
+    hal_irq_restore(irq);
+  } while (sent == SPI_ERR);
+  return 1;
+}
 
-  uint32_t response = 0x0;
-
-  uint8_t tx_byte;
-
-  uart_queue_str("\r\nTMC[");
-  uart_queue_hex(tmc,4);
-  uart_queue_str("] Sending: ");
-  uart_queue_hex(tx_data, 20);
-  uart_queue_str("\r\n");
-
-  gpio_low(tmc_pins[tmc].cs_port, tmc_pins[tmc].cs_pin);
-
-  tx_byte = tx_data >> 16;
-  response = spi_send_byte(tx_byte) << 12;
+// Function: tmc_update
+//
+// Brings a driver in line with tmc_config[tmc], sending only the registers
+// whose value differs from the shadow copy. DRVCONF goes first since it
+// selects how DRVCTL is interpreted. Returns the number of writes queued.
+uint8_t tmc_update(uint8_t tmc)
+{
+  uint8_t writes = 0;
 
-  tx_byte = (tx_data >> 8) & 0xff ; // next 8-bits
-  response |= spi_send_byte(tx_byte) << 4;
+  writes += tmc_write_changed(tmc, &tmc_config[tmc].drvconf.raw);
+  // in SPI mode DRVCTL holds coil currents, owned by coil.c
+  if (tmc_config[tmc].drvconf.SDOFF == TMC_SD_ON) {
+    writes += tmc_write_changed(tmc, &tmc_config[tmc].drvctl.raw);
+  }
+  writes += tmc_write_changed(tmc, &tmc_config[tmc].chopconf.raw);
+  writes += tmc_write_changed(tmc, &tmc_config[tmc].sgcsconf.raw);
+  writes += tmc_write_changed(tmc, &tmc_config[tmc].smarten.raw);
+  return writes;
+}
 
-  tx_byte = tx_data & 0xff; // last 8 bits
-  response |= spi_send_byte(tx_byte) >> 4;
+// Function: tmc_update_reg
+//
+// As tmc_update(), for a single register (TMC_REG_*).
+uint8_t tmc_update_reg(uint8_t tmc, uint8_t reg)
+{
+  switch (reg) {
+    case TMC_REG_DRVCTL:
+      return tmc_write_changed(tmc, &tmc_config[tmc].drvctl.raw);
+    case TMC_REG_CHOPCONF:
+      return tmc_write_changed(tmc, &tmc_config[tmc].chopconf.raw);
+    case TMC_REG_SMARTEN:
+      return tmc_write_changed(tmc, &tmc_config[tmc].smarten.raw);
+    case TMC_REG_SGCSCONF:
+      return tmc_write_changed(tmc, &tmc_config[tmc].sgcsconf.raw);
+    case TMC_REG_DRVCONF:
+      return tmc_write_changed(tmc, &tmc_config[tmc].drvconf.raw);
+  }
+  return 0;
+}
 
-  gpio_high(tmc_pins[tmc].cs_port, tmc_pins[tmc].cs_pin);
+// Function: tmc_update_all
+//
+// Updates all drivers as one burst. Interrupts are held off while queueing
+// (as long as the queue has room), so the writes sit in the SPI queue in
+// order and contiguously, after any traffic already queued. The queue still
+// sends them one job at a time, other interrupts may run in between.
+uint8_t tmc_update_all(void)
+{
+  uint8_t writes = 0;
+  uint32_t irq;
+  uint8_t i;
 
-  uart_queue_str("TMC: Received: ");
-  uart_queue_hex(response, 20);
-  uart_queue_str("\r\n");
+  if (spi_pending() + 3*TMC_REG_COUNT <= SPI_JOB_QUEUE_SIZE) {
+    irq = hal_irq_save();
+    for(i=0; i<3; i++) {
+      writes += tmc_update(i);
+    }
+    hal_irq_restore(irq);
+  } else {
+    for(i=0; i<3; i++) {
+      writes += tmc_update(i);
+    }
+  }
+  return writes;
+}
 
-  return response;
+// Function: tmc_invalidate
+//
+// Forget the shadow copy, so the next update rewrites every register.
+void tmc_invalidate(uint8_t tmc)
+{
+  tmc_shadow_valid[tmc] = 0;
 }
 
 uint8_t tmc_get_current_scale(uint8_t tmc)
@@ -153,7 +363,7 @@ uint8_t tmc_get_current_scale(uint8_t tmc)
 void tmc_set_current_scale(uint8_t tmc, uint32_t value)
 {
   tmc_config[tmc].sgcsconf.CSCALE = value;
-  tmc_reconfigure(tmc, &tmc_config[tmc]);
+  tmc_update(tmc);
 }
 
 uint8_t tmc_get_microstep(uint8_t tmc)
@@ -161,14 +371,96 @@ uint8_t tmc_get_microstep(uint8_t tmc)
   return tmc_config[tmc].drvctl.MRES;
 }
 
-void tmc_set_microstep(uint8_t tmc, uint32_t value)
+// Function: tmc_set_microstep
+//
+// Sets the base resolution. Refused (SPI_ERR) while motion is running or
+// queued, since its blocks were planned for the old one and the step ISR
+// owns DRVCTL then.
+uint8_t tmc_set_microstep(uint8_t tmc, uint32_t value)
 {
+  if (motion || next_motion) {
+    return SPI_ERR;
+  }
+  tmc_base_mres[tmc] = value;
   tmc_config[tmc].drvctl.MRES = value;
-  tmc_reconfigure(tmc, &tmc_config[tmc]);
+  tmc_config[tmc].drvctl.INTPOL = (value == TMC_MRES_16) ? TMC_INTPOL_ON : TMC_INTPOL_OFF;
+  tmc_update(tmc);
+  return SPI_OK;
+}
+
+// Function: tmc_max_shift
+//
+// How many times coarser than the base resolution the driver can step.
+uint8_t tmc_max_shift(uint8_t tmc)
+{
+  return TMC_MRES_1 - tmc_base_mres[tmc];
+}
+
+static void tmc_block_cb(spi_job_t *job)
+{
+  tmc_block_writes[job->tag]--;
+}
+
+// Function: tmc_block_write
+//
+// Queues a register write for a block about to start, from the step ISR,
+// unless the driver already holds the value. Does not wait for room or
+// touch tmc_config[]: returns SPI_ERR if the queue is full, and the caller
+// keeps the config in step on success. tmc_block_pending() tells when the
+// writes have gone out.
+HAL_RAMFUNC uint8_t tmc_block_write(uint8_t tmc, uint32_t tx_data)
+{
+  uint8_t reg = TMC_REG_INDEX(tx_data);
+
+  if ( (tmc_shadow_valid[tmc] & (1 << reg)) && (tmc_shadow[tmc][reg] == tx_data) ) {
+    return SPI_OK;
+  }
+  tmc_block_writes[tmc]++;
+  if (tmc_send_async(tmc, tx_data, tmc_block_cb, 0) == SPI_ERR) {
+    tmc_block_writes[tmc]--;
+    return SPI_ERR;
+  }
+  return SPI_OK;
+}
+
+// True while writes from tmc_block_write() are still queued
+HAL_RAMFUNC uint8_t tmc_block_pending(uint8_t tmc)
+{
+  return tmc_block_writes[tmc] != 0;
+}
+
+// Function: tmc_set_step_shift
+//
+// Sets the driver to 2^shift base microsteps per STEP edge. INTPOL is used
+// whenever the result is 1/16, so the driver still moves in 1/256 steps.
+// Only the changed DRVCTL is queued, so this is cheap to call per block and
+// safe from the step ISR. Returns SPI_ERR if the write could not be queued;
+// tmc_block_pending() tells when a queued one has gone out.
+HAL_RAMFUNC uint8_t tmc_set_step_shift(uint8_t tmc, uint8_t shift)
+{
+  drvctl_t drvctl = tmc_config[tmc].drvctl;
+
+  drvctl.MRES = tmc_base_mres[tmc] + shift;
+  if (drvctl.MRES > TMC_MRES_1) {
+    drvctl.MRES = TMC_MRES_1;
+  }
+  drvctl.INTPOL = (drvctl.MRES == TMC_MRES_16) ? TMC_INTPOL_ON : TMC_INTPOL_OFF;
+
+  if (tmc_block_write(tmc, drvctl.raw) == SPI_ERR) {
+    return SPI_ERR;
+  }
+  tmc_config[tmc].drvctl = drvctl;
+  return SPI_OK;
+}
+
+// Base microsteps moved by one STEP edge at the driver's current setting
+int32_t tmc_step_size(uint8_t tmc)
+{
+  return 1 << (tmc_config[tmc].drvctl.MRES - tmc_base_mres[tmc]);
 }
 
 // set fwd/rev direction depending on axis polarity
-void tmc_set_dir(uint8_t tmc, uint8_t dir) {
+HAL_RAMFUNC void tmc_set_dir(uint8_t tmc, uint8_t dir) {
   if (tmc_axis_conf[tmc] == TMC_POLARITY_NORMAL) {
     if (dir == TMC_FWD) {
       gpio_high(tmc_pins[tmc].dir_port, tmc_pins[tmc].dir_pin);
@@ -185,7 +477,7 @@ void tmc_set_dir(uint8_t tmc, uint8_t dir) {
 }
 
 // returns TMC_FWD / TMC_REV depending on polarity and dir pin
-int8_t tmc_get_dir(uint8_t tmc) {
+HAL_RAMFUNC int8_t tmc_get_dir(uint8_t tmc) {
   if ( gpio_get_output(tmc_pins[tmc].dir_port, tmc_pins[tmc].dir_pin) ) {
     return (tmc_axis_conf[tmc] == TMC_POLARITY_NORMAL) ? TMC_FWD : TMC_REV;
   } else {
@@ -12,6 +12,8 @@
 #include "msp432p401r.h"
 #include "fifo.h"
 #include "uart.h"
+#include "clock.h"
+#include "profile.h"
 
 #define UART_TX_READY (EUSCI_A0->IFG & EUSCI_A_IFG_TXIFG)
 #define UART_IRQ_DISABLE (EUSCI_A0->IE &= ~(EUSCI_A_IE_TXIE|EUSCI_A_IE_RXIE))
@@ -23,7 +25,7 @@ fifo_t tx_fifo;
 // Function: uart_init
 //
 // Initializes the EUSCI A0 as a basic UART in 8n1 mode at 57.6K baud.
-// Current configuration expectes a processor clock of 3MHz.
+// Baud rate dividers are derived from CLOCK_SMCLK_HZ (see clock.h).
 //
 // Also initializes UART FIFOs for queued transmissions.
 //
@@ -39,24 +41,22 @@ void uart_init(void)
   // Reset device before configuration
   EUSCI_A0->CTLW0 |= EUSCI_A_CTLW0_SWRST;
 
-  // UART Clock = SMCLK (low-speed subsystem master clock) = 3MHz
+  // UART Clock = SMCLK (low-speed subsystem master clock)
   EUSCI_A0->CTLW0 = EUSCI_A_CTLW0_SSEL__SMCLK | EUSCI_A_CTLW0_SWRST;
 
   // Baud rate calculation
   //   See MSP432P4xx TRM section 22.3.10
-  //   baud_clock/baud_rate = 3MHz/57600 = 52.0833  > 16 (so use oversampling)
-  //   52.083 / 16  = 3.255 -> BRW = 3
-  //   3.255-3 * 16 = 4     -> BRF = 4
+  //   baud_clock/baud_rate = 24MHz/57600 = 416.67 > 16 (so use oversampling)
+  //   417 / 16 = 26 -> BRW = 26
+  //   417 % 16 = 1  -> BRF = 1
   // Calculator: http://processors.wiki.ti.com/index.php/USCI_UART_Baud_Rate_Gen_Mode_Selection
-  //EUSCI_A0->BRW = 3;
-  EUSCI_A0->BRW = 26;
+  EUSCI_A0->BRW = CLOCK_UART_BRW;
 
   // MCTLW
-  //   BRF = 4  (bits 7-4)
-  //   BRS = 0  (bits 15-8)
-  //   OS16 = 1 (bit0)
-  //EUSCI_A0->MCTLW = EUSCI_A_MCTLW_OS16 | (4<<EUSCI_A_MCTLW_BRF_OFS);
-  EUSCI_A0->MCTLW = EUSCI_A_MCTLW_OS16 | (1<<EUSCI_A_MCTLW_BRF_OFS);
+  //   BRF       (bits 7-4)
+  //   BRS = 0   (bits 15-8)
+  //   OS16 = 1  (bit0)
+  EUSCI_A0->MCTLW = EUSCI_A_MCTLW_OS16 | (CLOCK_UART_BRF<<EUSCI_A_MCTLW_BRF_OFS);
 
   // clear reset to enable UART
   EUSCI_A0->CTLW0 &= ~EUSCI_A_CTLW0_SWRST;
@@ -96,77 +96,9 @@ void uart_prime_tx(void) {
   UART_IRQ_ENABLE;;
 }
 
-// Function: uart_queue
-//
-// Queues a character for UART transmission
-void uart_queue(char c) {
-  fifo_push(&tx_fifo, c);
-  uart_prime_tx();
-}
-
-// Function: uart_queue_str
-//
-// Queues a null-terminated string for UART transmission
-void uart_queue_str(char *str) {
-  while(*str != 0) {
-    fifo_push(&tx_fifo, *str);
-    str++;
-  }
-  uart_prime_tx();
-}
-
-// Function: uart_queue
-//
-// Queues a character for UART transmission
-void uart_queue_uint8(uint8_t byte) {
-  fifo_push(&tx_fifo, NIBBLE_TO_ASCII(byte>>4));
-  fifo_push(&tx_fifo, NIBBLE_TO_ASCII(byte&0xf));
-  uart_prime_tx();
-}
-
-void uart_queue_hex(uint32_t val, uint8_t bits)
-{
-  val &= ~((~0L)<<bits); // remove any extraneous bits
-  // round to nearest nibble (multiple of 4)
-  if(bits&0x3) {
-    bits = (bits& ~(0x3)) + 4;
-  }
-  while(bits > 0) {
-    bits -= 4;
-    fifo_push(&tx_fifo, NIBBLE_TO_ASCII( (val>>bits) & 0xf));
-  }
-  uart_prime_tx();
-}
-
-void uart_queue_dec(uint32_t val) {
-  char buf[11];  // max uint_32 is 10 digits
-  uint8_t i = 10;
-
-  buf[i] = '\0';
-  do {
-    i--;
-    buf[i] = '0' + (val % 10);
-    val /= 10;
-  } while (val != 0);
-  uart_queue_str(&buf[i]);
-}
-
-void uart_queue_sdec(int32_t val) {
-
-  if (val < 0) {
-    uart_queue('-');
-    uart_queue_dec(-val);
-  } else {
-    uart_queue_dec(val);
-  }
-}
-
-void uart_flush(void) {
-  while(tx_fifo.count);
-}
-
 void EUSCIA0_IRQHandler(void)
 {
+  uint32_t start = hal_cycles();
   // FXIFG automatically cleared on read from RXBUF
   // TXIFG automatically cleared on write to TXBUF
   uint8_t flags = EUSCI_A0->IFG;
@@ -188,4 +120,6 @@ void EUSCIA0_IRQHandler(void)
       EUSCI_A0->IE &= ~EUSCI_A_IE_TXIE;
     }
   }
+
+  prof_isr(PROF_UART, start, PROF_NO_LATENCY);
 }
@@ -0,0 +1,82 @@
+// File       : uart_queue.c
+// Author     : Jeff Schornick
+//
+// Queued and formatted UART output. Characters go into tx_fifo and the
+// backend (uart.c, or src/host/uart_host.c) is primed to send them.
+//
+// Compilation: GCC cross compiler for ARM, v4.9.3+
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include <stddef.h>
+#include "fifo.h"
+#include "uart.h"
+
+// Function: uart_queue
+//
+// Queues a character for UART transmission
+void uart_queue(char c) {
+  fifo_push(&tx_fifo, c);
+  uart_prime_tx();
+}
+
+// Function: uart_queue_str
+//
+// Queues a null-terminated string for UART transmission
+void uart_queue_str(char *str) {
+  while(*str != 0) {
+    fifo_push(&tx_fifo, *str);
+    str++;
+  }
+  uart_prime_tx();
+}
+
+// Function: uart_queue
+//
+// Queues a character for UART transmission
+void uart_queue_uint8(uint8_t byte) {
+  fifo_push(&tx_fifo, NIBBLE_TO_ASCII(byte>>4));
+  fifo_push(&tx_fifo, NIBBLE_TO_ASCII(byte&0xf));
+  uart_prime_tx();
+}
+
+void uart_queue_hex(uint32_t val, uint8_t bits)
+{
+  val &= ~((~0L)<<bits); // remove any extraneous bits
+  // round to nearest nibble (multiple of 4)
+  if(bits&0x3) {
+    bits = (bits& ~(0x3)) + 4;
+  }
+  while(bits > 0) {
+    bits -= 4;
+    fifo_push(&tx_fifo, NIBBLE_TO_ASCII( (val>>bits) & 0xf));
+  }
+  uart_prime_tx();
+}
+
+void uart_queue_dec(uint32_t val) {
+  char buf[11];  // max uint_32 is 10 digits
+  uint8_t i = 10;
+
+  buf[i] = '\0';
+  do {
+    i--;
+    buf[i] = '0' + (val % 10);
+    val /= 10;
+  } while (val != 0);
+  uart_queue_str(&buf[i]);
+}
+
+void uart_queue_sdec(int32_t val) {
+
+  if (val < 0) {
+    uart_queue('-');
+    uart_queue_dec(-val);
+  } else {
+    uart_queue_dec(val);
+  }
+}
+
+void uart_flush(void) {
+  while(tx_fifo.count);
+}
@@ -0,0 +1,25 @@
+G00 X600 Y500
+G03 X571 Y571 I-100 J0 F200
+G03 X500 Y600 I-71 J-71
+G03 X429 Y571 I0 J-100
+G03 X400 Y500 I71 J-71
+G03 X429 Y429 I100 J0
+G03 X500 Y400 I71 J71
+G03 X571 Y429 I0 J100
+G03 X600 Y500 I-71 J71
+G02 X571 Y429 I-100 J0
+G02 X500 Y400 I-71 J71
+G02 X429 Y429 I0 J100
+G02 X400 Y500 I71 J71
+G02 X429 Y571 I100 J0
+G02 X500 Y600 I71 J-71
+G02 X571 Y571 I0 J-100
+G02 X600 Y500 I-71 J-71
+G03 X500 Y400 I-100 J0 F250
+G02 X429 Y571 I0 J100
+G03 X429 Y571 I71 J-71
+G02 X429 Y571 I71 J-71
+G02 X549 Y571 I60 J80 F300
+G03 X559 Y571 I5 J0
+G02 X549 Y571 I-5 J0
+G00 X0 Y0
@@ -0,0 +1,11 @@
+G01 X400 F300
+G01 Y300 F250
+G01 X0 F400
+G01 Y0
+G01 X300 Y100 F300
+G01 X400 Y400
+G01 X100 Y500 F200
+G01 X0 Y0 Z60 F300
+G01 Z0 F200
+G00 X200 Y200 Z20
+G00 X0 Y0 Z0
@@ -0,0 +1,5 @@
+G01 X2500 Y600 F2500
+G01 X0 Y1500 F2000
+G00 Y0 Z1000
+G01 X1800 Y1800 Z0 F2500
+G00 X0 Y0
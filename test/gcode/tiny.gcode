@@ -0,0 +1,36 @@
+G01 X10 Y10 F200
+G01 X11 Y10
+G01 X11 Y11
+G01 X12 Y12
+G01 X14 Y13
+G01 X15 Y15
+G01 X18 Y15
+G01 X18 Y18
+G01 X21 Y21
+G01 X20 Y21
+G01 X20 Y20
+G01 X19 Y19
+G01 X17 Y20
+G01 X18 Y18
+G01 X20 Y20
+G01 X17 Y19
+G01 X18 Y19
+G01 X18 Y20
+G01 X19 Y21
+G01 X21 Y22
+G01 X22 Y24
+G01 X25 Y24
+G01 X25 Y27
+G01 X28 Y30
+G01 X27 Y30
+G01 X27 Y29
+G01 X26 Y28
+G01 X24 Y29
+G01 X25 Y27
+G01 X27 Y29
+G01 X24 Y28
+G01 Z2
+G01 Z0
+G02 X28 Y28 I2 J0
+G03 X28 Y28 I-1 J1
+G00 X0 Y0
@@ -0,0 +1,74 @@
+// File       : test.h
+// Author     : Jeff Schornick
+//
+// Host unit tests, see `make test`
+//
+// Tests are plain functions listed in test_main.c. Each starts from
+// test_reset(), which initializes the firmware modules as main() in cnc.c
+// does, and reports failures through CHECK() without stopping.
+//
+// test_run_ms() advances a virtual clock driving the step timer handlers
+// (all STEP_BACKENDs, as the simulator does), the coil timer, SysTick and
+// the main loop work (control_poll). Simulated TMC26x drivers answer on
+// the host SPI bus and follow the STEP/DIR pins.
+//
+// Compilation: host GCC, see `make test`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#ifndef __TEST_H
+#define __TEST_H
+
+#include <stdint.h>
+#include "tmc.h"
+
+extern uint32_t test_failures;
+
+#define CHECK(cond) test_check((cond) ? 1 : 0, #cond, __FILE__, __LINE__)
+#define CHECK_EQ(a, b) test_check_eq((int64_t) (a), (int64_t) (b), #a, #b, __FILE__, __LINE__)
+
+void test_check(uint8_t ok, const char *expr, const char *file, int line);
+void test_check_eq(int64_t a, int64_t b, const char *expr_a, const char *expr_b,
+                   const char *file, int line);
+
+// Virtual clock (test_clock.c)
+#define TEST_ACLK_HZ 32768
+
+extern uint64_t test_aclk;   // ACLK ticks since test_reset()
+extern uint32_t test_ms;     // SysTick ms since test_reset()
+extern uint32_t test_poll_ms;  // main loop period, 1 unless a test slows it
+
+void test_reset(void);
+void test_run_ms(uint32_t ms);
+
+// Simulated TMC26x drivers (test_tmc.c), indexed as tmc_pins[]
+#define TEST_TMC_LOG 4096
+#define TEST_TMC_STST_ACLK 2294  // 2^20 TMC clocks without a step, ~70 ms
+#define TEST_TMC_EDGES 8192
+
+typedef struct {
+  uint32_t reg[TMC_REG_COUNT];  // last datagram written to each register
+  uint8_t rdsel;                // reading the next response carries
+  uint8_t step;                 // last seen STEP and DIR levels
+  uint8_t dir;
+  int32_t position;             // base microsteps moved by STEP/DIR
+  uint16_t sg;                  // SG10 reading while not against the wall
+  uint8_t faults;               // TMC_STAT_* fault flags reported, tests set them
+  int8_t wall_side;             // -1/+1: stalls at or past wall, 0: no wall
+  int32_t wall;
+  uint64_t step_aclk;           // last STEP edge, for STST
+  uint8_t stepped;              // set at the first STEP edge, tests clear it
+  uint32_t reg_stepped[TMC_REG_COUNT];  // registers as of that edge
+  uint32_t edges;               // counted STEP edges, the first TEST_TMC_EDGES kept
+  uint64_t edge_aclk[TEST_TMC_EDGES];
+  int16_t edge_move[TEST_TMC_EDGES];    // base microsteps moved
+  uint32_t logged;              // datagrams received, the first TEST_TMC_LOG kept
+  uint32_t log[TEST_TMC_LOG];
+} test_tmc_t;
+
+extern test_tmc_t test_tmc[3];
+
+void test_tmc_reset(void);
+void test_tmc_sync(void);
+void test_tmc_sample(void);
+
+#endif /* __TEST_H */
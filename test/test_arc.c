@@ -0,0 +1,103 @@
+// File       : test_arc.c
+// Author     : Jeff Schornick
+//
+// Arcs on the simulated drivers: starting in every octant, both ways round
+// and over several sweeps, each ends exactly at its end point and every
+// step stays on the circle.
+//
+// Compilation: host GCC, see `make test`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include <math.h>
+#include <stdlib.h>
+#include "tmc.h"
+#include "motion.h"
+#include "test.h"
+
+#define ARC_TEST_PI 3.14159265358979
+#define ARC_TEST_R 60
+#define ARC_TEST_RATE 1000
+
+// Runs one arc from a fresh edge log, returns 0 if it did not finish
+static uint8_t run_arc(int32_t dx, int32_t dy, int32_t i, int32_t j, int8_t rot)
+{
+  uint32_t ms = 0;
+  uint8_t k;
+
+  for(k=0; k<3; k++) {
+    test_tmc[k].edges = 0;
+  }
+  next_motion = new_arc_motion(dx, dy, i, j, rot, ARC_TEST_RATE, 1);
+  motion_start();
+  while ( (motion || next_motion) && (ms++ < 10000) ) {
+    test_run_ms(1);
+  }
+  return !motion && !next_motion;
+}
+
+// Largest distance from the circle of radius r around (cx, cy), walking the
+// X and Y edges in time order from (x, y)
+static double arc_deviation(int32_t x, int32_t y, int32_t cx, int32_t cy, double r)
+{
+  test_tmc_t *tx = &test_tmc[X_AXIS];
+  test_tmc_t *ty = &test_tmc[Y_AXIS];
+  uint32_t nx = 0;
+  uint32_t ny = 0;
+  double d;
+  double worst = 0;
+
+  while ( (nx < tx->edges) || (ny < ty->edges) ) {
+    if ( (ny >= ty->edges) || ((nx < tx->edges) && (tx->edge_aclk[nx] <= ty->edge_aclk[ny])) ) {
+      x += tx->edge_move[nx++];
+    } else {
+      y += ty->edge_move[ny++];
+    }
+    d = fabs(hypot(x - cx, y - cy) - r);
+    if (d > worst) {
+      worst = d;
+    }
+  }
+  return worst;
+}
+
+void test_arc_ends(void)
+{
+  static const uint8_t sweeps[] = {1, 3, 6, 8};  // eighths of a turn
+  int32_t sx, sy, ex, ey;
+  int32_t x, y;
+  int32_t step;
+  double a, b;
+  uint8_t oct, n;
+  int8_t rot;
+
+  for(oct=0; oct<8; oct++) {
+    for(n=0; n<sizeof(sweeps); n++) {
+      for(rot=-1; rot<=1; rot+=2) {
+        // start just past the octant's first edge, relative to the center
+        a = (oct + 0.3) * ARC_TEST_PI / 4;
+        b = a + rot * sweeps[n] * ARC_TEST_PI / 4;
+        sx = lround(ARC_TEST_R * cos(a));
+        sy = lround(ARC_TEST_R * sin(a));
+        ex = (sweeps[n] == 8) ? sx : lround(ARC_TEST_R * cos(b));
+        ey = (sweeps[n] == 8) ? sy : lround(ARC_TEST_R * sin(b));
+
+        x = test_tmc[X_AXIS].position;
+        y = test_tmc[Y_AXIS].position;
+        CHECK(run_arc(ex - sx, ey - sy, -sx, -sy, rot));
+        CHECK_EQ(test_tmc[X_AXIS].position - x, ex - sx);
+        CHECK_EQ(test_tmc[Y_AXIS].position - y, ey - sy);
+        // aligned arcs are planned in coarser steps
+        step = abs(test_tmc[X_AXIS].edge_move[0]);
+        CHECK(arc_deviation(x, y, x - sx, y - sy, hypot(sx, sy)) <= 1.5 * step);
+        // a full circle goes all the way round
+        if (sweeps[n] == 8) {
+          CHECK(test_tmc[X_AXIS].edges * step >= 4 * (ARC_TEST_R - 1));
+        }
+      }
+    }
+  }
+  CHECK_EQ(pos[X_AXIS], test_tmc[X_AXIS].position);
+  CHECK_EQ(pos[Y_AXIS], test_tmc[Y_AXIS].position);
+  CHECK_EQ(test_tmc[Z_AXIS].edges, 0);
+}
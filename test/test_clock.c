@@ -0,0 +1,147 @@
+// File       : test_clock.c
+// Author     : Jeff Schornick
+//
+// Virtual clock for the host unit tests
+//
+// Runs the step timer one ACLK tick at a time, dispatching its handlers
+// for the configured STEP_BACKEND the way cnc_sim does: per-axis compare
+// matches ahead of the block clock, armed compare outputs at the match,
+// DMA frames at each wrap while streaming. Every millisecond the coil
+// timer catches up and SysTick fires, and every test_poll_ms the main loop
+// work runs once.
+//
+// Compilation: host GCC, see `make test`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include "hal.h"
+#include "uart.h"
+#include "timer.h"
+#include "tmc.h"
+#include "coil.h"
+#include "gcode.h"
+#include "motion.h"
+#include "stepper.h"
+#include "homing.h"
+#include "drive.h"
+#include "control.h"
+#include "test.h"
+
+uint64_t test_aclk;
+uint32_t test_ms;
+uint32_t test_poll_ms;
+
+static uint64_t step_at;     // ACLK tick of the next step timer wrap
+static uint32_t coil_frac;   // SMCLK cycles toward the next coil update
+
+// Function: test_reset
+//
+// Discards any motion left by a previous test, powers up fresh simulated
+// drivers and initializes the modules in the order of main() in cnc.c.
+void test_reset(void)
+{
+  uint8_t i;
+
+  motion_abort();
+  for(i=0; i<3; i++) {
+    coil_enable(i, 0);
+    pos[i] = 0;
+  }
+  motion_inhibit = 0;
+  homing_state = HOMING_IDLE;
+
+  test_aclk = 0;
+  test_ms = 0;
+  test_poll_ms = 1;
+  systick_ms = 0;
+  step_at = 0;
+  coil_frac = 0;
+
+  test_tmc_reset();
+  uart_init();
+  timer_init();
+  coil_init();
+  init_parser();
+  tmc_init();
+  stepper_init();
+  drive_init();
+  test_tmc_sync();
+}
+
+// Step timer handlers due at test_aclk
+static void test_step_tick(void)
+{
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+  uint8_t i;
+
+  for(i=0; i<3; i++) {
+    if (timer_host_axis_ie[i] && (timer_host_axis_at[i] == test_aclk)) {
+      timer_host_aclk = test_aclk;
+      timer_host_axis_match(i);
+      test_tmc_sample();
+    }
+  }
+#endif
+
+  // up mode, a timer stopped by CCR0 = 0 restarts from the next tick
+  if (!timer_host_step_ccr || (step_at < test_aclk)) {
+    step_at = test_aclk + 1;
+    return;
+  }
+  if (step_at != test_aclk) {
+    return;
+  }
+
+#if STEP_BACKEND == STEP_BACKEND_DMA
+  if (timer_host_dma_on) {
+    timer_host_dma_match();
+    test_tmc_sample();
+    if (timer_host_dma_irq) {
+      DMA_INT3_IRQHandler();
+    }
+  } else if (timer_host_step_ie) {
+    TA1_0_IRQHandler();
+  }
+#else
+  if (timer_host_step_ie) {
+    timer_host_step_match();
+    test_tmc_sample();
+    timer_host_aclk = test_aclk;
+    TA1_0_IRQHandler();
+  }
+#endif
+  // the handlers may have changed CCR0 for the period just begun
+  step_at += timer_host_step_ccr + 1;
+  test_tmc_sample();
+}
+
+// Function: test_run_ms
+//
+// Advances virtual time by `ms` milliseconds.
+void test_run_ms(uint32_t ms)
+{
+  uint64_t end;
+
+  while (ms--) {
+    test_ms++;
+    end = (uint64_t) test_ms * TEST_ACLK_HZ / 1000;
+    while (test_aclk < end) {
+      test_aclk++;
+      test_step_tick();
+    }
+
+    coil_frac += COIL_SMCLK / 1000;
+    while (coil_frac >= (uint32_t) timer_host_coil_ccr + 1) {
+      coil_frac -= timer_host_coil_ccr + 1;
+      if (timer_host_coil_ie) {
+        TA2_0_IRQHandler();
+      }
+    }
+
+    SysTick_Handler();
+    if (test_ms % test_poll_ms == 0) {
+      control_poll();
+    }
+    test_tmc_sample();
+  }
+}
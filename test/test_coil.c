@@ -0,0 +1,126 @@
+// File       : test_coil.c
+// Author     : Jeff Schornick
+//
+// SPI coil drive: the DRVCTL datagrams a driver receives over an
+// electrical cycle, decoded into signed coil currents.
+//
+// Compilation: host GCC, see `make test`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include <math.h>
+#include "tmc.h"
+#include "motion.h"
+#include "coil.h"
+#include "test.h"
+
+#define COIL_CYCLE 1024
+#define COIL_TEST_PI 3.14159265358979
+
+// Signed coil currents carried by an SPI-mode DRVCTL datagram
+static void coil_currents(uint32_t data, int32_t *a, int32_t *b)
+{
+  drvctl_spi_t drvctl;
+
+  drvctl.raw = data;
+  *a = drvctl.PHA ? -(int32_t) drvctl.CA : drvctl.CA;
+  *b = drvctl.PHB ? -(int32_t) drvctl.CB : drvctl.CB;
+}
+
+// Coil A follows sine and coil B cosine of the phase, within a count
+static void check_currents(uint32_t data, int32_t phase)
+{
+  double angle = 2 * COIL_TEST_PI * (phase & (COIL_CYCLE - 1)) / COIL_CYCLE;
+  int32_t a, b;
+
+  CHECK_EQ(TMC_REG_INDEX(data), TMC_REG_DRVCTL);
+  coil_currents(data, &a, &b);
+  CHECK(fabs(a - COIL_AMPLITUDE * sin(angle)) <= 1.0);
+  CHECK(fabs(b - COIL_AMPLITUDE * cos(angle)) <= 1.0);
+}
+
+// Table and signs over a full cycle, exact at the quadrant boundaries
+void test_coil_table(void)
+{
+  static const int32_t quadrant[4][2] = {
+    { 0, COIL_AMPLITUDE }, { COIL_AMPLITUDE, 0 }, { 0, -COIL_AMPLITUDE }, { -COIL_AMPLITUDE, 0 },
+  };
+  int32_t phase;
+  int32_t a, b;
+  uint8_t q;
+
+  for(phase=0; phase<COIL_CYCLE; phase++) {
+    check_currents(coil_datagram(phase), phase);
+  }
+  for(q=0; q<4; q++) {
+    phase = q * COIL_CYCLE / 4;
+    coil_currents(coil_datagram(phase), &a, &b);
+    CHECK_EQ(a, quadrant[q][0]);
+    CHECK_EQ(b, quadrant[q][1]);
+
+    // just either side of the boundary the signs follow the quadrants
+    coil_currents(coil_datagram(phase - 1), &a, &b);
+    CHECK_EQ(a < 0, (q == 0) || (q == 3));
+    CHECK_EQ(b < 0, (q == 2) || (q == 3));
+    coil_currents(coil_datagram(phase + 1), &a, &b);
+    CHECK_EQ(a < 0, (q == 2) || (q == 3));
+    CHECK_EQ(b < 0, (q == 1) || (q == 2));
+  }
+  // whole cycles wrap, negative phases included
+  CHECK_EQ(coil_datagram(-1), coil_datagram(COIL_CYCLE - 1));
+  CHECK_EQ(coil_datagram(COIL_CYCLE + 5), coil_datagram(5));
+}
+
+// Runs one electrical cycle at `velocity` and checks what the driver got:
+// every phase in order, each as a sine/cosine pair
+static void run_cycle(int32_t velocity)
+{
+  test_tmc_t *dev = &test_tmc[X_AXIS];
+  int32_t dir = (velocity > 0) ? 1 : -1;
+  int32_t phase = 0;
+  uint32_t first;
+  uint32_t ms = 0;
+  uint32_t i;
+  drvconf_t drvconf;
+
+  first = dev->logged;
+  coil_enable(X_AXIS, 1);
+  drvconf.raw = dev->reg[TMC_REG_DRVCONF];
+  CHECK_EQ(drvconf.SDOFF, TMC_SD_OFF);
+
+  coil_set_velocity(X_AXIS, velocity);
+  while ( (coil_phase[X_AXIS] * dir < COIL_CYCLE) && (ms++ < 10000) ) {
+    test_run_ms(1);
+  }
+  coil_set_velocity(X_AXIS, 0);
+  test_run_ms(10);
+  CHECK(coil_phase[X_AXIS] * dir >= COIL_CYCLE);
+
+  CHECK(dev->logged <= TEST_TMC_LOG);
+  for(i=first; (i<dev->logged) && (i<TEST_TMC_LOG); i++) {
+    if (TMC_REG_INDEX(dev->log[i]) != TMC_REG_DRVCTL) {
+      continue;
+    }
+    check_currents(dev->log[i], phase);
+    CHECK_EQ(dev->log[i], coil_datagram(phase));
+    phase += dir;
+  }
+  // the enabling datagram plus one per phase step, ending where it stopped
+  CHECK_EQ(phase, coil_phase[X_AXIS] + dir);
+  CHECK_EQ(pos[X_AXIS], coil_phase[X_AXIS] >> tmc_base_mres[X_AXIS]);
+
+  coil_enable(X_AXIS, 0);
+  drvconf.raw = dev->reg[TMC_REG_DRVCONF];
+  CHECK_EQ(drvconf.SDOFF, TMC_SD_ON);
+  CHECK_EQ(dev->reg[TMC_REG_DRVCTL], tmc_config[X_AXIS].drvctl.raw);
+}
+
+void test_coil_forward(void)
+{
+  run_cycle(2048);
+}
+
+void test_coil_reverse(void)
+{
+  run_cycle(-2048);
+}
@@ -0,0 +1,93 @@
+// File       : test_drive.c
+// Author     : Jeff Schornick
+//
+// Velocity bands and hold current: each block's chopper and current
+// settings must reach the driver before its first step.
+//
+// Compilation: host GCC, see `make test`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include "tmc.h"
+#include "motion.h"
+#include "drive.h"
+#include "test.h"
+
+// CSCALE for a percentage of the run current, as drive.c scales it
+static uint8_t scale(uint8_t tmc, uint8_t pct)
+{
+  uint32_t cs = ((drive_run_cs[tmc] + 1) * pct) / 100;
+
+  if (cs < 1) {
+    cs = 1;
+  } else if (cs > 32) {
+    cs = 32;
+  }
+  return cs - 1;
+}
+
+// Runs a single X move to completion, returns 0 if it did not finish
+static uint8_t run_move(int32_t x, uint16_t rate)
+{
+  uint32_t ms = 0;
+
+  test_tmc[X_AXIS].stepped = 0;
+  next_motion = new_linear_motion(x, 0, 0, rate, 1);
+  motion_start();
+  while ( (motion || next_motion) && (ms++ < 10000) ) {
+    test_run_ms(1);
+  }
+  return !motion && !next_motion;
+}
+
+// The band in effect at the first step, and the driver current
+static void check_band(uint8_t band)
+{
+  test_tmc_t *dev = &test_tmc[X_AXIS];
+  chopconf_t chopconf;
+  sgcsconf_t sgcsconf;
+
+  CHECK(dev->stepped);
+  chopconf.raw = dev->reg_stepped[TMC_REG_CHOPCONF];
+  CHECK_EQ(chopconf.CHM, drive_bands[band].chm);
+  CHECK_EQ(chopconf.TBL, drive_bands[band].tbl);
+  CHECK_EQ(chopconf.TOFF, drive_bands[band].toff);
+  CHECK_EQ(chopconf.HSTRT, drive_bands[band].hstrt);
+  CHECK_EQ(chopconf.HEND, drive_bands[band].hend);
+  sgcsconf.raw = dev->reg_stepped[TMC_REG_SGCSCONF];
+  CHECK_EQ(sgcsconf.CSCALE, scale(X_AXIS, drive_bands[band].current_pct));
+  CHECK_EQ(dev->reg_stepped[TMC_REG_DRVCTL], tmc_config[X_AXIS].drvctl.raw);
+  CHECK_EQ(dev->reg[TMC_REG_CHOPCONF], tmc_config[X_AXIS].chopconf.raw);
+}
+
+void test_drive_bands(void)
+{
+  uint32_t y_chopconf = test_tmc[Y_AXIS].reg[TMC_REG_CHOPCONF];
+  sgcsconf_t sgcsconf;
+  uint8_t i;
+
+  // a main loop busy elsewhere must not delay the settings
+  test_poll_ms = 20;
+
+  CHECK(run_move(4000, drive_bands[DRIVE_BANDS-1].min_rate + 100));
+  check_band(DRIVE_BANDS-1);
+  CHECK_EQ(test_tmc[X_AXIS].position, 4000);
+  CHECK_EQ(pos[X_AXIS], 4000);
+  // axes that did not move keep their settings
+  CHECK_EQ(test_tmc[Y_AXIS].reg[TMC_REG_CHOPCONF], y_chopconf);
+
+  CHECK(run_move(-400, drive_bands[1].min_rate));
+  check_band(1);
+
+  // idle: hold current once the drivers report standstill
+  test_run_ms(drive_hold_ms + 200);
+  for(i=0; i<3; i++) {
+    sgcsconf.raw = test_tmc[i].reg[TMC_REG_SGCSCONF];
+    CHECK_EQ(sgcsconf.CSCALE, scale(i, drive_hold_pct));
+  }
+
+  // the next block starts at its run current
+  CHECK(run_move(-100, 50));
+  check_band(0);
+  CHECK_EQ(test_tmc[X_AXIS].position, 3500);
+}
@@ -0,0 +1,86 @@
+// File       : test_duration.c
+// Author     : Jeff Schornick
+//
+// Linear move durations: over a sweep of lengths and feeds, a block's step
+// table lasts its planned length / rate to within one step timer tick, so
+// rounding never adds up over the steps of a move.
+//
+// Compilation: host GCC, see `make test`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include "timer.h"
+#include "motion.h"
+#include "stepper.h"
+#include "test.h"
+
+#define DURATION_MOVES 9
+#define DURATION_RATES 9
+
+static const int32_t duration_moves[DURATION_MOVES][3] = {  // X, Y, Z
+  {1, 0, 0},
+  {5, 3, 0},
+  {0, 0, -64},
+  {100, 0, 0},
+  {0, 250, 17},
+  {-333, 200, -50},
+  {1000, -1, 2},
+  {-3000, 4000, 0},
+  {150000, 47123, 0},  // tables past 16 bits of entries
+};
+
+static const uint16_t duration_rates[DURATION_RATES] = {
+  10, 37, 100, 250, 399, 400, 401, 1000, 2000
+};
+
+// Step timer ticks from the block start to the end of its last entry
+static uint64_t duration_ticks(motion_t *block)
+{
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+  return block->ticks;
+#else
+  uint64_t ticks = 0;
+  uint32_t n;
+
+  for(n=0; n<block->count; n++) {
+    ticks += (uint64_t) (block->steps[n].timer_ticks + 1) * (block->steps[n].repeat + 1);
+  }
+  return ticks;
+#endif
+}
+
+void test_duration_sweep(void)
+{
+  const int32_t *m;
+  motion_t *block;
+  int64_t dx, dy, dz;
+  int64_t d;
+  int64_t err;
+  uint32_t rate;
+  uint8_t b, r;
+
+  for(b=0; b<DURATION_MOVES; b++) {
+    m = duration_moves[b];
+    for(r=0; r<DURATION_RATES; r++) {
+      block = new_linear_motion(m[0], m[1], m[2], duration_rates[r], 1);
+      CHECK(block != 0);
+      if (!block) {
+        continue;
+      }
+
+      // the block's length in its own steps, whole steps as planned
+      dx = m[0] >> block->shift;
+      dy = m[1] >> block->shift;
+      dz = m[2] >> block->shift;
+      d = (int64_t) sqrtl(dx*dx + dy*dy + dz*dz);
+      rate = duration_rates[r] >> block->shift;
+
+      // |ticks - d * STEP_TIMER_HZ / rate| <= 1
+      err = (int64_t) duration_ticks(block) * rate - d * STEP_TIMER_HZ;
+      CHECK(llabs(err) <= rate);
+      free_motion(block);
+    }
+  }
+}
@@ -0,0 +1,86 @@
+// File       : test_homing.c
+// Author     : Jeff Schornick
+//
+// Homing cycle against simulated drivers: each axis runs into a wall that
+// stalls its driver, backs off and is zeroed.
+//
+// Compilation: host GCC, see `make test`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include "tmc.h"
+#include "motion.h"
+#include "homing.h"
+#include "test.h"
+
+#define HOMING_TEST_MS 60000
+
+// Runs the cycle to completion, recording how far each axis went toward
+// its home end
+static void run_homing(int32_t peak[])
+{
+  int32_t travel;
+  uint32_t ms = 0;
+  uint8_t i;
+
+  for(i=0; i<3; i++) {
+    peak[i] = 0;
+  }
+  homing_start();
+  while ( homing_active() && (ms++ < HOMING_TEST_MS) ) {
+    test_run_ms(1);
+    for(i=0; i<3; i++) {
+      travel = test_tmc[i].position * homing_dir[i];
+      if (travel > peak[i] * homing_dir[i]) {
+        peak[i] = test_tmc[i].position;
+      }
+    }
+  }
+}
+
+void test_homing(void)
+{
+  uint32_t sgcsconf[3];
+  int32_t peak[3];
+  int32_t wall;
+  int32_t slack;
+  uint8_t i;
+
+  for(i=0; i<3; i++) {
+    test_tmc[i].wall_side = homing_dir[i];
+    test_tmc[i].wall = homing_dir[i] * (150 + 50 * i);
+    sgcsconf[i] = tmc_config[i].sgcsconf.raw;
+  }
+
+  run_homing(peak);
+  CHECK_EQ(homing_state, HOMING_DONE);
+
+  // a stall is seen at the next StallGuard sample, one poll later at most
+  slack = (int32_t) homing_rate * (2 * HOMING_SAMPLE_MS + 2) / 1000 + 1;
+  for(i=0; i<3; i++) {
+    wall = test_tmc[i].wall * homing_dir[i];
+    CHECK(peak[i] * homing_dir[i] >= wall);
+    CHECK(peak[i] * homing_dir[i] <= wall + slack);
+    CHECK_EQ(test_tmc[i].position, peak[i] - homing_dir[i] * homing_backoff);
+    CHECK_EQ(pos[i], 0);
+    CHECK_EQ(tmc_config[i].sgcsconf.raw, sgcsconf[i]);
+    CHECK_EQ(test_tmc[i].reg[TMC_REG_SGCSCONF], sgcsconf[i]);
+  }
+  CHECK(!motion && !next_motion);
+}
+
+void test_homing_no_stall(void)
+{
+  uint32_t travel = homing_travel;
+  int32_t peak[3];
+
+  homing_travel = 4 * HOMING_SEEK_CHUNK;
+  run_homing(peak);
+  homing_travel = travel;
+
+  CHECK_EQ(homing_state, HOMING_FAILED);
+  CHECK_EQ(test_tmc[Z_AXIS].position, homing_dir[Z_AXIS] * 4 * HOMING_SEEK_CHUNK);
+  CHECK_EQ(pos[Z_AXIS], test_tmc[Z_AXIS].position);
+  CHECK_EQ(test_tmc[X_AXIS].position, 0);
+  CHECK_EQ(test_tmc[Y_AXIS].position, 0);
+}
@@ -0,0 +1,129 @@
+// File       : test_main.c
+// Author     : Jeff Schornick
+//
+// Host unit test runner
+//
+//   cnc_test [-v] [name ...]
+//
+//   -v    echo firmware output (log level from the build)
+//   name  run only these tests
+//
+// Exits non-zero if any check failed.
+//
+// Compilation: host GCC, see `make test`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "hal.h"
+#include "log.h"
+#include "test.h"
+
+void test_homing(void);
+void test_homing_no_stall(void);
+void test_drive_bands(void);
+void test_coil_table(void);
+void test_coil_forward(void);
+void test_coil_reverse(void);
+void test_trace_tables(void);
+void test_arc_ends(void);
+void test_stream_totals(void);
+void test_rapid_ends(void);
+void test_duration_sweep(void);
+void test_rle_tables(void);
+void test_stop_fault(void);
+
+typedef struct {
+  const char *name;
+  void (*run)(void);
+} test_case_t;
+
+static const test_case_t tests[] = {
+  { "homing",          test_homing },
+  { "homing_no_stall", test_homing_no_stall },
+  { "drive_bands",     test_drive_bands },
+  { "coil_table",      test_coil_table },
+  { "coil_forward",    test_coil_forward },
+  { "coil_reverse",    test_coil_reverse },
+  { "trace_tables",    test_trace_tables },
+  { "arc_ends",        test_arc_ends },
+  { "stream_totals",   test_stream_totals },
+  { "rapid_ends",      test_rapid_ends },
+  { "duration_sweep",  test_duration_sweep },
+  { "rle_tables",      test_rle_tables },
+  { "stop_fault",      test_stop_fault },
+};
+
+#define TESTS (sizeof(tests) / sizeof(tests[0]))
+
+uint32_t test_failures;
+
+void test_check(uint8_t ok, const char *expr, const char *file, int line)
+{
+  if (!ok) {
+    printf("  %s:%d: CHECK(%s) failed\n", file, line, expr);
+    test_failures++;
+  }
+}
+
+void test_check_eq(int64_t a, int64_t b, const char *expr_a, const char *expr_b,
+                   const char *file, int line)
+{
+  if (a != b) {
+    printf("  %s:%d: %s == %s failed: %lld != %lld\n", file, line, expr_a, expr_b,
+           (long long) a, (long long) b);
+    test_failures++;
+  }
+}
+
+static uint8_t selected(int argc, char **argv, int first, const char *name)
+{
+  int i;
+
+  if (first >= argc) {
+    return 1;
+  }
+  for(i=first; i<argc; i++) {
+    if (!strcmp(argv[i], name)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t failed = 0;
+  uint32_t ran = 0;
+  uint32_t before;
+  uint8_t verbose = 0;
+  int first = 1;
+  uint32_t i;
+
+  if ( (argc > 1) && !strcmp(argv[1], "-v") ) {
+    verbose = 1;
+    first = 2;
+  }
+
+  for(i=0; i<TESTS; i++) {
+    if (!selected(argc, argv, first, tests[i].name)) {
+      continue;
+    }
+    uart_host_echo = verbose;
+    log_level = verbose ? LOG_LEVEL : LOG_WARN;
+    before = test_failures;
+    test_reset();
+    tests[i].run();
+    ran++;
+    if (test_failures != before) {
+      printf("FAIL %s\n", tests[i].name);
+      failed++;
+    } else {
+      printf("ok   %s\n", tests[i].name);
+    }
+  }
+
+  printf("%u of %u tests failed\n", failed, ran);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,107 @@
+// File       : test_rapid.c
+// Author     : Jeff Schornick
+//
+// Oversampled rapids on the simulated drivers: every axis ends exactly at
+// its target with one STEP edge per step, and the shorter axes' steps are
+// spread over the longest axis' time instead of bunched at the start.
+//
+// Compilation: host GCC, see `make test`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "tmc.h"
+#include "motion.h"
+#include "test.h"
+
+#define RAPID_MOVES 6
+
+typedef struct {
+  int32_t move[3];  // X, Y, Z
+  uint32_t rate;    // rapid_rate for the move
+} rapid_move_t;
+
+static const rapid_move_t rapid_moves[RAPID_MOVES] = {
+  { {300, -120, 40}, 300 },
+  { {-7, 200, 0}, 300 },
+  { {0, 0, -50}, 300 },
+  { {400, 399, 1}, 300 },
+  { {-3, -2, 1}, 300 },
+  { {512, -256, 64}, 1600 },  // aligned, planned in coarser steps
+};
+
+// Runs one rapid from a fresh edge log, returns 0 if it did not finish
+static uint8_t run_rapid(const rapid_move_t *m)
+{
+  uint32_t ms = 0;
+  uint8_t k;
+
+  for(k=0; k<3; k++) {
+    test_tmc[k].edges = 0;
+  }
+  rapid_rate = m->rate;
+  next_motion = new_rapid_motion(m->move[0], m->move[1], m->move[2], 1);
+  motion_start();
+  while ( (motion || next_motion) && (ms++ < 10000) ) {
+    test_run_ms(1);
+  }
+  return !motion && !next_motion;
+}
+
+void test_rapid_ends(void)
+{
+  const rapid_move_t *m;
+  test_tmc_t *major;
+  test_tmc_t *dev;
+  int32_t want[3];
+  int32_t start[3];
+  int32_t step;
+  uint64_t t0, p, at;
+  uint32_t longest;
+  uint32_t k;
+  uint8_t b, i;
+  uint32_t saved_rate = rapid_rate;
+
+  for(b=0; b<RAPID_MOVES; b++) {
+    m = &rapid_moves[b];
+    want[X_AXIS] = m->move[0];
+    want[Y_AXIS] = m->move[1];
+    want[Z_AXIS] = m->move[2];
+    for(i=0; i<3; i++) {
+      start[i] = test_tmc[i].position;
+    }
+    CHECK(run_rapid(m));
+
+    major = &test_tmc[0];
+    for(i=0; i<3; i++) {
+      dev = &test_tmc[i];
+      CHECK_EQ(dev->position - start[i], want[i]);
+      if (dev->edges > major->edges) {
+        major = dev;
+      }
+    }
+
+    // the longest axis steps once a period from the block start
+    longest = major->edges;
+    if (longest < 2) {
+      continue;
+    }
+    p = major->edge_aclk[1] - major->edge_aclk[0];
+    t0 = major->edge_aclk[0] - p;
+    for(i=0; i<3; i++) {
+      dev = &test_tmc[i];
+      step = dev->edges ? abs(dev->edge_move[0]) : 1;
+      CHECK_EQ(dev->edges * step, abs(want[i]));
+      // step k of d lands within half a period of k/d of the way through
+      for(k=0; k<dev->edges; k++) {
+        at = t0 + ((uint64_t) (k + 1) * longest * p + dev->edges / 2) / dev->edges;
+        CHECK(llabs((int64_t) (dev->edge_aclk[k] - at)) <= (int64_t) (p / 2 + 1));
+      }
+    }
+  }
+  rapid_rate = saved_rate;
+
+  CHECK_EQ(pos[X_AXIS], test_tmc[X_AXIS].position);
+  CHECK_EQ(pos[Y_AXIS], test_tmc[Y_AXIS].position);
+  CHECK_EQ(pos[Z_AXIS], test_tmc[Z_AXIS].position);
+}
@@ -0,0 +1,130 @@
+// File       : test_rle.c
+// Author     : Jeff Schornick
+//
+// Run-length coded step tables: with every repeat expanded, the tables
+// built for the bench moves are entry for entry those built with
+// interp_rle cleared, and folding leaves fewer entries.
+//
+// Compilation: host GCC, see `make test`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "tmc.h"
+#include "motion.h"
+#include "stepper.h"
+#include "interpolate.h"
+#include "test.h"
+
+#define RLE_MOVES 7
+#define RLE_RATE 200
+
+typedef struct {
+  int32_t end[3];  // X, Y, Z
+  int32_t i;       // arc center offsets
+  int32_t j;
+  int8_t rot;      // 0 = linear, else arc direction
+  uint8_t rapid;
+} rle_move_t;
+
+// the moves of bench.c, and a rapid
+static const rle_move_t rle_moves[RLE_MOVES] = {
+  { {1000, 400, 0}, 0, 0, 0, 0 },
+  { {300, -700, 50}, 0, 0, 0, 0 },
+  { {5, 3, 0}, 0, 0, 0, 0 },
+  { {200, 0, 0}, 100, 0, -1, 0 },
+  { {0, 0, 0}, 100, 0, 1, 0 },
+  { {20, 20, 0}, 10, 10, 1, 0 },
+  { {600, -250, 40}, 0, 0, 0, 1 },
+};
+
+static void rle_build(const rle_move_t *m, uint8_t rle, motion_t *block)
+{
+  int32_t start[3] = {0, 0, 0};
+  int32_t end[3];
+
+  end[X_AXIS] = m->end[0];
+  end[Y_AXIS] = m->end[1];
+  end[Z_AXIS] = m->end[2];
+  block->id = 0;
+  block->shift = 0;
+
+  interp_rle = rle;
+  if (m->rot) {
+    arc_interpolate(start, end, m->i, m->j, m->rot, RLE_RATE, block);
+  } else if (m->rapid) {
+    rapid_interpolate(start, end, rapid_rate, block);
+  } else {
+    linear_interpolate(start, end, RLE_RATE, block);
+  }
+  interp_rle = 1;
+}
+
+// Checks that `rle` with its repeats expanded is `plain`, returns the
+// number of expanded entries
+static uint32_t rle_compare(step_timing_t *rle, uint32_t rle_count, step_timing_t *plain,
+                            uint32_t plain_count)
+{
+  uint32_t n = 0;
+  uint32_t i;
+  uint16_t k;
+
+  for(i=0; i<rle_count; i++) {
+    for(k=0; k<=rle[i].repeat; k++, n++) {
+      if (n >= plain_count) {
+        continue;
+      }
+      CHECK_EQ(rle[i].timer_ticks, plain[n].timer_ticks);
+      CHECK_EQ(rle[i].step_data, plain[n].step_data);
+    }
+  }
+  CHECK_EQ(n, plain_count);
+  for(i=0; i<plain_count; i++) {
+    CHECK_EQ(plain[i].repeat, 0);
+  }
+  return n;
+}
+
+static void rle_free(motion_t *block)
+{
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+  uint8_t axis;
+
+  for(axis=0; axis<3; axis++) {
+    free(block->axis_steps[axis]);
+  }
+#endif
+  free(block->steps);
+}
+
+void test_rle_tables(void)
+{
+  motion_t rle;
+  motion_t plain;
+  uint32_t folded = 0;
+  uint32_t entries = 0;
+  uint8_t m;
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+  uint8_t axis;
+#endif
+
+  for(m=0; m<RLE_MOVES; m++) {
+    rle_build(&rle_moves[m], 1, &rle);
+    rle_build(&rle_moves[m], 0, &plain);
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+    CHECK_EQ(rle.ticks, plain.ticks);
+    for(axis=0; axis<3; axis++) {
+      entries += rle_compare(rle.axis_steps[axis], rle.axis_count[axis],
+                             plain.axis_steps[axis], plain.axis_count[axis]);
+      folded += rle.axis_count[axis];
+    }
+#else
+    entries += rle_compare(rle.steps, rle.count, plain.steps, plain.count);
+    folded += rle.count;
+#endif
+    rle_free(&rle);
+    rle_free(&plain);
+  }
+  // the moves have uniform stretches to fold
+  CHECK(folded < entries);
+}
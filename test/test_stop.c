@@ -0,0 +1,122 @@
+// File       : test_stop.c
+// Author     : Jeff Schornick
+//
+// Feed hold on a driver fault: a fault raised mid-block stops the STEP
+// edges within a step timer tick, with pos[] still following the drivers,
+// and once the fault is cleared the held block resumes and ends exactly at
+// its target.
+//
+// Compilation: host GCC, see `make test`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include "tmc.h"
+#include "timer.h"
+#include "motion.h"
+#include "stepper.h"
+#include "health.h"
+#include "test.h"
+
+#define STOP_MOVES 3
+
+typedef struct {
+  int32_t move[3];  // X, Y, Z
+  int32_t i;        // arc center offsets
+  int32_t j;
+  int8_t rot;       // 0 = linear, else arc direction as new_arc_motion
+  uint16_t rate;
+  uint16_t fault_ms;  // time into the block the fault is raised
+} stop_move_t;
+
+static const stop_move_t stop_moves[STOP_MOVES] = {
+  { {600, -250, 40}, 0, 0, 0, 300, 40 },
+  { {-150, 800, -60}, 0, 0, 0, 500, 170 },
+  { {0, 0, 0}, -30, 40, 1, 300, 90 },   // full circle, DIR reversals
+};
+
+static motion_t *stop_block(const stop_move_t *m)
+{
+  if (m->rot) {
+    return new_arc_motion(m->move[0], m->move[1], m->i, m->j, m->rot, m->rate, 1);
+  }
+  return new_linear_motion(m->move[0], m->move[1], m->move[2], m->rate, 1);
+}
+
+// Runs until the queue drains, returns 0 if it did not
+static uint8_t stop_finish(void)
+{
+  uint32_t ms = 0;
+
+  while ( (motion || next_motion) && (ms++ < 20000) ) {
+    test_run_ms(1);
+  }
+  return !motion && !next_motion;
+}
+
+void test_stop_fault(void)
+{
+  const stop_move_t *m;
+  test_tmc_t *dev;
+  int32_t start[3];
+  int32_t want[3];
+  uint64_t held;
+  uint32_t late;
+  uint32_t ms;
+  uint32_t k;
+  uint8_t b, i;
+
+  for(b=0; b<STOP_MOVES; b++) {
+    m = &stop_moves[b];
+    want[X_AXIS] = m->move[0];
+    want[Y_AXIS] = m->move[1];
+    want[Z_AXIS] = m->move[2];
+    for(i=0; i<3; i++) {
+      start[i] = test_tmc[i].position;
+      test_tmc[i].edges = 0;
+    }
+    next_motion = stop_block(m);
+    motion_start();
+    ms = 0;
+    while (!motion && (ms++ < 2000)) {
+      test_run_ms(1);
+    }
+    test_run_ms(m->fault_ms);
+    CHECK(motion != 0);
+
+    // the hold is taken by the main loop at the end of some millisecond
+    test_tmc[Y_AXIS].faults = TMC_STAT_OT;
+    ms = 0;
+    while (!(motion_inhibit & MOTION_INHIBIT_FAULT) && (ms++ < 1000)) {
+      test_run_ms(1);
+    }
+    CHECK(motion_inhibit & MOTION_INHIBIT_FAULT);
+    CHECK(motion != 0);
+    held = test_aclk;
+#if (STEP_BACKEND == STEP_BACKEND_AXIS) || (STEP_BACKEND == STEP_BACKEND_DMA)
+    late = 0;  // the streams are halted on the spot
+#else
+    late = timer_host_step_ccr + 1;  // the step already due is made
+#endif
+    test_run_ms(500);
+
+    for(i=0; i<3; i++) {
+      dev = &test_tmc[i];
+      CHECK(dev->edges < TEST_TMC_EDGES);
+      for(k=0; k<dev->edges; k++) {
+        CHECK(dev->edge_aclk[k] <= held + late);
+      }
+      CHECK_EQ(pos[i], dev->position);
+    }
+
+    // cleared, the job carries on from where it was held
+    test_tmc[Y_AXIS].faults = 0;
+    test_run_ms(200);
+    health_clear();
+    motion_start();
+    CHECK(stop_finish());
+    for(i=0; i<3; i++) {
+      CHECK_EQ(test_tmc[i].position - start[i], want[i]);
+      CHECK_EQ(pos[i], test_tmc[i].position);
+    }
+  }
+}
@@ -0,0 +1,111 @@
+// File       : test_stream.c
+// Author     : Jeff Schornick
+//
+// Step tables against the blocks they were planned for: each axis' steps,
+// with their DIR reversals, add up to the requested move. With
+// STEP_BACKEND_AXIS every axis stream also has to fit in the block clock,
+// and the streams of a linear move all end on its last tick.
+//
+// Compilation: host GCC, see `make test`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include "tmc.h"
+#include "motion.h"
+#include "stepper.h"
+#include "test.h"
+
+#define STREAM_BLOCKS 9
+
+typedef struct {
+  int32_t move[3];  // X, Y, Z
+  int32_t i;        // arc center offsets
+  int32_t j;
+  int8_t rot;       // 0 = linear, else arc direction as new_arc_motion
+  uint16_t rate;    // 0 = rapid
+} stream_move_t;
+
+static const stream_move_t stream_moves[STREAM_BLOCKS] = {
+  { {300, -120, 40}, 0, 0, 0, 500 },
+  { {1, 0, 0}, 0, 0, 0, 500 },
+  { {2, 0, 200}, 0, 0, 0, 50 },     // X intervals past 16 bits
+  { {-150, 80, -40}, 0, 0, 0, 0 },
+  { {2000, 3, 0}, 0, 0, 0, 0 },
+  { {200, 0, 0}, 100, 0, -1, 400 },
+  { {0, 0, 0}, -30, 40, 1, 300 },   // full circle
+  { {0, 0, 0}, -58, -14, -1, 800 },  // aligned, planned at shift 1
+  { {-20, -20, 0}, -10, -10, 1, 300 },
+};
+
+static motion_t *stream_block(const stream_move_t *m)
+{
+  if (m->rot) {
+    return new_arc_motion(m->move[0], m->move[1], m->i, m->j, m->rot, m->rate, 1);
+  }
+  if (!m->rate) {
+    return new_rapid_motion(m->move[0], m->move[1], m->move[2], 1);
+  }
+  return new_linear_motion(m->move[0], m->move[1], m->move[2], m->rate, 1);
+}
+
+// Base microsteps a table moves `axis` from the block's initial direction.
+// `ticks` gets its length, each entry's period being timer_ticks + `less`.
+static int32_t stream_moved(motion_t *block, step_timing_t *s, uint32_t count, uint8_t axis,
+                            uint8_t less, uint32_t *ticks)
+{
+  int32_t step = (block->dirs[axis] == TMC_FWD) ? (1 << block->shift) : -(1 << block->shift);
+  int32_t moved = 0;
+  uint32_t n;
+
+  *ticks = 0;
+  for(n=0; n<count; n++) {
+    *ticks += (uint32_t) (s[n].timer_ticks + less) * (s[n].repeat + 1);
+    if ((s[n].step_data >> STEPPER_BIT(axis)) & 1) {
+      moved += step * (s[n].repeat + 1);
+    }
+    if ((s[n].step_data >> (STEPPER_BIT(axis) + 1)) & 1) {
+      CHECK_EQ(s[n].repeat, 0);
+      step = -step;
+    }
+  }
+  return moved;
+}
+
+void test_stream_totals(void)
+{
+  const stream_move_t *m;
+  motion_t *block;
+  int32_t want[3];
+  uint32_t ticks;
+  uint8_t b, i;
+
+  for(b=0; b<STREAM_BLOCKS; b++) {
+    m = &stream_moves[b];
+    block = stream_block(m);
+    CHECK(block != 0);
+    if (!block) {
+      continue;
+    }
+    want[X_AXIS] = m->move[0];
+    want[Y_AXIS] = m->move[1];
+    want[Z_AXIS] = m->move[2];
+    for(i=0; i<3; i++) {
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+      CHECK(!block->steps);
+      CHECK_EQ(stream_moved(block, block->axis_steps[i], block->axis_count[i], i, 0, &ticks),
+               want[i]);
+      CHECK(ticks <= block->ticks);
+      // a linear move's axes all finish on its last tick
+      if (!m->rot && m->rate && want[i]) {
+        CHECK_EQ(ticks, block->ticks);
+      }
+      if (!want[i] && !m->rot) {
+        CHECK_EQ(block->axis_count[i], 0);
+      }
+#else
+      CHECK_EQ(stream_moved(block, block->steps, block->count, i, 1, &ticks), want[i]);
+#endif
+    }
+    free_motion(block);
+  }
+}
@@ -0,0 +1,167 @@
+// File       : test_tmc.c
+// Author     : Jeff Schornick
+//
+// Simulated TMC26x drivers for the host unit tests
+//
+// Attached as spi_host_device, each driver keeps the last datagram written
+// to every register and answers with the reading selected by the previous
+// DRVCONF.RDSEL, as the real part does. test_tmc_sample() follows the
+// STEP/DIR pins, so a driver knows its position and can be placed against
+// a wall: at or past it StallGuard reads 0 with the SG flag set. STST is
+// reported once STEP has been idle for TEST_TMC_STST_ACLK, and any faults
+// a test raises with every reading.
+//
+// Compilation: host GCC, see `make test`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include <string.h>
+#include "hal.h"
+#include "gpio.h"
+#include "spi.h"
+#include "tmc.h"
+#include "test.h"
+
+test_tmc_t test_tmc[3];
+
+static uint8_t test_tmc_synced;  // pin levels latched, see test_tmc_sync()
+
+static uint8_t test_tmc_stalled(test_tmc_t *dev)
+{
+  return dev->wall_side && ((dev->position - dev->wall) * dev->wall_side >= 0);
+}
+
+// Builds the 20-bit response for the current RDSEL
+static uint32_t test_tmc_response(test_tmc_t *dev)
+{
+  uint32_t raw = dev->faults;
+  uint16_t sg = dev->sg;
+
+  if (test_tmc_stalled(dev)) {
+    sg = 0;
+    raw |= TMC_STAT_SG;
+  }
+  if (test_aclk - dev->step_aclk >= TEST_TMC_STST_ACLK) {
+    raw |= TMC_STAT_STST;
+  }
+  switch (dev->rdsel) {
+    case TMC_RDSEL_SG:
+      raw |= (uint32_t) (sg & 0x3ff) << 10;
+      break;
+    case TMC_RDSEL_SGCS:
+      raw |= (uint32_t) (sg >> 5) << 15;
+      raw |= (uint32_t) (dev->reg[TMC_REG_SGCSCONF] & 0x1f) << 10;  // SE at CSCALE
+      break;
+    default:
+      break;
+  }
+  return raw;
+}
+
+static void test_tmc_device(spi_job_t *job)
+{
+  test_tmc_t *dev = &test_tmc[job->tag];
+  uint32_t data;
+  uint32_t raw;
+  drvconf_t drvconf;
+
+  // edges made before the datagram see the old settings
+  test_tmc_sample();
+
+  data = ((uint32_t) job->tx[0] << 16) | ((uint32_t) job->tx[1] << 8) | job->tx[2];
+  data &= 0xfffff;
+
+  raw = test_tmc_response(dev);
+  job->rx[0] = (raw >> 12) & 0xff;
+  job->rx[1] = (raw >> 4) & 0xff;
+  job->rx[2] = (raw & 0xf) << 4;
+
+  if (dev->logged < TEST_TMC_LOG) {
+    dev->log[dev->logged] = data;
+  }
+  dev->logged++;
+  dev->reg[TMC_REG_INDEX(data)] = data;
+  if (TMC_REG_INDEX(data) == TMC_REG_DRVCONF) {
+    drvconf.raw = data;
+    dev->rdsel = drvconf.RDSEL;
+  }
+}
+
+// Function: test_tmc_reset
+//
+// Powers up fresh drivers: no registers written, position 0, no wall, a
+// nominal StallGuard reading. Attaches them to the host SPI bus.
+void test_tmc_reset(void)
+{
+  uint8_t i;
+
+  memset(test_tmc, 0, sizeof(test_tmc));
+  test_tmc_synced = 0;
+  for(i=0; i<3; i++) {
+    test_tmc[i].sg = 500;
+  }
+  spi_host_device = test_tmc_device;
+}
+
+// Function: test_tmc_sync
+//
+// Latches the STEP/DIR levels after tmc_init() has set up the pins, so the
+// initial levels do not count as steps.
+void test_tmc_sync(void)
+{
+  uint8_t i;
+
+  for(i=0; i<3; i++) {
+    test_tmc[i].step = gpio_get_output(tmc_pins[i].step_port, tmc_pins[i].step_pin) ? 1 : 0;
+    test_tmc[i].dir = gpio_get_output(tmc_pins[i].dir_port, tmc_pins[i].dir_pin) ? 1 : 0;
+  }
+  test_tmc_synced = 1;
+}
+
+// Function: test_tmc_sample
+//
+// Moves each driver by its STEP edges since the last call. Every edge
+// counts with DRVCTL.DEDGE set, otherwise only rising ones, and an edge is
+// 2^(MRES - base MRES) base microsteps. Edges are logged with their tick.
+void test_tmc_sample(void)
+{
+  test_tmc_t *dev;
+  drvctl_t drvctl;
+  int16_t move;
+  uint8_t step;
+  uint8_t fwd;
+  uint8_t i;
+
+  if (!test_tmc_synced) {
+    return;
+  }
+  for(i=0; i<3; i++) {
+    dev = &test_tmc[i];
+    step = gpio_get_output(tmc_pins[i].step_port, tmc_pins[i].step_pin) ? 1 : 0;
+    dev->dir = gpio_get_output(tmc_pins[i].dir_port, tmc_pins[i].dir_pin) ? 1 : 0;
+    if (step == dev->step) {
+      continue;
+    }
+    dev->step = step;
+    dev->step_aclk = test_aclk;
+    drvctl.raw = dev->reg[TMC_REG_DRVCTL];
+    if (!drvctl.DEDGE && !step) {
+      continue;
+    }
+    if (!dev->stepped) {
+      memcpy(dev->reg_stepped, dev->reg, sizeof(dev->reg));
+      dev->stepped = 1;
+    }
+    fwd = (dev->dir == (tmc_axis_conf[i] == TMC_POLARITY_NORMAL));
+    move = 1 << (drvctl.MRES - tmc_base_mres[i]);
+    if (!fwd) {
+      move = -move;
+    }
+    dev->position += move;
+    if (dev->edges < TEST_TMC_EDGES) {
+      dev->edge_aclk[dev->edges] = test_aclk;
+      dev->edge_move[dev->edges] = move;
+    }
+    dev->edges++;
+  }
+}
@@ -0,0 +1,155 @@
+// File       : test_trace.c
+// Author     : Jeff Schornick
+//
+// STEP edges seen by the drivers against the step tables they came from:
+// every edge at the tick its table entry sets, in the right direction and
+// size, across back-to-back blocks.
+//
+// Compilation: host GCC, see `make test`
+// Version    : See GitHub repository jschornick/cnc for revision details
+
+#include <stdint.h>
+#include <string.h>
+#include "tmc.h"
+#include "motion.h"
+#include "stepper.h"
+#include "test.h"
+
+#define TRACE_BLOCKS 5
+
+typedef struct {
+  uint32_t count[3];
+  uint64_t aclk[3][TEST_TMC_EDGES];  // relative to the first block's start
+  int16_t move[3][TEST_TMC_EDGES];
+} trace_t;
+
+static trace_t expect;
+
+static void expect_edge(uint8_t axis, uint64_t aclk, int16_t move)
+{
+  uint32_t n = expect.count[axis]++;
+
+  if (n < TEST_TMC_EDGES) {
+    expect.aclk[axis][n] = aclk;
+    expect.move[axis][n] = move;
+  }
+}
+
+// Expected edges of one block starting at `start`, returns when the next
+// block starts
+static uint64_t expect_block(motion_t *block, uint64_t start)
+{
+  step_timing_t *s;
+  int16_t move[3];
+  uint64_t t;
+  uint32_t n;
+  uint16_t r;
+  uint8_t i;
+
+  for(i=0; i<3; i++) {
+    move[i] = (block->dirs[i] == TMC_FWD) ? (1 << block->shift) : -(1 << block->shift);
+  }
+
+#if STEP_BACKEND == STEP_BACKEND_AXIS
+  // each stream runs from the block start, the next block starts at its end
+  for(i=0; i<3; i++) {
+    t = start;
+    for(n=0; n<block->axis_count[i]; n++) {
+      s = &block->axis_steps[i][n];
+      for(r=0; r<=s->repeat; r++) {
+        t += s->timer_ticks;
+        if ((s->step_data >> STEPPER_BIT(i)) & 1) {
+          expect_edge(i, t, move[i]);
+        }
+      }
+      if ((s->step_data >> (STEPPER_BIT(i) + 1)) & 1) {
+        move[i] = -move[i];
+      }
+    }
+  }
+  return start + block->ticks;
+#else
+  // each entry's period ends at its step, the next block is timed from
+  // the last one
+  t = start;
+  for(n=0; n<block->count; n++) {
+    s = &block->steps[n];
+    for(r=0; r<=s->repeat; r++) {
+      t += s->timer_ticks + 1;
+      for(i=0; i<3; i++) {
+        if ((s->step_data >> STEPPER_BIT(i)) & 1) {
+          expect_edge(i, t, move[i]);
+        }
+      }
+    }
+    for(i=0; i<3; i++) {
+      if ((s->step_data >> (STEPPER_BIT(i) + 1)) & 1) {
+        move[i] = -move[i];
+      }
+    }
+  }
+  return t;
+#endif
+}
+
+static motion_t *trace_block(uint8_t n)
+{
+  switch (n) {
+    case 0:
+      return new_linear_motion(300, -120, 40, 500, 1);
+    case 1:
+      return new_arc_motion(200, 0, 100, 0, -1, 400, 2);
+    case 2:
+      return new_linear_motion(3, 1, 0, 500, 3);
+    case 3:
+      return new_rapid_motion(-150, 80, -40, 4);
+    default:
+      return new_arc_motion(-20, -20, -10, -10, 1, 300, 5);
+  }
+}
+
+void test_trace_tables(void)
+{
+  int32_t moved[3] = {0, 0, 0};
+  uint64_t start = 0;
+  uint64_t offset;
+  uint32_t ms = 0;
+  uint8_t queued = 0;
+  uint8_t i;
+  uint32_t n;
+
+  memset(&expect, 0, sizeof(expect));
+
+  // keep the next block queued, so the blocks run back to back
+  while ( ((queued < TRACE_BLOCKS) || motion || next_motion) && (ms++ < 20000) ) {
+    if ( (queued < TRACE_BLOCKS) && !next_motion && (motion || !queued) ) {
+      next_motion = trace_block(queued++);
+      start = expect_block(next_motion, start);
+      if (queued == 1) {
+        motion_start();
+      }
+    }
+    test_run_ms(1);
+  }
+  CHECK(!motion && !next_motion);
+
+  // the first block starts when the timer picks it up, align on its first edge
+  CHECK(test_tmc[X_AXIS].edges > 0);
+  offset = test_tmc[X_AXIS].edge_aclk[0] - expect.aclk[X_AXIS][0];
+
+  for(i=0; i<3; i++) {
+    CHECK(expect.count[i] <= TEST_TMC_EDGES);
+    CHECK_EQ(test_tmc[i].edges, expect.count[i]);
+    for(n=0; (n<expect.count[i]) && (n<test_tmc[i].edges) && (n<TEST_TMC_EDGES); n++) {
+      if ( (test_tmc[i].edge_aclk[n] != expect.aclk[i][n] + offset) ||
+           (test_tmc[i].edge_move[n] != expect.move[i][n]) ) {
+        CHECK_EQ(test_tmc[i].edge_aclk[n], expect.aclk[i][n] + offset);
+        CHECK_EQ(test_tmc[i].edge_move[n], expect.move[i][n]);
+        break;
+      }
+      moved[i] += expect.move[i][n];
+    }
+    CHECK_EQ(test_tmc[i].position, moved[i]);
+    CHECK_EQ(pos[i], moved[i]);
+  }
+}